@@ -21,6 +21,7 @@ const chain_message_type subscribe_message::type = chain_message_type::subscribe
 const chain_message_type block_message::type = chain_message_type::block_msg;
 const chain_message_type trx_message::type = chain_message_type::trx_msg;
 const chain_message_type trx_err_message::type = chain_message_type::trx_err_msg;
+const chain_message_type chain_status_message::type = chain_message_type::chain_status_msg;
 
   namespace detail
   {
@@ -278,19 +279,37 @@ const chain_message_type trx_err_message::type = chain_message_type::trx_err_msg
           while( !my->exec_sync_loop_complete.canceled() )
           {
              try {
+                // read every block of this pass from the same view of the chain so
+                // that blocks pushed while we sleep do not tear the sequence
+                auto chain_snap = my->chain->get_snapshot();
                 int32_t  cur_block_num  = int32_t(-1);
                 if( my->_last_block_id != bts::blockchain::block_id_type() )
-                    cur_block_num = my->chain->fetch_block_num( my->_last_block_id );
-                ilog( "head block ${h}  cur block ${c}", ("c",cur_block_num)("h",my->chain->head_block_num() ) );
-                while( cur_block_num < int32_t(my->chain->head_block_num())  )
+                    cur_block_num = chain_snap->fetch_block_num( my->_last_block_id );
+                ilog( "head block ${h}  cur block ${c}", ("c",cur_block_num)("h",chain_snap->head_block_num() ) );
+                uint32_t first_full = my->chain->first_full_block();
+                if( cur_block_num + 1 < int32_t(first_full) )
+                {
+                    // the blocks in between were pruned, tell the client and send what is left
+                    wlog( "pruned blocks ${c} to ${f}, skipping ahead", ("c",cur_block_num + 1)("f",first_full - 1) );
+                    chain_status_message status;
+                    status.head_block_num   = chain_snap->head_block_num();
+                    status.first_full_block = first_full;
+                    send( message( status ) );
+                    cur_block_num = int32_t(first_full) - 1;
+                }
+                while( cur_block_num < int32_t(chain_snap->head_block_num())  )
                 {
                     cur_block_num++;
-                    block_message blk_msg;
-                    blk_msg.block_data = my->chain->fetch_trx_block( cur_block_num );
-                    // TODO: sign it..
-                    ilog( "sending block ${n} ${c}", ("n",cur_block_num)("c",blk_msg.block_data.id()) );
-                    send( mail::message(blk_msg) );
-                    my->_last_block_id = blk_msg.block_data.id();
+                    // the archived block followed by an empty set of sigs is a packed block_message
+                    mail::message blk_msg;
+                    blk_msg.type = block_message::type;
+                    blk_msg.data = chain_snap->fetch_packed_trx_block( cur_block_num );
+                    blk_msg.data.push_back( 0 ); // TODO: sign it..
+                    blk_msg.size = blk_msg.data.size();
+                    auto blk_id  = chain_snap->fetch_block( cur_block_num ).id();
+                    ilog( "sending block ${n} ${c}", ("n",cur_block_num)("c",blk_id) );
+                    send( blk_msg );
+                    my->_last_block_id = blk_id;
                     fc::usleep( fc::microseconds( 1000*100 ) );
                 }
                 ilog( "all synced up, no blocks left to send" );
@@ -9,10 +9,11 @@ enum chain_message_type
     subscribe_msg = 1,
     block_msg     = 2,
     trx_msg       = 3,
-    trx_err_msg   = 4
+    trx_err_msg   = 4,
+    chain_status_msg = 5
 
 };
-FC_REFLECT_ENUM( chain_message_type, (subscribe_msg)(block_msg)(trx_msg)(trx_err_msg) )
+FC_REFLECT_ENUM( chain_message_type, (subscribe_msg)(block_msg)(trx_msg)(trx_err_msg)(chain_status_msg) )
 
 struct subscribe_message
 {
@@ -50,3 +51,17 @@ struct trx_err_message
    std::string                            err;
 };
 FC_REFLECT( trx_err_message, (signed_trx)(err) )
+
+/**
+ *  Sent by a pruned server before it skips to the first block it still has in
+ *  full, a client behind it has to import a chain state file to follow.
+ */
+struct chain_status_message
+{
+   static const chain_message_type type;
+   chain_status_message():head_block_num(uint32_t(-1)),first_full_block(0){}
+
+   uint32_t                               head_block_num;
+   uint32_t                               first_full_block;
+};
+FC_REFLECT( chain_status_message, (head_block_num)(first_full_block) )
@@ -6,6 +6,7 @@
 #include <mail/message.hpp>
 #include <mail/stcp_socket.hpp>
 #include <bts/blockchain/blockchain_db.hpp>
+#include <bts/blockchain/mempool.hpp>
 #include <bts/db/level_map.hpp>
 #include <fc/time.hpp>
 #include <fc/network/tcp_socket.hpp>
@@ -102,7 +103,7 @@ namespace detail
    {
       public:
         chain_server_impl()
-        :ser_del(nullptr)
+        :ser_del(nullptr),pending(&chain)
         {}
 
         ~chain_server_impl()
@@ -143,7 +144,7 @@ namespace detail
                                                                                             
         fc::future<void>                                                                     accept_loop_complete;
        // fc::future<void>                                                                     block_gen_loop_complete;
-        std::unordered_map<bts::blockchain::transaction_id_type,bts::blockchain::signed_transaction> pending;
+        bts::blockchain::mempool                                                             pending;
 
 
        /* void block_gen_loop()
@@ -237,10 +238,7 @@ namespace detail
                 try {
                    auto blk = m.as<block_message>();
                    chain.push_block( blk.block_data );
-                   for( auto itr = blk.block_data.trxs.begin(); itr != blk.block_data.trxs.end(); ++itr )
-                   {
-                      pending.erase( itr->id() );
-                   }
+                   pending.handle_block( blk.block_data );
                    broadcast_block( blk.block_data );
                 }
                 catch ( const fc::exception& e )
@@ -258,8 +256,8 @@ namespace detail
                 ilog( "recv: ${m}", ("m",trx) );
                 try 
                 {
-                   chain.evaluate_signed_transaction( trx.signed_trx ); // throws exception if invalid trx.
-                   if( pending.insert( std::make_pair(trx.signed_trx.id(),trx.signed_trx) ).second )
+                   // throws exception if invalid trx.
+                   if( pending.add( hashed_transaction( trx.signed_trx ) ) )
                    {
                       fc::async( [=]() { broadcast( m ); } );
                    }
@@ -405,6 +403,11 @@ void chain_server::configure( const chain_server::config& c )
     // my->block_gen_loop_complete = fc::async( [=](){ my->block_gen_loop(); } ); 
      
      my->chain.open( "chain" );
+     my->chain.set_prune_depth( c.prune_depth );
+     if( my->chain.head_block_num() == uint32_t(-1) && c.import_state.size() )
+     {
+         my->chain.import_state( c.import_state );
+     }
      if( my->chain.head_block_num() == uint32_t(-1) )
      {
          auto genesis = create_test_genesis_block();
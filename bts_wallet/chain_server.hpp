@@ -46,10 +46,12 @@
         struct config
         {
             config()
-            :port(0){}
+            :port(0),prune_depth(0){}
             uint16_t                 port;  ///< the port to listen for incoming connections on.
             std::vector<std::string> blacklist;  // host's that are blocked from connecting
             std::vector<fc::ip::endpoint> mirrors;  // host's that are blocked from connecting
+            std::string              import_state; ///< chain state file loaded instead of the genesis block into an empty chain
+            uint32_t                 prune_depth;  ///< blocks of history kept, 0 keeps every block
         };
         
         chain_server();
@@ -79,4 +81,4 @@
   };
   typedef std::shared_ptr<chain_server> chain_server_ptr;
 
-FC_REFLECT( chain_server::config, (port)(mirrors) )
+FC_REFLECT( chain_server::config, (port)(mirrors)(import_state)(prune_depth) )
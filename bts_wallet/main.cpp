@@ -14,6 +14,7 @@
 #include <fc/log/logger.hpp>
 #include <fstream>
 #include <bts/blockchain/blockchain_printer.hpp>
+#include <bts/blockchain/mempool.hpp>
 #include "chain_connection.hpp"
 #include "chain_messages.hpp"
 #include <fc/network/tcp_socket.hpp>
@@ -42,7 +43,7 @@ std::string to_balance( uint64_t a )
 struct client_config
 {
     client_config()
-    :rpc_endpoint( fc::ip::endpoint::from_string("127.0.0.1:0") ),ignore_console(false)
+    :rpc_endpoint( fc::ip::endpoint::from_string("127.0.0.1:0") ),ignore_console(false),prune_depth(0)
     {
         //unique_node_list["162.243.45.158:4567"] = "";
         unique_node_list["127.0.0.1:4567"] = "";
@@ -53,10 +54,44 @@ struct client_config
     std::string      rpc_password;
     bool             ignore_console;
 
+    /// "HEIGHT:BLOCK_ID" of a trusted block, signatures of its ancestors are not checked
+    std::string      assume_valid;
+    /// file of fc::raw packed std::vector<block_header> ending at the trusted block, which
+    /// proves which blocks are its ancestors, relative to the data directory
+    std::string      assume_valid_headers;
+
+    /// blocks of history kept by the chain, 0 keeps every block
+    uint32_t         prune_depth;
+
     /// map "IP:PORT" to "publickey" of the node that we are connecting to.
     std::unordered_map<std::string,std::string> unique_node_list;
 };
-FC_REFLECT( client_config, (rpc_endpoint)(rpc_user)(rpc_password)(unique_node_list)(ignore_console) )
+FC_REFLECT( client_config, (rpc_endpoint)(rpc_user)(rpc_password)(unique_node_list)(ignore_console)(assume_valid)(assume_valid_headers)(prune_depth) )
+
+/**
+ *  Configures @param chain to skip signature checks up to the block given
+ *  as "HEIGHT:BLOCK_ID" by @param checkpoint.
+ */
+void set_assume_valid( blockchain_db& chain, const std::string& checkpoint )
+{ try {
+    auto pos = checkpoint.find( ':' );
+    FC_ASSERT( pos != std::string::npos, "expected HEIGHT:BLOCK_ID" );
+    uint32_t      block_num = fc::variant( checkpoint.substr( 0, pos ) ).as<uint32_t>();
+    block_id_type block_id( checkpoint.substr( pos + 1 ) );
+    chain.set_assume_valid( block_num, block_id );
+} FC_RETHROW_EXCEPTIONS( warn, "invalid assume valid checkpoint ${c}", ("c",checkpoint) ) }
+
+/**
+ *  Loads the headers leading up to the assume valid block from @param headers_file,
+ *  without them every signature is still checked.
+ */
+void load_assume_valid_headers( blockchain_db& chain, const fc::path& headers_file )
+{ try {
+    std::ifstream in( headers_file.generic_string().c_str(), std::ios::binary );
+    FC_ASSERT( in, "unable to open the file" );
+    std::vector<char> packed( (std::istreambuf_iterator<char>( in )), std::istreambuf_iterator<char>() );
+    chain.add_assume_valid_headers( fc::raw::unpack<std::vector<block_header>>( packed ) );
+} FC_RETHROW_EXCEPTIONS( warn, "unable to load assume valid headers from ${f}", ("f",headers_file) ) }
 
 void dump_vec(std::vector<char> v) {
     std::cout << std::hex;
@@ -104,7 +139,7 @@ class client : public chain_connection_delegate
       fc::path                                      _datadir;
       std::unordered_set<fc::rpc::json_connection*> _login_set;
       client_config                                 _config;
-      std::unordered_map<bts::blockchain::transaction_id_type,bts::blockchain::signed_transaction> pending;
+      bts::blockchain::mempool                      pending;
 
       fc::signal<void()>                            _exit_signal;
       void wait_for_quit()
@@ -240,6 +275,20 @@ class client : public chain_connection_delegate
             return fc::variant(data);
          });
 
+         /**
+          *  @param quote
+          *  @param base
+          *  @param levels - optional, BLOCKCHAIN_ORDER_BOOK_LEVELS by default
+          */
+         con->add_method( "getorderbook", [=]( const fc::variants& params ) -> fc::variant 
+         {
+            FC_ASSERT( _chain_connected );
+            FC_ASSERT( params.size() == 2 || params.size() == 3 );
+
+            uint32_t levels = params.size() == 3 ? params[2].as<uint32_t>() : BLOCKCHAIN_ORDER_BOOK_LEVELS;
+            return fc::variant( chain.get_order_book( params[0].as<asset::type>(), params[1].as<asset::type>(), levels ) );
+         });
+
          con->add_method( "getnewaddress", [=]( const fc::variants& params ) -> fc::variant 
          {
              check_login( capture_con );
@@ -271,6 +320,26 @@ class client : public chain_connection_delegate
              return fc::variant( chain.get_market_history( quote, base, from, to, blocks_per_point ) );
          });
 
+         /**
+          *  @param quote
+          *  @param base
+          *  @param resolution - seconds per candle: 3600, 86400 or 604800
+          *  @param from 
+          *  @param to 
+          */
+         con->add_method( "market_candles", [=]( const fc::variants& params ) -> fc::variant 
+         {
+             FC_ASSERT( _chain_connected );
+             FC_ASSERT( params.size() == 5 );
+
+             auto quote      = params[0].as<bts::blockchain::asset::type>();
+             auto base       = params[1].as<bts::blockchain::asset::type>();
+             auto resolution = params[2].as<uint32_t>();
+             auto from       = params[3].as<fc::time_point_sec>();
+             auto to         = params[4].as<fc::time_point_sec>();
+             return fc::variant( chain.get_market_candles( quote, base, resolution, from, to ) );
+         });
+
          con->add_method( "transfer", [=]( const fc::variants& params ) -> fc::variant 
          {
              FC_ASSERT( _chain_connected );
@@ -453,17 +522,14 @@ class client : public chain_connection_delegate
          }
       }
 
-      client():_chain_con(this),_chain_connected(false){}
+      client():pending(&chain),_chain_con(this),_chain_connected(false){}
       virtual void on_connection_message( chain_connection& c, const message& m )
       {
          if( m.type == chain_message_type::block_msg )
          {
             auto blkmsg = m.as<block_message>();
             chain.push_block( blkmsg.block_data );
-            for( auto itr = blkmsg.block_data.trxs.begin(); itr != blkmsg.block_data.trxs.end(); ++itr )
-            {
-               pending.erase( itr->id() );
-            }
+            pending.handle_block( blkmsg.block_data );
             _wallet.set_stake( chain.get_stake(), chain.head_block_num() );
             _wallet.set_fee_rate( chain.get_fee_rate() );
             if( _wallet.scan_chain( chain, blkmsg.block_data.block_num ) )
@@ -477,8 +543,8 @@ class client : public chain_connection_delegate
          else if( m.type == trx_message::type )
          {
             auto trx_msg = m.as<trx_message>();
-            chain.evaluate_signed_transaction( trx_msg.signed_trx ); // throws exception if invalid trx.
-            if( pending.insert( std::make_pair(trx_msg.signed_trx.id(),trx_msg.signed_trx) ).second )
+            // throws exception if invalid trx.
+            if( pending.add( hashed_transaction( trx_msg.signed_trx ) ) )
             {
                // reset the mining thread...
                _new_trx = true;
@@ -490,12 +556,41 @@ class client : public chain_connection_delegate
             std::cerr<<  errmsg.err <<"\n";
             elog( "${e}", ("e", errmsg ) );
          }
+         else if( m.type == chain_status_message::type )
+         {
+            auto status = m.as<chain_status_message>();
+            if( chain.head_block_num() + 1 < status.first_full_block )
+            {
+               std::cerr<<"the server pruned the blocks below "<<status.first_full_block
+                        <<", import a chain state file with --import-state to follow it\n";
+               wlog( "server pruned the blocks below ${n}, our head is ${h}",
+                     ("n",status.first_full_block)("h",chain.head_block_num()) );
+            }
+         }
       }
 
-      void open( const fc::path& datadir )
+      /**
+       *  @param assume_valid and @param assume_valid_headers - override the config file
+       *  @param import_state - chain state file loaded into the chain if it is empty, see blockchain_db::export_state
+       */
+      void open( const fc::path& datadir, const std::string& assume_valid = std::string(),
+                 const std::string& assume_valid_headers = std::string(),
+                 const std::string& import_state = std::string() )
       { try {
           _datadir = datadir;
           chain.open( datadir / "chain" );
+          if( import_state.size() )
+          {
+             if( chain.head_block_num() == uint32_t(-1) )
+             {
+                std::cout<<"importing the chain state from "<<import_state<<"\n";
+                chain.import_state( import_state );
+             }
+             else
+             {
+                std::cerr<<"not importing "<<import_state<<" because the chain is not empty\n";
+             }
+          }
           ilog( "opening ${d}", ("d", datadir/"wallet.bts") );
           //_wallet.open( datadir / "wallet.bts" );
 
@@ -520,6 +615,21 @@ class client : public chain_connection_delegate
              fc::json::save_to_file( _config, config_file );
           }
 
+          std::string checkpoint = assume_valid.size() ? assume_valid : _config.assume_valid;
+          if( checkpoint.size() )
+          {
+             set_assume_valid( chain, checkpoint );
+             if( assume_valid_headers.size() )
+             {
+                load_assume_valid_headers( chain, fc::path( assume_valid_headers ) );
+             }
+             else if( _config.assume_valid_headers.size() )
+             {
+                load_assume_valid_headers( chain, datadir / _config.assume_valid_headers );
+             }
+          }
+          chain.set_prune_depth( _config.prune_depth );
+
           chain_connect_loop_complete = fc::async( [this](){ chain_connect_loop(); } );
           if( _config.rpc_password != std::string() )
           {
@@ -820,14 +930,8 @@ class client : public chain_connection_delegate
             {
                 fc::usleep( fc::seconds( 20 ) );
                 ilog( "buliding block..." );
-                std::vector<bts::blockchain::signed_transaction> new_trxs;
-                for( auto itr = pending.begin(); itr != pending.end(); ++itr )
-                {
-                   new_trxs.push_back(itr->second);
-                }
-
                 _new_trx   = false;
-                auto block_template = chain.generate_next_block( new_trxs );
+                auto block_template = chain.generate_next_block( pending.get_block_template() );
                 if( block_template.trxs.size() == 0 )
                 {
                    ilog( "no transactions to process" );
@@ -915,12 +1019,7 @@ class client : public chain_connection_delegate
       void mine()
       {
           ilog( "mine" );
-          std::vector<bts::blockchain::signed_transaction> new_trxs;
-          for( auto itr = pending.begin(); itr != pending.end(); ++itr )
-          {
-             new_trxs.push_back(itr->second);
-          }
-          auto block_template = chain.generate_next_block( new_trxs );
+          auto block_template = chain.generate_next_block( pending.get_block_template() );
           std::cout<<"block template\n" << fc::json::to_pretty_string(block_template)<<"\n";
           auto req = block_template.get_required_difficulty( chain.current_difficulty(), chain.available_coindays() );
           if( block_template.trxs.size() == 0 )
@@ -1413,25 +1512,65 @@ int main( int argc, char** argv )
 
    try {
      auto  bts_client = std::make_shared<client>();
-     if( argc == 1 )
+
+     std::string datadir;
+     std::string assume_valid;
+     std::string assume_valid_headers;
+     std::string import_state;
+     std::string export_state;
+     for( int i = 1; i < argc; ++i )
+     {
+        std::string arg = argv[i];
+        if( arg == "--assume-valid" && i + 1 < argc )
+        {
+           assume_valid = argv[++i];
+        }
+        else if( arg == "--assume-valid-headers" && i + 1 < argc )
+        {
+           assume_valid_headers = argv[++i];
+        }
+        else if( arg == "--import-state" && i + 1 < argc )
+        {
+           import_state = argv[++i];
+        }
+        else if( arg == "--export-state" && i + 1 < argc )
+        {
+           export_state = argv[++i];
+        }
+        else if( datadir.empty() && arg.size() && arg[0] != '-' )
+        {
+           datadir = arg;
+        }
+        else
+        {
+           std::cerr<<"Usage: "<<argv[0]<<" [DATADIR] [--assume-valid HEIGHT:BLOCK_ID] [--assume-valid-headers FILE]"
+                    <<" [--import-state FILE] [--export-state FILE]\n";
+           return -2;
+        }
+     }
+
+     if( datadir.empty() )
      {
 #ifdef WIN32
-        bts_client->open( fc::app_path() / "BitSharesX" );
+        datadir = (fc::app_path() / "BitSharesX").generic_string();
 #elif defined( __APPLE__ )
-        bts_client->open( fc::app_path() / "BitSharesX" );
+        datadir = (fc::app_path() / "BitSharesX").generic_string();
 #else
-        bts_client->open( fc::app_path() / ".bitsharesx" );
+        datadir = (fc::app_path() / ".bitsharesx").generic_string();
 #endif
      }
-     else if( argc == 2 )
-     {
-        bts_client->open( argv[1] );
-     }
-     else
+
+     if( export_state.size() )
      {
-        std::cerr<<"Usage: "<<argv[0]<<" [DATADIR]\n";
-        return -2;
+        // writes the state at the head of the local chain and exits without connecting
+        blockchain_db chain;
+        chain.open( fc::path(datadir) / "chain", false );
+        chain.export_state( export_state );
+        std::cout<<"exported the chain state at block "<<chain.head_block_num()<<" to "<<export_state<<"\n";
+        return 0;
      }
+
+     bts_client->open( datadir, assume_valid, assume_valid_headers, import_state );
      
      if( bts_client->_config.ignore_console == false )
      {
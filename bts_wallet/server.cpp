@@ -1,15 +1,46 @@
 #include "chain_server.hpp"
+#include <bts/blockchain/blockchain_db.hpp>
 #include <fc/thread/thread.hpp>
 #include <fc/log/logger_config.hpp>
+#include <fc/reflect/variant.hpp>
+
+#include <iostream>
 
 int main( int argc, char** argv )
 {
    try {
        fc::configure_logging( fc::logging_config::default_config() );
 
-       chain_server cserv;
        chain_server::config cfg;
        cfg.port = 4567;
+       for( int i = 1; i < argc; ++i )
+       {
+          std::string arg = argv[i];
+          if( arg == "--import-state" && i + 1 < argc )
+          {
+             cfg.import_state = argv[++i];
+          }
+          else if( arg == "--prune-depth" && i + 1 < argc )
+          {
+             // keeps the transactions of the last BLOCKS blocks only, 0 keeps every block
+             cfg.prune_depth = fc::variant( std::string( argv[++i] ) ).as<uint32_t>();
+          }
+          else if( arg == "--export-state" && i + 1 < argc )
+          {
+             // writes the state at the head of the local chain and exits
+             bts::blockchain::blockchain_db chain;
+             chain.open( "chain", false );
+             chain.export_state( argv[++i] );
+             return 0;
+          }
+          else
+          {
+             std::cerr<<"Usage: "<<argv[0]<<" [--import-state FILE] [--export-state FILE] [--prune-depth BLOCKS]\n";
+             return -2;
+          }
+       }
+
+       chain_server cserv;
        cserv.configure(cfg);
        ilog( "sleep..." );
        fc::usleep( fc::seconds( 60*60*24*365 ) );
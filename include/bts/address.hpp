@@ -67,4 +67,6 @@ namespace std
 }
 
 #include <fc/reflect/reflect.hpp>
+#include <bts/db/ordered_key.hpp>
 FC_REFLECT( bts::address, (addr) )
+BTS_DB_ORDERED_KEY( bts::address, (addr) )
@@ -2,6 +2,7 @@
 #include <bts/addressbook/contact.hpp>
 #include <fc/crypto/elliptic.hpp>
 #include <fc/crypto/sha512.hpp>
+#include <bts/db/fwd.hpp>
 
 #include <unordered_map>
 
@@ -24,6 +25,12 @@ namespace bts { namespace addressbook {
 
         void open( const fc::path& abook_dir, const fc::uint512& key );
 
+        /**
+         *  Stores the contacts in the shared database @param db, importing any
+         *  standalone addressbook left in @param legacy_dir.
+         */
+        void open( const db::database_ptr& db, const fc::uint512& key, const fc::path& legacy_dir );
+
         /**
          *  @return the contacts indexed by the profile ID we have assigned to them.
          */
@@ -38,6 +45,7 @@ namespace bts { namespace addressbook {
 
      private:
         void add_contact_to_lookup_tables(const wallet_contact& contact);
+        void load_contacts( const fc::uint512& key );
   
         std::unique_ptr<detail::addressbook_impl> my;
   };
@@ -1,5 +1,6 @@
 #pragma once
 #include <bts/peer/peer_channel.hpp>
+#include <bts/db/database_options.hpp>
 #include <fc/filesystem.hpp>
 
 namespace bts { namespace bitchat {
@@ -22,7 +23,8 @@ namespace bts { namespace bitchat {
       channel_config( const fc::path& p = fc::path() )
       :data_dir(p){}
 
-      fc::path data_dir;
+      fc::path             data_dir;
+      db::database_options message_cache_options;
    };
    
    /**
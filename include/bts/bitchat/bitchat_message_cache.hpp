@@ -1,5 +1,6 @@
 #pragma once
 #include <bts/bitchat/bitchat_private_message.hpp>
+#include <bts/db/database_options.hpp>
 #include <fc/filesystem.hpp>
 
 namespace bts { namespace bitchat {
@@ -16,7 +17,9 @@ namespace bts { namespace bitchat {
        message_cache();
        ~message_cache();
 
-       void                     open( const fc::path& db_dir );
+       /** @param opts - leveldb options of the message store, the indexes use the defaults */
+       void                     open( const fc::path& db_dir,
+                                      const db::database_options& opts = db::database_options() );
 
        void                     cache( const encrypted_message& msg );
        std::vector<fc::uint128> get_inventory( const fc::time_point& start_time, const fc::time_point& end_time );
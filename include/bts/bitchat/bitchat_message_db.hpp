@@ -4,6 +4,8 @@
 #include <fc/crypto/elliptic.hpp>
 #include <fc/time.hpp>
 #include <fc/io/enum_type.hpp>
+#include <bts/db/ordered_key.hpp>
+#include <bts/db/fwd.hpp>
 #include <bts/bitchat/bitchat_private_message.hpp>
 
 namespace bts { namespace bitchat {
@@ -71,6 +73,13 @@ namespace bts { namespace bitchat {
         *  @throw if the key is invalid or the database is unable to be created.
         */
        void open( const fc::path& dbdir, const fc::uint512& key, bool create = true );
+
+       /**
+        *  Opens the message database as the namespaces @param name.* of the shared
+        *  database @param db, importing any standalone database left in @param legacy_dir.
+        */
+       void open( const db::database_ptr& db, const std::string& name,
+                  const fc::uint512& key, const fc::path& legacy_dir );
        
        /**
         * Stores a new or modified message into the database and returns a message_header index to the message.
@@ -120,7 +129,7 @@ namespace bts { namespace bitchat {
      private:
        std::unique_ptr<detail::message_db_impl> my;
 
-       void update_digest_to_header(const fc::path& dbdir);
+       void update_digest_to_header();
   };
 
   typedef std::shared_ptr<message_db> message_db_ptr;
@@ -141,3 +150,17 @@ FC_REFLECT( bts::bitchat::message_header,
     (state_mark)
     (status)
     )
+
+// index order is type, received_time, to_key, from_key; the remaining members only keep keys unique
+BTS_DB_ORDERED_KEY( bts::bitchat::message_header,
+    (type)
+    (received_time)
+    (to_key)
+    (from_key)
+    (digest)
+    (from_sig)
+    (from_sig_time)
+    (ack_time)
+    (state_mark)
+    (status)
+    )
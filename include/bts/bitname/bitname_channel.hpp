@@ -3,6 +3,7 @@
 #include <bts/bitname/bitname_record.hpp>
 #include <bts/peer/peer_channel.hpp>
 #include <bts/network/server.hpp>
+#include <bts/bitname/bitname_db.hpp>
 #include <fc/filesystem.hpp>
 
 namespace bts { namespace bitname {
@@ -42,7 +43,11 @@ namespace bts { namespace bitname {
       public:
         struct config
         {
-           fc::path name_db_dir;
+           config()
+           :db_options(name_db::default_database_options()){}
+
+           fc::path             name_db_dir;
+           db::database_options db_options;  ///< used by both the name and fork databases
         };
 
         name_channel( const bts::peer::peer_channel_ptr& n );
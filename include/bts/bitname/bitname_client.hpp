@@ -2,6 +2,7 @@
 #include <bts/peer/peer_channel.hpp>
 #include <bts/bitname/bitname_block.hpp>
 #include <bts/bitname/bitname_record.hpp>
+#include <bts/bitname/bitname_db.hpp>
 #include <fc/reflect/reflect.hpp>
 #include <fc/crypto/elliptic.hpp>
 #include <fc/optional.hpp>
@@ -45,10 +46,12 @@ namespace bts { namespace bitname {
        struct config
        {
           config()
-          :max_mining_effort(0.25){} // TODO: remove magic number... 
+          :max_mining_effort(0.25), // TODO: remove magic number... 
+           database(name_db::default_database_options()){}
 
-          fc::path data_dir;
-          double   max_mining_effort;
+          fc::path             data_dir;
+          double               max_mining_effort;
+          db::database_options database;
        };
 
        void set_delegate( client_delegate* client_del );
@@ -82,5 +85,6 @@ namespace bts { namespace bitname {
 FC_REFLECT( bts::bitname::client::config,
     (data_dir)
     (max_mining_effort)
+    (database)
     )
 
@@ -1,5 +1,6 @@
 #pragma once
 #include <bts/bitname/bitname_block.hpp>
+#include <bts/db/database_options.hpp>
 #include <fc/filesystem.hpp>
 
 namespace bts { namespace bitname {
@@ -16,9 +17,15 @@ namespace bts { namespace bitname {
         name_db();
         ~name_db();
 
-        void open( const fc::path& dbdir, bool create = true );
+        static db::database_options default_database_options();
+
+        void open( const fc::path& dbdir, bool create = true,
+                   const db::database_options& opts = default_database_options() );
         void close();
 
+        /** the leveldb options the name database was opened with */
+        db::database_options get_database_options()const;
+
         /**
          *  Push the block, validating it, and throw an exception
          *  if there are any problems. todo: validate all trxtimes
@@ -1,6 +1,7 @@
 #pragma once
 #include <bts/bitname/bitname_fork_db.hpp>
 #include <bts/bitname/bitname_block.hpp>
+#include <bts/db/database_options.hpp>
 #include <fc/filesystem.hpp>
 
 namespace bts { namespace bitname {
@@ -31,7 +32,8 @@ namespace bts { namespace bitname {
        fork_db();
        ~fork_db();
 
-       void open( const fc::path& db_dir, bool create );
+       void open( const fc::path& db_dir, bool create,
+                  const db::database_options& opts = db::database_options() );
 
        void cache_header( const name_header& head );
        void cache_block( const name_block& blk );
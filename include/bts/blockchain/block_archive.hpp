@@ -0,0 +1,104 @@
+#pragma once
+#include <bts/config.hpp>
+#include <bts/blockchain/block.hpp>
+#include <bts/db/fwd.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/optional.hpp>
+#include <fc/reflect/reflect.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace bts { namespace db { class write_batch; } }
+
+namespace bts { namespace blockchain {
+
+  namespace detail { class block_archive_impl; }
+
+  /** where block_archive wrote a block */
+  struct block_location
+  {
+     block_location():segment(0),offset(0),size(0){}
+
+     uint32_t               segment;
+     uint32_t               offset;
+     uint32_t               size;
+     /** where each trx starts, relative to offset */
+     std::vector<uint32_t>  trx_offsets;
+  };
+
+  /**
+   *  @brief stores each block as one record appended to a series of segment files
+   *
+   *  A block is written once as the bytes fc::raw packs a trx_block into, so it
+   *  is read back or sent to a peer with a single read instead of a lookup per
+   *  transaction.  The location of every block and of the transactions in it is
+   *  indexed by block number in the shared chain database, so a block is only
+   *  found once the batch it was stored in commits and popping a block reverts
+   *  its index entry with the rest of the block.
+   *
+   *  Records are never overwritten while the archive is open, so readers holding
+   *  an older snapshot still find the blocks it indexes.  Space left behind by
+   *  popped blocks and blocks whose batch was discarded is reused after the
+   *  archive is reopened, appends resume after the last indexed block.  The
+   *  oldest segments are deleted once none of their blocks are indexed, see
+   *  remove_unused_segments().
+   *
+   *  Reads open their own file handle and may run on any thread.
+   */
+  class block_archive
+  {
+     public:
+       block_archive();
+       ~block_archive();
+
+       /**
+        *  @param dir - where the segment files are kept
+        *  @param db  - the database the index is a namespace of
+        */
+       void open( const fc::path& dir, const db::database_ptr& db,
+                  uint64_t segment_bytes = BLOCKCHAIN_ARCHIVE_SEGMENT_BYTES );
+       void close();
+
+       /** buffers index changes in @param batch until it is committed */
+       void join( db::write_batch& batch );
+
+       /** appends @param b to the last segment and indexes it in the joined batch */
+       void store( const trx_block& b );
+
+       /**
+        *  Drops the cached index entries, needed after the index is reverted behind the
+        *  archive's back.  Segments found unused before are timed again from the next
+        *  call to remove_unused_segments(), the reverted entries may point into them.
+        */
+       void clear_cache();
+
+       /** forgets @param block_num in the joined batch, its bytes stay until remove_unused_segments() */
+       void remove( uint32_t block_num );
+
+       /**
+        *  Deletes the segments before the first one holding a block that is still indexed,
+        *  once they have been unused for BLOCKCHAIN_UNDO_BLOCKS blocks up to the head block
+        *  @param head_block_num.  Until then popping the block that removed their last
+        *  entries would restore entries pointing into them.  Call it after the batch
+        *  removing blocks commits.
+        */
+       void remove_unused_segments( uint32_t head_block_num );
+
+       fc::optional<block_location> fetch_location( uint32_t block_num, const db::snapshot_ptr& snap = db::snapshot_ptr() );
+
+       /** @return false if block_num was not archived */
+       bool fetch( uint32_t block_num, trx_block& b, const db::snapshot_ptr& snap = db::snapshot_ptr() );
+       /** the block as packed by fc::raw, ready to be sent without decoding it */
+       bool fetch_packed( uint32_t block_num, std::vector<char>& packed, const db::snapshot_ptr& snap = db::snapshot_ptr() );
+       /** reads only the bytes of trx @param trx_idx of the block */
+       bool fetch_trx( uint32_t block_num, uint16_t trx_idx, signed_transaction& trx,
+                       const db::snapshot_ptr& snap = db::snapshot_ptr() );
+
+     private:
+       std::unique_ptr<detail::block_archive_impl> my;
+  };
+
+} } // bts::blockchain
+
+FC_REFLECT( bts::blockchain::block_location, (segment)(offset)(size)(trx_offsets) )
@@ -0,0 +1,94 @@
+#pragma once
+#include <bts/config.hpp>
+#include <bts/blockchain/blockchain_db.hpp>
+#include <fc/reflect/reflect.hpp>
+#include <fc/time.hpp>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace bts { namespace blockchain {
+
+  namespace detail { class block_pipeline_impl; }
+
+  /** time spent by one stage of the block_pipeline */
+  struct pipeline_stage_stats
+  {
+     pipeline_stage_stats():blocks(0),total_us(0),max_us(0){}
+
+     void record( const fc::microseconds& elapsed );
+
+     uint64_t blocks;
+     uint64_t total_us;
+     uint64_t max_us;
+  };
+
+  struct block_pipeline_stats
+  {
+     block_pipeline_stats():stalled_us(0){}
+
+     pipeline_stage_stats decode;   ///< unpacking blocks and checking their merkle root
+     pipeline_stage_stats prefetch; ///< reading the unspent inputs from a snapshot
+     pipeline_stage_stats verify;   ///< recovering the signing keys
+     pipeline_stage_stats apply;    ///< blockchain_db::push_block
+
+     /** time the apply stage waited on the others, sync is limited by them when it grows */
+     uint64_t             stalled_us;
+  };
+
+  /**
+   *  @brief validates a sequence of blocks in stages that run on separate threads
+   *
+   *  Pushing a block on the chain decodes it, reads its inputs, recovers its
+   *  signatures and then applies it, one block after another.  Only the last
+   *  step depends on the block before it, so the pipeline runs the first three
+   *  on worker threads for up to BLOCKCHAIN_PIPELINE_DEPTH blocks ahead while
+   *  the calling thread applies the oldest one.  A long sync is then limited by
+   *  the slowest stage rather than the sum of them.
+   *
+   *  Inputs are prefetched from a chain_snapshot taken when the block is pushed,
+   *  before the blocks ahead of it are applied.  Outputs that those blocks spend
+   *  are dropped from the prefetched set before it is used, and outputs they
+   *  create are read again when the block is applied.  Blocks covered by the
+   *  assume valid checkpoint skip the verify stage.
+   *
+   *  Blocks are applied on the thread that pushes them, which must be the one
+   *  that owns the blockchain_db.  If a block fails every block after it is
+   *  discarded and the error is thrown by push() or flush().
+   */
+  class block_pipeline
+  {
+     public:
+        block_pipeline( blockchain_db* chain, uint32_t depth = BLOCKCHAIN_PIPELINE_DEPTH );
+        ~block_pipeline();
+
+        /** called with each block after it has been pushed on the chain */
+        void set_applied_handler( const std::function<void(const trx_block&)>& handler );
+
+        /**
+         *  Starts validating @param b, which must follow the last block pushed.
+         *  Applies the oldest block first if depth blocks are already in flight.
+         */
+        void push( const trx_block& b );
+        /** as above for a block packed with fc::raw, which is unpacked on a worker */
+        void push( std::vector<char> packed_block );
+
+        /** applies every block in flight */
+        void flush();
+
+        /** discards the blocks in flight without applying them */
+        void clear();
+
+        /** number of blocks pushed but not yet applied */
+        size_t               size()const;
+        block_pipeline_stats get_stats()const;
+
+     private:
+        std::unique_ptr<detail::block_pipeline_impl> my;
+  };
+
+} } // bts::blockchain
+
+FC_REFLECT( bts::blockchain::pipeline_stage_stats, (blocks)(total_us)(max_us) )
+FC_REFLECT( bts::blockchain::block_pipeline_stats, (decode)(prefetch)(verify)(apply)(stalled_us) )
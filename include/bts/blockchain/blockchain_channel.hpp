@@ -1,5 +1,6 @@
 #pragma once
 #include <bts/blockchain/blockchain_db.hpp>
+#include <bts/blockchain/mempool.hpp>
 #include <bts/peer/peer_channel.hpp>
 
 #include <unordered_map>
@@ -57,7 +58,7 @@ namespace bts { namespace blockchain {
         *  All transactions that are known but that have not been included in 
         *  a block that has been added to the blockchain_db
         */
-       const std::unordered_map<uint160,signed_transaction>& get_pending_pool()const;
+       const mempool& get_pending_pool()const;
 
        /**
         *  Called when this node wishes to pubish a trx.
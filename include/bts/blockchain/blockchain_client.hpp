@@ -2,6 +2,7 @@
 #include <bts/peer/peer_channel.hpp>
 #include <bts/extended_address.hpp>
 #include <bts/blockchain/asset.hpp>
+#include <bts/blockchain/blockchain_db.hpp>
 #include <fc/filesystem.hpp>
 
 namespace bts { namespace blockchain {
@@ -21,10 +22,14 @@ namespace bts { namespace blockchain {
           }; 
 
           config()
-          :chan_num(bitshares_test_chan){}
-
-          fc::path     data_dir;
-          chan_name    chan_num;
+          :chan_num(bitshares_test_chan),
+           database(blockchain_db::default_database_options()),
+           unspent_cache_bytes(BLOCKCHAIN_UNSPENT_CACHE_BYTES){}
+
+          fc::path              data_dir;
+          chan_name             chan_num;
+          db::database_options  database;
+          uint64_t              unspent_cache_bytes;
       };
 
       blockchain_client( const peer::peer_channel_ptr& peers );
@@ -62,4 +67,4 @@ namespace bts { namespace blockchain {
 } }  // namespace bts::blockchain
 
 FC_REFLECT_ENUM( bts::blockchain::blockchain_client::config::chan_name, (bitshares_test_chan)(bitshares_chan) )
-FC_REFLECT( bts::blockchain::blockchain_client::config, (data_dir)(chan_num) )
+FC_REFLECT( bts::blockchain::blockchain_client::config, (data_dir)(chan_num)(database)(unspent_cache_bytes) )
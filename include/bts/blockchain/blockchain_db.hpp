@@ -1,6 +1,15 @@
 #pragma once
 #include <bts/blockchain/block.hpp>
 #include <bts/blockchain/transaction.hpp>
+#include <bts/blockchain/order_book.hpp>
+#include <bts/config.hpp>
+#include <bts/db/ordered_key.hpp>
+#include <bts/db/lru_cache.hpp>
+#include <bts/db/database_options.hpp>
+#include <bts/db/fwd.hpp>
+
+#include <map>
+#include <unordered_map>
 
 namespace fc 
 {
@@ -11,6 +20,7 @@ namespace bts { namespace blockchain {
     #define INVALID_BLOCK_NUM uint32_t(-1)
 
     namespace detail  { class blockchain_db_impl; }
+    struct signature_keys;
 
     struct price_point
     {
@@ -49,6 +59,11 @@ namespace bts { namespace blockchain {
        uint64_t coindays_destroyed;
        uint64_t invalid_coindays_destroyed;
        uint64_t total_spent;
+       /** fees paid per 1000 bytes of a trx of @param trx_size bytes, used to rank trxs */
+       uint64_t fee_rate( size_t trx_size )const
+       {
+          return trx_size ? fees.get_rounded_amount() * 1000 / trx_size : 0;
+       }
        trx_eval& operator += ( const trx_eval& e )
        {
          fees                       += e.fees;
@@ -122,6 +137,111 @@ namespace bts { namespace blockchain {
        std::vector<meta_trx_output> meta_outputs; // tracks where the output was spent
     };
 
+    /**
+     *  Identifies an output by the position of the transaction that created it
+     */
+    struct output_num
+    {
+       output_num( const trx_num& t = trx_num(), uint8_t o = 0 )
+       :trx_id(t),output_idx(o){}
+
+       trx_num   trx_id;
+       uint8_t   output_idx;
+    };
+
+    /**
+     *  An output that has not been spent and the transaction that created it.
+     *  These are kept in their own map so that validating and spending an
+     *  input only touches this record rather than the whole meta_trx.
+     */
+    struct unspent_output
+    {
+       unspent_output(){}
+       unspent_output( const trx_output& o, const trx_num& src )
+       :output(o),source(src){}
+
+       trx_output   output;
+       trx_num      source;
+    };
+
+    /**
+     *  Key of the address index, the unspent outputs paying an address are next
+     *  to each other in output_reference order.
+     */
+    struct address_output_key
+    {
+       address_output_key(){}
+       address_output_key( const address& a, const output_reference& o )
+       :owner(a),output(o){}
+
+       friend bool operator < ( const address_output_key& a, const address_output_key& b )
+       {
+          return a.owner == b.owner ? a.output < b.output : a.owner < b.owner;
+       }
+       friend bool operator == ( const address_output_key& a, const address_output_key& b )
+       {
+          return a.owner == b.owner && a.output == b.output;
+       }
+
+       address           owner;
+       output_reference  output;
+    };
+
+    /** as address_output_key for outputs claimed with a PTS address */
+    struct pts_address_output_key
+    {
+       pts_address_output_key(){}
+       pts_address_output_key( const pts_address& a, const output_reference& o )
+       :owner(a),output(o){}
+
+       friend bool operator < ( const pts_address_output_key& a, const pts_address_output_key& b )
+       {
+          return a.owner == b.owner ? a.output < b.output : a.owner < b.owner;
+       }
+       friend bool operator == ( const pts_address_output_key& a, const pts_address_output_key& b )
+       {
+          return a.owner == b.owner && a.output == b.output;
+       }
+
+       pts_address       owner;
+       output_reference  output;
+    };
+
+    /** an unspent output found through the address index */
+    struct owned_output
+    {
+       owned_output(){}
+       owned_output( const output_reference& l, const unspent_output& o )
+       :location(l),output(o){}
+
+       output_reference  location;
+       unspent_output    output;
+    };
+
+    /**
+     *  The unspent outputs referenced by a batch of trxs, read from the unspent index
+     *  in one sorted pass before the trxs are evaluated.  Every output in the map
+     *  must still be unspent when it is used, references that are not in it are
+     *  looked up again.
+     */
+    typedef std::unordered_map<output_reference,unspent_output> prefetched_inputs;
+
+    /**
+     *  Outputs of transactions that are not in the chain yet, consulted by fetch_inputs
+     *  for inputs that are not in the unspent index.  This lets a trx spend the output
+     *  of one before it in the same block or in the mempool.
+     */
+    typedef std::unordered_map<output_reference,trx_output> pending_outputs;
+
+    /** adds the outputs of @param trx, whose id is @param trx_id, to @param outs */
+    inline void add_pending_outputs( pending_outputs& outs, const signed_transaction& trx, const transaction_id_type& trx_id )
+    {
+       for( uint32_t i = 0; i < trx.outputs.size(); ++i )
+       {
+          outs[output_reference( trx_id, i )] = trx.outputs[i];
+       }
+    }
+
     struct bid_data
     {
        bid_data():amount(0){}
@@ -168,6 +288,32 @@ namespace bts { namespace blockchain {
     };
 
 
+    class chain_snapshot;
+    typedef std::shared_ptr<chain_snapshot> chain_snapshot_ptr;
+
+    /**
+     *  The assume valid checkpoint and the ids of the blocks below it that are
+     *  known to be its ancestors, because their headers link to it.  It is never
+     *  modified once shared, so other threads may keep a copy of the pointer.
+     */
+    struct assume_valid_chain
+    {
+       assume_valid_chain():first_block_num(INVALID_BLOCK_NUM){}
+
+       uint32_t                    first_block_num; ///< the number of ids.front()
+       std::vector<block_id_type>  ids;             ///< ids.back() is the checkpoint
+
+       uint32_t checkpoint_num()const { return first_block_num + ids.size() - 1; }
+
+       /** @return true if @param block_id is the checkpoint or a known ancestor of it at @param block_num */
+       bool covers( uint32_t block_num, const block_id_type& block_id )const
+       {
+          return block_num >= first_block_num && block_num - first_block_num < ids.size() &&
+                 ids[block_num - first_block_num] == block_id;
+       }
+    };
+    typedef std::shared_ptr<const assume_valid_chain> assume_valid_chain_ptr;
+
     /**
      *  This database only stores valid blocks and applied transactions,
      *  it does not store invalid/orphaned blocks and transactions which
@@ -179,9 +325,79 @@ namespace bts { namespace blockchain {
           blockchain_db();
           ~blockchain_db();
 
-          void open( const fc::path& dir, bool create = true );
+          /** larger cache and write buffer than the db defaults, the chain is the biggest database */
+          static db::database_options default_database_options();
+
+          void open( const fc::path& dir, bool create = true,
+                     const db::database_options& opts = default_database_options() );
           void close();
 
+          /** the leveldb options the chain database was opened with */
+          db::database_options get_database_options()const;
+
+          /** hit / miss counters of the decoded value caches, by map name */
+          std::map<std::string,db::cache_stats> get_cache_stats()const;
+
+          /** bytes of unspent outputs kept decoded in memory, 0 disables the cache */
+          void set_unspent_cache_size( uint64_t max_bytes );
+
+          /**
+           *  Trusts @param block_id as the block at @param block_num.  A block at or
+           *  below it is pushed without recovering signatures or checking that the
+           *  required ones are present, everything else is still validated, but only
+           *  once it is known to be an ancestor of the checkpoint, see
+           *  add_assume_valid_headers().  Until then its signatures are checked.  The
+           *  block at block_num must be block_id or it is rejected.  Defaults to
+           *  BLOCKCHAIN_ASSUME_VALID_BLOCK_NUM, INVALID_BLOCK_NUM checks every signature.
+           */
+          void     set_assume_valid( uint32_t block_num, const block_id_type& block_id );
+          uint32_t assume_valid_block_num()const;
+
+          /**
+           *  Learns the ancestors of the checkpoint from a run of consecutive
+           *  @param headers, such as the headers synced from a peer before the blocks.
+           *  The last header must be the checkpoint or an ancestor already known and
+           *  each one must be the prev of the one after it.
+           *
+           *  @throw if the headers do not link to the checkpoint
+           */
+          void     add_assume_valid_headers( const std::vector<block_header>& headers );
+          /** the checkpoint and its known ancestors, null if there is no checkpoint */
+          assume_valid_chain_ptr get_assume_valid_chain()const;
+
+          /**
+           *  Once a block is more than @param depth blocks below the head its transactions
+           *  are dropped, only its header is kept.  The id and spent status of a trx are
+           *  dropped with it once all of its outputs are spent, the unspent outputs are all
+           *  a new block is validated against.  0, the default, keeps every block, otherwise
+           *  depth must be at least BLOCKCHAIN_MIN_PRUNE_DEPTH.
+           */
+          void     set_prune_depth( uint32_t depth );
+          uint32_t prune_depth()const;
+          /** blocks below this one have been pruned and can not be fetched in full */
+          uint32_t first_full_block()const;
+
+          /**
+           *  The threads the order books of different asset pairs are matched on, 0 for
+           *  one per core and 1 to match on the calling thread.  Defaults to
+           *  BLOCKCHAIN_MATCH_THREADS, the matched trxs do not depend on it.
+           */
+          void     set_match_threads( uint32_t threads );
+
+          /**
+           *  The address index maps the owner of every unspent claim_by_signature,
+           *  claim_by_pts, claim_by_bid, claim_by_long and claim_by_cover output to the
+           *  output, so fetch_unspent_outputs() reads only the outputs an address owns.
+           *  It is on by default and must be set before open(), turning it off drops
+           *  the index and turning it back on builds it again from the unspent outputs.
+           */
+          void     set_address_index( bool enabled );
+          bool     has_address_index()const;
+
+          /** @throw if the address index is off */
+          std::vector<owned_output> fetch_unspent_outputs( const address& owner );
+          std::vector<owned_output> fetch_unspent_outputs( const pts_address& owner );
+
           uint64_t      total_shares()const;
           uint32_t      head_block_num()const;
           block_id_type head_block_id()const;
@@ -196,51 +412,126 @@ namespace bts { namespace blockchain {
           std::vector<price_point> get_market_history( asset::type quote, asset::type base, 
                                                       fc::time_point_sec from, fc::time_point_sec to, 
                                                       uint32_t blocks_per_point = 1 );
+          /** @param resolution - one of candle_resolution, see market_db::get_candles() */
+          std::vector<price_point> get_market_candles( asset::type quote, asset::type base, uint32_t resolution,
+                                                       fc::time_point_sec from, fc::time_point_sec to );
 
          /**
           *  Validates that trx could be included in a future block, that
           *  all inputs are unspent, that it is valid for the current time,
           *  and that all inputs have proper signatures and input data.
           *
+          *  @param keys - the keys recovered from the signatures of trx, if already known
+          *  @param pending - outputs of unconfirmed trxs that trx may spend
+          *  @param prefetched - the unspent outputs read for a batch including trx, see prefetch_inputs()
+          *  @param check_signatures - see trx_validation_state::check_signatures
+          *
           *  @return any trx fees that would be paid if this trx were included
           *          in the next block.
           *
           *  @throw exception if trx can not be applied to the current chain state.
           */
-         trx_eval   evaluate_signed_transaction( const signed_transaction& trx, bool ignore_fees = false, bool is_market = false );       
-         trx_eval   evaluate_signed_transactions( const std::vector<signed_transaction>& trxs, uint64_t ignore_first_n = 0 );
+         trx_eval   evaluate_signed_transaction( const signed_transaction& trx, bool ignore_fees = false, bool is_market = false,
+                                                 const signature_keys* keys = nullptr, const pending_outputs* pending = nullptr,
+                                                 const prefetched_inputs* prefetched = nullptr, bool check_signatures = true );
+         /**
+          *  recovers the signatures of all trxs in parallel before evaluating them in order,
+          *  a trx may spend the outputs of those before it
+          *
+          *  @param keys - the keys of every trx if already recovered, see block_pipeline
+          *  @param prefetched - the unspent inputs of trxs if already read
+          *  @param check_signatures - see trx_validation_state::check_signatures
+          */
+         trx_eval   evaluate_signed_transactions( const std::vector<signed_transaction>& trxs, uint64_t ignore_first_n = 0,
+                                                  const std::vector<signature_keys>* keys = nullptr,
+                                                  const prefetched_inputs* prefetched = nullptr,
+                                                  bool check_signatures = true );
 
          std::vector<signed_transaction> match_orders( std::vector<price_point>* order_stats = nullptr );
          trx_block  generate_next_block( const std::vector<signed_transaction>& trx );
+         /** as above without reserializing each trx to find its size and digest */
+         trx_block  generate_next_block( const std::vector<hashed_transaction>& trx );
 
+         bool       has_transaction( const transaction_id_type& trx_id );
          trx_num    fetch_trx_num( const uint160& trx_id );
          meta_trx   fetch_trx( const trx_num& t );
+         /** decodes into @param trx reusing its storage, for scans over many transactions */
+         void       fetch_trx( const trx_num& t, meta_trx& trx );
 
          signed_transaction          fetch_transaction( const transaction_id_type& trx_id );
-         std::vector<meta_trx_input> fetch_inputs( const std::vector<trx_input>& inputs, uint32_t head = INVALID_BLOCK_NUM );
+         /**
+          *  inputs found in @param pending have no meta_output and destroy no coindays,
+          *  those in @param prefetched are not read from the unspent index again
+          */
+         std::vector<meta_trx_input> fetch_inputs( const std::vector<trx_input>& inputs, uint32_t head = INVALID_BLOCK_NUM,
+                                                   const pending_outputs* pending = nullptr,
+                                                   const prefetched_inputs* prefetched = nullptr );
+         /**
+          *  reads the unspent outputs referenced by the inputs of @param trxs sorted by
+          *  key so that the whole batch is resolved in a single forward pass over the index
+          */
+         prefetched_inputs           prefetch_inputs( const std::vector<signed_transaction>& trxs );
 
          uint32_t     fetch_block_num( const block_id_type& block_id );
          block_header fetch_block( uint32_t block_num );
          full_block   fetch_full_block( uint32_t block_num );
+         void         fetch_full_block( uint32_t block_num, full_block& blk );
          trx_block    fetch_trx_block( uint32_t block_num );
 
          uint64_t   current_bitshare_supply();
          
          /**
           *  Attempts to append block b to the block chain with the given trxs.
+          *
+          *  @param keys - the keys recovered from the signatures of b.trxs, if already known
+          *  @param prefetched - the unspent inputs of b.trxs, if already read
+          *
+          *  Signatures are not checked if b is the assume valid block or a known
+          *  ancestor of it, see add_assume_valid_headers().
           */
-         void push_block( const trx_block& b );
+         void push_block( const trx_block& b, const std::vector<signature_keys>* keys = nullptr,
+                          const prefetched_inputs* prefetched = nullptr );
 
          /**
-          *  Removes the top block from the stack and marks all spent outputs as 
-          *  unspent.
+          *  Removes the top block from the stack and reverts every change it made
+          *  to the chain and market state, returning the block and its transactions.
+          *  Only the last BLOCKCHAIN_UNDO_BLOCKS blocks keep the undo record needed.
           */
          void pop_block( full_block& b, std::vector<signed_transaction>& trxs );
 
+         /**
+          *  Writes everything needed to validate the blocks after the head to @param file:
+          *  the unspent outputs, the trx ids, the market orders, depth and price history,
+          *  and the last BLOCKCHAIN_STATE_FILE_HEADERS block headers.  The file starts with
+          *  a version and ends with a checksum of its contents.  Pop blocks first to
+          *  export an earlier height.
+          */
+         void export_state( const fc::path& file );
+
+         /**
+          *  Loads a file written by export_state() into an empty chain, which then accepts
+          *  the block after the exported head.  The transactions of the blocks before it
+          *  are not in the file, so those blocks can not be fetched in full or popped.
+          *
+          *  @throw if the checksum or version of @param file does not match
+          */
+         void import_state( const fc::path& file );
+
          std::string dump_market( asset::type quote, asset::type base );
 
          market_data get_market( asset::type quote, asset::type base );
 
+         /**
+          *  The best @param levels prices on each side of the market with the amount
+          *  and number of orders at each, as they are after the head block.  Unlike
+          *  get_market() the outputs of the orders are not read.
+          */
+         order_book_summary get_order_book( asset::type quote, asset::type base,
+                                            uint32_t levels = BLOCKCHAIN_ORDER_BOOK_LEVELS );
+
+         /** pins the current head block for reads that must not see a block being applied */
+         chain_snapshot_ptr get_snapshot();
+
        private:
          void   store_trx( const signed_transaction& trx, const trx_num& t );
          std::unique_ptr<detail::blockchain_db_impl> my;          
@@ -248,10 +539,75 @@ namespace bts { namespace blockchain {
 
     typedef std::shared_ptr<blockchain_db> blockchain_db_ptr;
 
+    /**
+     *  A consistent read only view of the chain and market as of the head block
+     *  it was taken at.  Reads go through a leveldb snapshot of the shared chain
+     *  database and never touch the caches or pending batch used by push_block(),
+     *  so readers on other threads or fibers never see part of a block.
+     *
+     *  @note a snapshot must not outlive the blockchain_db it was taken from
+     */
+    class chain_snapshot
+    {
+       public:
+         uint32_t      head_block_num()const;
+         block_id_type head_block_id()const;
+
+         trx_num            fetch_trx_num( const uint160& trx_id )const;
+         meta_trx           fetch_trx( const trx_num& t )const;
+         void               fetch_trx( const trx_num& t, meta_trx& trx )const;
+         signed_transaction fetch_transaction( const transaction_id_type& trx_id )const;
+
+         uint32_t     fetch_block_num( const block_id_type& block_id )const;
+         block_header fetch_block( uint32_t block_num )const;
+         full_block   fetch_full_block( uint32_t block_num )const;
+         void         fetch_full_block( uint32_t block_num, full_block& blk )const;
+         trx_block    fetch_trx_block( uint32_t block_num )const;
+         /**
+          *  fc::raw::pack( fetch_trx_block( block_num ) ), read from the block archive
+          *  in one piece without decoding it
+          */
+         std::vector<char> fetch_packed_trx_block( uint32_t block_num )const;
+
+         /** the inputs of @param trxs that were unspent when the snapshot was taken */
+         prefetched_inputs        prefetch_inputs( const std::vector<signed_transaction>& trxs )const;
+
+         /** see blockchain_db::fetch_unspent_outputs() */
+         std::vector<owned_output> fetch_unspent_outputs( const address& owner )const;
+         std::vector<owned_output> fetch_unspent_outputs( const pts_address& owner )const;
+
+         uint64_t                 get_market_depth( asset::type quote )const;
+         market_data              get_market( asset::type quote, asset::type base )const;
+         std::vector<price_point> get_market_history( asset::type quote, asset::type base,
+                                                      fc::time_point_sec from, fc::time_point_sec to,
+                                                      uint32_t blocks_per_point = 1 )const;
+         std::vector<price_point> get_market_candles( asset::type quote, asset::type base, uint32_t resolution,
+                                                      fc::time_point_sec from, fc::time_point_sec to )const;
+
+       private:
+         friend class blockchain_db;
+         chain_snapshot( detail::blockchain_db_impl* chain, const db::snapshot_ptr& snap,
+                         uint32_t head_num, const block_id_type& head_id );
+
+         detail::blockchain_db_impl* _chain;
+         db::snapshot_ptr            _snapshot;
+         uint32_t                    _head_block_num;
+         block_id_type               _head_block_id;
+    };
+
 }  } // bts::blockchain
 
 FC_REFLECT( bts::blockchain::trx_eval, (fees)(coindays_destroyed) )
 FC_REFLECT( bts::blockchain::trx_num, (block_num)(trx_idx) );
+BTS_DB_ORDERED_KEY( bts::blockchain::trx_num, (block_num)(trx_idx) )
+FC_REFLECT( bts::blockchain::output_num, (trx_id)(output_idx) )
+BTS_DB_ORDERED_KEY( bts::blockchain::output_num, (trx_id)(output_idx) )
+FC_REFLECT( bts::blockchain::unspent_output, (output)(source) )
+FC_REFLECT( bts::blockchain::address_output_key, (owner)(output) )
+BTS_DB_ORDERED_KEY( bts::blockchain::address_output_key, (owner)(output) )
+FC_REFLECT( bts::blockchain::pts_address_output_key, (owner)(output) )
+BTS_DB_ORDERED_KEY( bts::blockchain::pts_address_output_key, (owner)(output) )
+FC_REFLECT( bts::blockchain::owned_output, (location)(output) )
 FC_REFLECT( bts::blockchain::meta_trx_output, (trx_id)(input_num) )
 FC_REFLECT( bts::blockchain::meta_trx_input, (source)(output_num)(output)(meta_output) )
 FC_REFLECT_DERIVED( bts::blockchain::meta_trx, (bts::blockchain::signed_transaction), (meta_outputs) );
@@ -1,13 +1,20 @@
 #pragma once
 #include <bts/blockchain/block.hpp>
 #include <bts/blockchain/asset.hpp>
+#include <bts/db/ordered_key.hpp>
+#include <bts/db/fwd.hpp>
 #include <fc/optional.hpp>
 #include <fc/filesystem.hpp>
 
+#include <functional>
+
+namespace bts { namespace db { class write_batch; class state_file_writer; class state_file_reader; } }
+
 namespace bts { namespace blockchain {
 
   namespace detail { class market_db_impl; }
   struct price_point;
+  struct order_book_summary;
 
  /**
   *   Bids:  (offers to buy Base Unit with Quote Unit)
@@ -34,16 +41,29 @@ namespace bts { namespace blockchain {
   struct margin_call
   {
      margin_call( const price& callp, const output_reference& loc ):call_price(callp),location(loc){}
+     margin_call(){}
 
      price            call_price;
      output_reference location;
   };
   bool operator < ( const margin_call& a, const margin_call& b );
   bool operator == ( const margin_call& a, const margin_call& b );
+
+  /** the spans of time, in seconds, that market_db rolls the price history up into */
+  enum candle_resolution
+  {
+     hourly_candles = 60*60,
+     daily_candles  = 60*60*24,
+     weekly_candles = 60*60*24*7
+  };
   
   /**
    *  Manages the current state of the market to enable effecient
    *  pairing of the highest bid with the lowest ask.
+   *
+   *  The bids and asks of every pair and the depth of every quote are also held
+   *  in memory as an order_book, loaded when the market is opened.  Reads without
+   *  a snapshot are served from them, leveldb only persists the orders.
    */
   class market_db
   {
@@ -52,9 +72,53 @@ namespace bts { namespace blockchain {
        ~market_db();
 
        void open( const fc::path& db_dir );
-       std::vector<market_order> get_bids( asset::type quote_unit, asset::type base_unit )const;
-       std::vector<market_order> get_asks( asset::type quote_unit, asset::type base_unit )const;
-       std::vector<margin_call>  get_calls( price call_price )const;
+
+       /** opens the market as a set of namespaces in the shared database @param db */
+       void open( const db::database_ptr& db );
+
+       /** moves the standalone databases in @param db_dir into the shared database */
+       void import_standalone( const fc::path& db_dir );
+       void close();
+
+       /**
+        *  Buffers all changes to the market in @param batch until it is committed,
+        *  the in memory books only change once it is.
+        */
+       void join( db::write_batch& batch );
+
+       /**
+        *  Loads the in memory books again after the market was written without
+        *  going through this class, as blockchain_db::pop_block() does.
+        */
+       void reload();
+
+       /** the amount of an order, read from the output it spends */
+       typedef std::function<uint64_t( const market_order& )> order_amount_func;
+
+       /**
+        *  Sets how the in memory books find the amount of the orders they hold
+        *  and loads them again.  Without it every order has an amount of 0.
+        *
+        *  @param amount_of is called when an order is inserted, while the output
+        *  it refers to is still unspent.
+        */
+       void set_order_amounts( const order_amount_func& amount_of );
+
+       /** writes the orders, calls, depth and price history as of @param snap, see blockchain_db::export_state() */
+       void export_state( db::state_file_writer& out, const db::snapshot_ptr& snap );
+       /** loads what export_state() wrote into an empty market */
+       void import_state( db::state_file_reader& in );
+
+       /**
+        *  The read methods below take an optional snapshot of the shared database,
+        *  see blockchain_db::get_snapshot().  Without one they return the committed
+        *  orders from the in memory books.
+        */
+       std::vector<market_order> get_bids( asset::type quote_unit, asset::type base_unit,
+                                           const db::snapshot_ptr& snap = db::snapshot_ptr() )const;
+       std::vector<market_order> get_asks( asset::type quote_unit, asset::type base_unit,
+                                           const db::snapshot_ptr& snap = db::snapshot_ptr() )const;
+       std::vector<margin_call>  get_calls( price call_price, const db::snapshot_ptr& snap = db::snapshot_ptr() )const;
 
        
        /**
@@ -68,7 +132,7 @@ namespace bts { namespace blockchain {
         *  Returns the minimum of total volume of orders on either the bid or
         *  ask side of the market.  
         */
-       uint64_t get_depth( asset::type quote_unit );
+       uint64_t get_depth( asset::type quote_unit, const db::snapshot_ptr& snap = db::snapshot_ptr() );
 
        /** @param depth - the amount of bts backing the order used to
         * track minimum market depth to facilitate trading.
@@ -80,17 +144,38 @@ namespace bts { namespace blockchain {
        void insert_call( const margin_call& c, uint64_t depth );
        void remove_call( const margin_call& c, uint64_t depth );
 
+       /**
+        *  The best @param levels prices of each side of the committed books with the
+        *  amount and order count at each of them.  Each level keeps its totals as
+        *  orders come and go, so this does not visit the orders.
+        *
+        *  @pre quote > base
+        */
+       order_book_summary get_order_book( asset::type quote, asset::type base, uint32_t levels )const;
+
        /** @pre quote > base  */
        fc::optional<market_order> get_highest_bid( asset::type quote, asset::type base );
        /** @pre quote > base  */
        fc::optional<market_order> get_lowest_ask( asset::type quote, asset::type base );
 
+       /** stores the point of one block and adds it to the candle of each candle_resolution it falls in */
        void push_price_point( const price_point& pt );
 
        /**
         *  This method returns the price history for a given asset pair for a given range and block granularity. 
         */
-       std::vector<price_point> get_history( asset::type quote, asset::type base, fc::time_point_sec from, fc::time_point_sec to, uint32_t blocks_per_point = 1 );
+       std::vector<price_point> get_history( asset::type quote, asset::type base, fc::time_point_sec from, fc::time_point_sec to, uint32_t blocks_per_point = 1,
+                                             const db::snapshot_ptr& snap = db::snapshot_ptr() );
+
+       /**
+        *  The candles of @param resolution seconds, one of candle_resolution, that overlap
+        *  [from, to].  They were rolled up as each block was pushed, so this reads one
+        *  row per candle rather than one per block.  Candles start at multiples of
+        *  @param resolution since the epoch.
+        */
+       std::vector<price_point> get_candles( asset::type quote, asset::type base, uint32_t resolution,
+                                             fc::time_point_sec from, fc::time_point_sec to,
+                                             const db::snapshot_ptr& snap = db::snapshot_ptr() );
 
      private:
        std::unique_ptr<detail::market_db_impl> my;
@@ -101,3 +186,6 @@ namespace bts { namespace blockchain {
 FC_REFLECT( bts::blockchain::market_order, (base_unit)(quote_unit)(ratio)(location) );
 FC_REFLECT( bts::blockchain::margin_call, (call_price)(location) )
 
+BTS_DB_ORDERED_KEY( bts::blockchain::market_order, (base_unit)(quote_unit)(ratio)(location) )
+// the base unit is not part of the call order, it is only stored so the key can be decoded
+BTS_DB_ORDERED_KEY( bts::blockchain::margin_call, (call_price.quote_unit)(call_price.ratio)(location)(call_price.base_unit) )
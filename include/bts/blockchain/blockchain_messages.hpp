@@ -15,6 +15,7 @@ namespace bts { namespace blockchain {
       trxs_msg            = 8,
       full_block_msg      = 9,
       trx_block_msg       = 10,
+      chain_status_msg    = 11,
       message_type_count     /// used to verify message type range
   };
 
@@ -115,6 +116,20 @@ namespace bts { namespace blockchain {
      trx_block block_data;
   };
 
+  /**
+   *  Sent to every connection that subscribes to the channel.  A pruned node
+   *  only keeps the transactions of recent blocks, peers must not request
+   *  the blocks below first_full_block from it.
+   */
+  struct chain_status_message
+  {
+     static const message_type type;
+
+     chain_status_message():head_block_num(uint32_t(-1)),first_full_block(0){}
+
+     uint32_t head_block_num;
+     uint32_t first_full_block;
+  };
 
 } } // bts::blockchain
 FC_REFLECT_ENUM( bts::blockchain::message_type,
@@ -128,6 +143,7 @@ FC_REFLECT_ENUM( bts::blockchain::message_type,
   (trxs_msg)
   (full_block_msg)
   (trx_block_msg)
+  (chain_status_msg)
 )
 
 FC_REFLECT( bts::blockchain::trx_inv_message, (items) )
@@ -140,4 +156,4 @@ FC_REFLECT( bts::blockchain::get_trx_block_message, (block_id) )
 FC_REFLECT( bts::blockchain::trxs_message, (trxs) )
 FC_REFLECT( bts::blockchain::full_block_message, (block_data) )
 FC_REFLECT( bts::blockchain::trx_block_message, (block_data) )
-
+FC_REFLECT( bts::blockchain::chain_status_message, (head_block_num)(first_full_block) )
@@ -0,0 +1,106 @@
+#pragma once
+#include <bts/config.hpp>
+#include <bts/blockchain/blockchain_db.hpp>
+#include <fc/optional.hpp>
+#include <fc/time.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace bts { namespace blockchain {
+
+  namespace detail { class mempool_impl; }
+
+  /**
+   *  A pending transaction with the result of evaluating it when it was
+   *  admitted to the mempool.
+   */
+  struct mempool_entry
+  {
+     hashed_transaction  trx;
+     trx_eval            eval;
+     uint64_t            fee_rate; ///< eval.fee_rate( trx.size() )
+     fc::time_point      received;
+  };
+
+  /**
+   *  @brief transactions that are valid against the head of the chain but not yet in a block
+   *
+   *  Every transaction is evaluated once, when it is added.  Pending transactions
+   *  are indexed by fee rate and by the outputs they spend, so double spends are
+   *  found with one lookup and the pool never holds two trxs spending the same
+   *  output.  A conflicting trx replaces the pending ones only if it pays a higher
+   *  fee rate.  When the pool grows past its byte budget the lowest fee rate trxs
+   *  are evicted.
+   *
+   *  A trx may spend the outputs of other pending trxs, which it is validated
+   *  against through a pending_outputs overlay.  Removing a trx for any reason
+   *  other than its inclusion in a block removes the trxs spending its outputs,
+   *  which go back to the orphan pool.  A trx whose parents are neither pending
+   *  nor in the chain is held in a bounded orphan pool, keyed by the missing
+   *  parent ids, until they arrive.
+   *
+   *  Because the pool is free of conflicts, the block template is simply the
+   *  highest fee rate prefix of the fee index that fits in a block, with each
+   *  trx preceded by its pending parents.  Building a block costs time
+   *  proportional to the block rather than to the pool.
+   */
+  class mempool
+  {
+     public:
+        mempool( blockchain_db* chain, uint64_t max_bytes = BLOCKCHAIN_MEMPOOL_BYTES );
+        ~mempool();
+
+        /**
+         *  Evaluates @param trx against the chain and the pending trxs and admits it,
+         *  replacing any pending trxs that spend the same outputs.  Orphans waiting
+         *  for trx are then added as well.
+         *
+         *  @return true if trx is now pending, false if it was already known or is
+         *          held as an orphan until its parents arrive.
+         *  @throw if trx is invalid, pays less than the chain fee rate, pays a fee rate
+         *         no higher than a conflicting trx or than the lowest one in a full pool,
+         *         or spends the outputs of a trx it would replace.
+         */
+        bool  add( const hashed_transaction& trx );
+        bool  remove( const transaction_id_type& trx_id );
+
+        /**
+         *  Drops the trxs included in @param b and any others that spend the same
+         *  outputs, then admits orphans that were waiting for trxs in b.  Call after
+         *  b has been pushed on the chain.
+         */
+        void  handle_block( const trx_block& b );
+        void  clear();
+
+        bool                               contains( const transaction_id_type& trx_id )const;
+        bool                               is_orphan( const transaction_id_type& trx_id )const;
+        fc::optional<mempool_entry>        get( const transaction_id_type& trx_id )const;
+        /** @return the pending trx that spends @param out, if any */
+        fc::optional<transaction_id_type>  get_spender( const output_reference& out )const;
+
+        /**
+         *  @return the highest fee rate trxs whose combined size fits in a block, in
+         *  the order they should be included with parents before children.  Pass
+         *  to blockchain_db::generate_next_block.
+         */
+        std::vector<hashed_transaction>    get_block_template()const;
+        /** @return up to @param limit trx ids, highest fee rate first */
+        std::vector<transaction_id_type>   get_ids( uint32_t limit = -1 )const;
+
+        size_t    size()const;
+        size_t    orphan_count()const;
+        /** packed size of all pending trxs */
+        uint64_t  bytes()const;
+        void      set_max_bytes( uint64_t max_bytes );
+        void      set_max_orphans( uint32_t max_orphans );
+
+     private:
+        void      accept_orphans( const transaction_id_type& parent );
+        /** validates the trxs erased with an ancestor again, holding them as orphans */
+        void      revalidate_displaced();
+
+        std::unique_ptr<detail::mempool_impl> my;
+  };
+
+} } // bts::blockchain
@@ -0,0 +1,112 @@
+#pragma once
+#include <bts/blockchain/blockchain_market_db.hpp>
+#include <fc/optional.hpp>
+#include <fc/reflect/reflect.hpp>
+
+#include <map>
+#include <vector>
+
+namespace bts { namespace blockchain {
+
+  /**
+   *  The orders waiting at one price and the amount of each.  They are matched
+   *  in output_reference order, the order market_db stores them in, because the
+   *  time an order arrived is not part of the chain state and every node must
+   *  match the same orders first.
+   */
+  struct price_level
+  {
+     price_level():amount(0){}
+
+     std::map<output_reference,uint64_t> orders;
+     uint64_t                            amount; ///< sum of the orders
+  };
+
+  /** one price of an order_book_summary */
+  struct order_book_level
+  {
+     order_book_level():amount(0),cumulative_amount(0),orders(0){}
+
+     price     level_price;
+     uint64_t  amount;            ///< quote units for bids, base units for asks
+     uint64_t  cumulative_amount; ///< this level and every better one
+     uint32_t  orders;
+  };
+
+  /** the best price levels of both sides of a pair, see market_db::get_order_book() */
+  struct order_book_summary
+  {
+     order_book_summary():bid_levels(0),ask_levels(0),bid_orders(0),ask_orders(0){}
+
+     asset_type                     quote_unit;
+     asset_type                     base_unit;
+     fc::optional<price>            best_bid;
+     fc::optional<price>            best_ask;
+     uint32_t                       bid_levels;  ///< all levels, not just those returned
+     uint32_t                       ask_levels;
+     uint32_t                       bid_orders;
+     uint32_t                       ask_orders;
+     std::vector<order_book_level>  bids;        ///< highest price first
+     std::vector<order_book_level>  asks;        ///< lowest price first
+  };
+
+  /**
+   *  @brief the bids and asks of one quote / base pair held in memory
+   *
+   *  Price levels are kept sorted by ratio, so the best bid and ask are found
+   *  without a database iterator and walking the book in price order does not
+   *  decode any keys.  Each level keeps the total amount of its orders as they
+   *  are inserted and removed, so summarize() only visits the levels it returns.
+   *  market_db keeps one per pair in sync with the orders it stores, leveldb only
+   *  persists them.
+   */
+  class order_book
+  {
+     public:
+        order_book( asset_type quote = asset::bts, asset_type base = asset::bts )
+        :_quote(quote),_base(base),_bid_count(0),_ask_count(0){}
+
+        /** inserting an order that is already in the book updates its @param amount */
+        void insert_bid( const market_order& m, uint64_t amount = 0 );
+        void insert_ask( const market_order& m, uint64_t amount = 0 );
+        /** @return false if @param m was not in the book */
+        bool remove_bid( const market_order& m );
+        bool remove_ask( const market_order& m );
+
+        bool     empty()const { return _bids.empty() && _asks.empty(); }
+        uint32_t bid_count()const { return _bid_count; }
+        uint32_t ask_count()const { return _ask_count; }
+
+        /** every order on one side from the lowest price to the highest, as market_db::get_bids() */
+        std::vector<market_order> get_bids()const;
+        std::vector<market_order> get_asks()const;
+
+        fc::optional<market_order> highest_bid()const;
+        fc::optional<market_order> lowest_ask()const;
+
+        /** the best @param max_levels levels of each side */
+        order_book_summary summarize( uint32_t max_levels )const;
+
+        typedef std::map<fc::uint128_t,price_level> levels;
+        const levels& bid_levels()const { return _bids; }
+        const levels& ask_levels()const { return _asks; }
+
+     private:
+        void insert( levels& side, uint32_t& count, const market_order& m, uint64_t amount );
+        bool remove( levels& side, uint32_t& count, const market_order& m );
+        std::vector<market_order> get_orders( const levels& side )const;
+        market_order make_order( const fc::uint128_t& ratio, const output_reference& loc )const;
+
+        asset_type   _quote;
+        asset_type   _base;
+        levels       _bids;
+        levels       _asks;
+        uint32_t     _bid_count;
+        uint32_t     _ask_count;
+  };
+
+} } // bts::blockchain
+
+FC_REFLECT( bts::blockchain::order_book_level, (level_price)(amount)(cumulative_amount)(orders) )
+FC_REFLECT( bts::blockchain::order_book_summary, (quote_unit)(base_unit)(best_bid)(best_ask)
+            (bid_levels)(ask_levels)(bid_orders)(ask_orders)(bids)(asks) )
@@ -1,6 +1,7 @@
 #pragma once
 #include <fc/crypto/ripemd160.hpp>
 #include <fc/crypto/city.hpp>
+#include <bts/db/ordered_key.hpp>
 namespace bts { namespace blockchain {
 
 /**
@@ -45,3 +46,5 @@ namespace std {
   };
 
 } // std
+
+BTS_DB_ORDERED_KEY( bts::blockchain::output_reference, (trx_hash)(output_idx) )
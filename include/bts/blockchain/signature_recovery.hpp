@@ -0,0 +1,60 @@
+#pragma once
+#include <bts/config.hpp>
+#include <bts/address.hpp>
+#include <bts/pts_address.hpp>
+#include <bts/blockchain/transaction.hpp>
+#include <bts/signature_cache.hpp>
+
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+namespace fc { class thread; }
+
+namespace bts { namespace blockchain {
+
+  /**
+   *  The public keys recovered from the signatures of one transaction, used
+   *  in place of signed_transaction::get_signed_addresses() so that the
+   *  expensive recovery only happens once per signature.
+   */
+  struct signature_keys
+  {
+     std::vector<recovered_key_ptr>   keys;
+
+     std::unordered_set<address>      addresses()const;
+     std::unordered_set<pts_address>  pts_addresses()const;
+  };
+
+  /**
+   *  @brief recovers the signing keys of many transactions on a pool of threads
+   *
+   *  Public key recovery is pure math on the transaction digest and signature,
+   *  so a block or batch can have all of its signatures recovered in parallel
+   *  before the state dependent validation runs serially.  Results go through
+   *  the signature_cache, so transactions already seen cost no recovery.
+   */
+  class signature_recovery_pool
+  {
+     public:
+        /** @param num_threads - number of worker threads, 0 uses one per core */
+        signature_recovery_pool( uint32_t num_threads = BLOCKCHAIN_SIGNATURE_THREADS );
+        ~signature_recovery_pool();
+
+        /**
+         *  @return the keys of every signature of trxs[i] in element i
+         *  @throw if any signature is invalid
+         */
+        std::vector<signature_keys> recover( const std::vector<signed_transaction>& trxs );
+        /** uses the digests already computed by each hashed_transaction */
+        std::vector<signature_keys> recover( const std::vector<hashed_transaction>& trxs );
+
+     private:
+        std::vector<signature_keys> recover( const std::vector<const signed_transaction*>& trxs,
+                                             const std::vector<fc::sha256>& digests );
+
+        uint32_t                                  _num_threads;
+        std::vector<std::unique_ptr<fc::thread> > _threads; // started on first use
+  };
+
+} } // bts::blockchain
@@ -11,6 +11,8 @@
 #include <fc/io/varint.hpp>
 #include <fc/exception/exception.hpp>
 
+#include <memory>
+
 
 namespace bts { namespace blockchain {
 
@@ -111,6 +113,46 @@ struct signed_transaction : public transaction
     std::set<fc::ecc::compact_signature> sigs;
 };
 
+/**
+ *  @brief an immutable signed_transaction with its id, digest and packed form
+ *
+ *  Every stage a transaction passes through (channel, pending pool, block
+ *  generation and storage) asks for its id, its size or its digest, each of
+ *  which reserializes the whole transaction.  A hashed_transaction serializes
+ *  once on construction and answers all of them from that.  Copies share the
+ *  same state so they are cheap to keep in several containers.
+ */
+class hashed_transaction
+{
+   public:
+      hashed_transaction();
+      explicit hashed_transaction( signed_transaction trx );
+
+      const signed_transaction&   trx()const     { return my->trx;    }
+      operator const signed_transaction&()const  { return my->trx;    }
+
+      const transaction_id_type&  id()const      { return my->id;     }
+      /** the digest signed by sigs, same as transaction::digest() */
+      const fc::sha256&           digest()const  { return my->digest; }
+      /** fc::raw::pack( trx() ) */
+      const std::vector<char>&    packed()const  { return my->packed; }
+      size_t                      size()const    { return my->packed.size(); }
+
+      /** signers are recovered through the signature_cache from the cached digest */
+      std::unordered_set<address>      get_signed_addresses()const;
+      std::unordered_set<pts_address>  get_signed_pts_addresses()const;
+
+   private:
+      struct state
+      {
+         signed_transaction    trx;
+         transaction_id_type   id;
+         fc::sha256            digest;
+         std::vector<char>     packed;
+      };
+      std::shared_ptr<const state> my;
+};
+
 } }  // namespace bts::blockchain
 
 namespace fc {
@@ -2,6 +2,7 @@
 #include <bts/blockchain/block.hpp>
 #include <bts/blockchain/transaction.hpp>
 #include <bts/blockchain/blockchain_db.hpp>
+#include <bts/blockchain/signature_recovery.hpp>
 #include <fc/log/logger.hpp>
 
 namespace bts { namespace blockchain {
@@ -24,15 +25,31 @@ namespace bts { namespace blockchain {
             * @param head_idx - the head index to evaluate this
             * transaction against.  This should be the prior block
             * before the one t will be included in.
+            *
+            * @param keys - the keys already recovered from the signatures of t,
+            * see signature_recovery_pool, or null to recover them here.
+            *
+            * @param pending - outputs of unconfirmed trxs that t may spend
+            *
+            * @param prefetched - the unspent outputs read ahead for a batch including t
             */
            trx_validation_state( const signed_transaction& t, 
                                 blockchain_db* d, 
                                 bool enforce_unspent_in = true,
-                                uint32_t  head_idx = -1
+                                uint32_t  head_idx = -1,
+                                const signature_keys* keys = nullptr,
+                                const pending_outputs* pending = nullptr,
+                                const prefetched_inputs* prefetched = nullptr
                                 );
            bool allow_short_long_matching;
+           /**
+            * when false the signing keys are only recovered for the inputs whose
+            * rules depend on who signed, such as canceling a bid, and missing
+            * signatures are not an error.  See blockchain_db::set_assume_valid()
+            */
+           bool check_signatures;
 
-           trx_validation_state() : trx(signed_transaction()) {}
+           trx_validation_state() : trx(signed_transaction()),check_signatures(true),_keys(nullptr) {}
            
            /** tracks the sum of all inputs and outputs for a particular
             * asset type in the balance_sheet 
@@ -93,6 +110,8 @@ namespace bts { namespace blockchain {
             */
            std::unordered_set<uint8_t>         used_outputs;
            std::unordered_set<address>         signed_addresses;
+           /** only filled when an input is claimed by a pts address */
+           std::unordered_set<pts_address>     signed_pts_addresses;
 
            /**
             *  contains all addresses for which a signature is required,
@@ -116,6 +135,9 @@ namespace bts { namespace blockchain {
            void validate();
         private:
            static const uint16_t output_not_found = uint16_t(-1);
+           const signature_keys*               _keys;
+
+           void     load_signed_addresses();
            void     mark_output_as_used( uint16_t output_number );
            uint16_t find_unused_sig_output( const address& a, const asset& bal );
            uint16_t find_unused_bid_output( const claim_by_bid_output& b );
@@ -61,10 +61,71 @@
 #define PEER_HOST_CACHE_QUERY_LIMIT   (1000)              // number of ip/ports that we will cache
 #define MAX_CHANNELS_PER_CONNECTION   (32)
 
+// public keys recovered from signatures, shared by all components
+#define BTS_SIGNATURE_CACHE_ENTRIES   (64*1024)
+
 // blockchain channel config
 #define TRX_INV_QUERY_LIMIT           (2000) // number of trx that may be sent as part of inventory or request msg
 #define BLOCK_INV_QUERY_LIMIT         (2000) // number of trx that may be sent as part of inventory or request msg
 
+// signature recovery while validating blocks and batches of transactions
+#define BLOCKCHAIN_SIGNATURE_THREADS      (0)                // 0 for one thread per core
+#define BLOCKCHAIN_SIGNATURES_PER_THREAD  (8)                // smaller batches are recovered on the calling thread
+
+// order matching, each asset pair is matched on its own thread
+#define BLOCKCHAIN_MATCH_THREADS          (0)                // 0 for one thread per core, 1 matches on the calling thread
+#define BLOCKCHAIN_ORDER_BOOK_LEVELS      (10)               // price levels per side returned by get_order_book
+
+// number of recent blocks that keep an undo record so they can be popped
+#define BLOCKCHAIN_UNDO_BLOCKS            (BLOCKS_PER_DAY)
+
+// pruned chains, see blockchain_db::set_prune_depth
+#define BLOCKCHAIN_PRUNE_DEPTH            (0)                // blocks of history kept, 0 keeps everything
+#define BLOCKCHAIN_MIN_PRUNE_DEPTH        (BLOCKCHAIN_UNDO_BLOCKS) // blocks that can be popped are never pruned
+#define BLOCKCHAIN_PRUNE_BLOCKS_PER_PUSH  (16)               // catching up on an unpruned chain is spread over many blocks
+
+// index of unspent outputs by the address they pay, see blockchain_db::set_address_index
+#define BLOCKCHAIN_ADDRESS_INDEX          (true)             // costs a write per output created or spent
+
+// pending transactions kept by bts::blockchain::mempool, lowest fee rate is evicted first
+#define BLOCKCHAIN_MEMPOOL_BYTES          (32*1024*1024)     // 32 MB of packed trxs
+#define BLOCKCHAIN_MEMPOOL_ORPHANS        (1000)             // trxs waiting for a parent that has not arrived
+
+// signatures are not checked for blocks up to this trusted one, see blockchain_db::set_assume_valid
+#define BLOCKCHAIN_ASSUME_VALID_BLOCK_NUM (uint32_t(-1))     // none
+#define BLOCKCHAIN_ASSUME_VALID_BLOCK_ID  ""                 // hex id of the block at that height
+
+// blocks decoded and verified by bts::blockchain::block_pipeline ahead of the one being applied
+#define BLOCKCHAIN_PIPELINE_DEPTH         (8)
+
+// blocks are appended to files of about this size, see bts::blockchain::block_archive
+#define BLOCKCHAIN_ARCHIVE_SEGMENT_BYTES  (256*1024*1024)    // 256 MB
+
+// chain state files written by blockchain_db::export_state
+#define BLOCKCHAIN_STATE_FILE_MAGIC       "bts-chain-state"
+#define BLOCKCHAIN_STATE_FILE_VERSION     (1)
+#define BLOCKCHAIN_STATE_FILE_HEADERS     (145)              // generate_next_block reads the header 144 back
+
+// decoded values kept in memory by the blockchain and bitchat databases
+#define BLOCKCHAIN_TRX_CACHE_ENTRIES      (32*1024)          // trx ids and meta trxs
+#define BLOCKCHAIN_TRX_CACHE_BYTES        (64*1024*1024)     // 64 MB per map
+#define BLOCKCHAIN_BLOCK_CACHE_ENTRIES    (BLOCKS_PER_DAY)   // block headers
+#define BLOCKCHAIN_UNSPENT_CACHE_BYTES    (128*1024*1024)    // 128 MB of unspent outputs
+#define BITCHAT_MESSAGE_CACHE_ENTRIES     (4096)             // messages by id
+#define BITCHAT_MESSAGE_CACHE_BYTES       (32*1024*1024)     // 32 MB
+
+// default leveldb options, see bts::db::database_options
+#define DB_BLOOM_FILTER_BITS              (10)               // ~1% false positives on point lookups
+#define DB_CACHE_BYTES                    (8*1024*1024)      // 8 MB, the leveldb default
+#define DB_WRITE_BUFFER_BYTES             (4*1024*1024)      // 4 MB, the leveldb default
+#define DB_BLOCK_BYTES                    (4*1024)           // 4 KB, the leveldb default
+
+// leveldb block cache and memtable shared by all maps of one database
+#define BLOCKCHAIN_DB_CACHE_BYTES         (32*1024*1024)     // 32 MB
+#define BLOCKCHAIN_DB_WRITE_BUFFER_BYTES  (8*1024*1024)      // 8 MB
+#define BITNAME_DB_CACHE_BYTES            (8*1024*1024)      // 8 MB
+#define BITCHAT_DB_CACHE_BYTES            (8*1024*1024)      // 8 MB, per profile
+
 
 /**
  *  How much space can be consumed by the trx portion of a block.  This is calculated to
@@ -0,0 +1,62 @@
+#pragma once
+#include <leveldb/db.h>
+#include <leveldb/cache.h>
+#include <leveldb/filter_policy.h>
+#include <bts/db/database_options.hpp>
+#include <bts/db/fwd.hpp>
+#include <fc/filesystem.hpp>
+
+#include <memory>
+#include <string>
+
+namespace bts { namespace db {
+
+  namespace ldb = leveldb;
+
+  /**
+   *  @brief a leveldb instance shared by several level_maps
+   *
+   *  Each map opened in a shared database owns a namespace: its keys are prefixed
+   *  with the ordered encoding of the map name.  All maps then share one block
+   *  cache, memtable, log and compaction thread, and a write_batch spanning them
+   *  is committed with a single atomic write.
+   */
+  class database : public std::enable_shared_from_this<database>
+  {
+     public:
+        database();
+        ~database();
+
+        void open( const fc::path& dir, bool create = true,
+                   const database_options& opts = database_options() );
+        void close();
+
+        bool            is_open()const { return _db != nullptr; }
+        const fc::path& get_path()const { return _dir; }
+
+        /** the options the database was opened with */
+        const database_options& get_options()const { return _options; }
+
+        /** @pre is_open() */
+        ldb::DB*        get_db()const;
+
+        /**
+         *  Pins the current state of the database, later writes are not visible
+         *  through the snapshot.  The snapshot keeps the database open.
+         *
+         *  @pre is_open() and the database is owned by a database_ptr
+         */
+        snapshot_ptr    create_snapshot();
+
+     private:
+        database( const database& ) = delete;
+        database& operator=( const database& ) = delete;
+
+        fc::path                                 _dir;
+        database_options                         _options;
+        std::unique_ptr<ldb::Cache>              _block_cache;   // must outlive _db
+        std::unique_ptr<const ldb::FilterPolicy> _filter_policy; // must outlive _db
+        std::unique_ptr<ldb::DB>                 _db;
+  };
+
+} } // bts::db
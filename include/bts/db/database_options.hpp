@@ -0,0 +1,34 @@
+#pragma once
+#include <bts/config.hpp>
+#include <fc/reflect/reflect.hpp>
+
+#include <stdint.h>
+
+namespace bts { namespace db {
+
+  /**
+   *  @brief leveldb settings used when opening a database
+   *
+   *  The defaults come from config.hpp, components that know their access
+   *  pattern override them and most expose them in their own config so
+   *  nodes can be tuned without rebuilding.
+   */
+  struct database_options
+  {
+     database_options()
+     :bloom_filter_bits(DB_BLOOM_FILTER_BITS),
+      cache_size(DB_CACHE_BYTES),
+      write_buffer_size(DB_WRITE_BUFFER_BYTES),
+      block_size(DB_BLOCK_BYTES),
+      compression(true){}
+
+     uint32_t bloom_filter_bits;  ///< bits per key of the bloom filter, 0 disables it
+     uint64_t cache_size;         ///< bytes of uncompressed blocks kept in memory
+     uint64_t write_buffer_size;  ///< bytes buffered in the memtable before it is written to disk
+     uint32_t block_size;         ///< approximate bytes of user data per block
+     bool     compression;        ///< snappy compress blocks when leveldb was built with snappy
+  };
+
+} } // bts::db
+
+FC_REFLECT( bts::db::database_options, (bloom_filter_bits)(cache_size)(write_buffer_size)(block_size)(compression) )
@@ -1,6 +1,8 @@
 #pragma once
 #include <memory>
 
+namespace leveldb { class Snapshot; }
+
 namespace bts { namespace db { 
 
      class peer;
@@ -9,4 +11,13 @@ namespace bts { namespace db {
      class peer_ram;
      typedef std::shared_ptr<peer_ram> peer_ram_ptr;
 
+     class database;
+     typedef std::shared_ptr<database> database_ptr;
+
+     /**
+      *  A consistent read only view of every map in a database, pass it to the
+      *  level_map read methods.  The view is released with the last reference.
+      */
+     typedef std::shared_ptr<const leveldb::Snapshot> snapshot_ptr;
+
 }} // namespace bts::db 
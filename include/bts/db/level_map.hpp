@@ -1,16 +1,24 @@
 #pragma once
 #include <leveldb/db.h>
 #include <leveldb/comparator.h>
+#include <leveldb/write_batch.h>
 
 #include <fc/filesystem.hpp>
 
 #include <fc/reflect/reflect.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/exception/exception.hpp>
+#include <fc/optional.hpp>
 
 #include <fc/log/logger.hpp>
 
 #include "upgrade_leveldb.hpp"
+#include "database.hpp"
+#include "ordered_key.hpp"
+#include "write_batch.hpp"
+#include "lru_cache.hpp"
+
+#include <map>
 
 namespace bts { namespace db {
 
@@ -19,58 +27,321 @@ namespace bts { namespace db {
   /**
    *  @brief implements a high-level API on top of Level DB that stores items using fc::raw / reflection
    *
+   *  Keys are stored with their ordered_key encoding so the database uses the default
+   *  bytewise comparator, values are stored with fc::raw.
+   *
+   *  A map either owns a standalone database or is a namespace inside a shared
+   *  database, in which case every key is prefixed with the encoded map name.
+   *
+   *  fetch() can keep recently used values decoded in a bounded cache, see set_cache_limits().
+   *  visit(), visit_sorted(), exists() and iterator::view() give access to stored values without
+   *  decoding them into temporaries.
+   *
+   *  The read methods optionally take a snapshot from database::create_snapshot().
+   *  Snapshot reads bypass the pending batch and the value cache and do not modify
+   *  the map, so they may run on another thread while the map is being written.
    */
   template<typename Key, typename Value>
-  class level_map
+  class level_map : public batch_participant
   {
      public:
-        void open( const fc::path& dir, bool create = true )
+        level_map():_batch(nullptr),_db(nullptr){}
+        ~level_map()
         {
-           ldb::Options opts;
-           opts.create_if_missing = create;
-           opts.comparator = & _comparer;
-
-           /// \waring Given path must exist to succeed toNativeAnsiPath
-           fc::create_directories(dir);
+           // the batch is shared with other maps, only this map leaves it
+           if( _batch ) _batch->leave( this );
+        }
 
-           std::string ldbPath = dir.to_native_ansi_path();
+        void open( const fc::path& dir, bool create = true,
+                   const database_options& opts = database_options() )
+        {
+           open_db( dir, create, opts, &_legacy_comparer, &recode_legacy_key );
+        }
 
-           ldb::DB* ndb = nullptr;
-           auto ntrxstat = ldb::DB::Open( opts, ldbPath.c_str(), &ndb );
-           if( !ntrxstat.ok() )
-           {
-               FC_THROW_EXCEPTION( db_in_use_exception, "Unable to open database ${db}\n\t${msg}", 
-                    ("db",dir)
-                    ("msg",ntrxstat.ToString()) 
-                    );
-           }
-           _db.reset(ndb);
-           UpgradeDbIfNecessary(dir,ndb, fc::get_typename<Value>::name(),sizeof(Value));
+        /**
+         *  Opens the map as the namespace @param name of the shared database @param db,
+         *  the database must stay open until the map is closed.
+         */
+        void open( const database_ptr& db, const std::string& name )
+        { try {
+           FC_ASSERT( db && db->is_open() );
+           FC_ASSERT( !name.empty() );
+           _database = db;
+           _db       = db->get_db();
+           _prefix   = encode_key( name );
+        } FC_RETHROW_EXCEPTIONS( warn, "error opening ${name}", ("name",name) ) }
+
+        /**
+         *  Moves every entry of the standalone database in @param dir into this
+         *  map and then deletes @param dir.  Does nothing if there is no database
+         *  in @param dir, so it can be called on every start.
+         */
+        void import_standalone( const fc::path& dir )
+        {
+           import_db( dir, &_legacy_comparer, &recode_legacy_key );
         }
 
+        /** the database holding this map, shared with other maps unless opened standalone */
+        const database_ptr& get_database()const { return _database; }
+
         void close()
         {
-          _db.reset();
+          _cache.clear();
+          _db = nullptr;
+          _database.reset();
+          _prefix.clear();
+        }
+
+        /**
+         *  Buffers all following store() and remove() calls in @param batch until
+         *  it is committed or discarded.  fetch() and fetch_optional() see the
+         *  pending writes, iterators only see what has been committed.
+         */
+        void join( write_batch& batch )
+        {
+           FC_ASSERT( _db );
+           FC_ASSERT( _batch == nullptr || _batch == &batch );
+           batch.join( this, _db );
+           _batch = &batch;
         }
 
-        Value fetch( const Key& k )
+        /**
+         *  Enables the decoded value cache used by fetch() and fetch_optional(), store()
+         *  and remove() invalidate the cached entry.  Passing 0 for both limits disables it.
+         *
+         *  @param max_entries - maximum number of cached values, 0 for no limit
+         *  @param max_bytes   - maximum encoded size of the cached keys and values, 0 for no limit
+         */
+        void set_cache_limits( uint64_t max_entries, uint64_t max_bytes )
+        {
+           _cache.set_limits( max_entries, max_bytes );
+        }
+
+        cache_stats get_cache_stats()const { return _cache.stats(); }
+
+        /** drops every cached value, needed after the database is written behind the map's back */
+        void clear_cache() { _cache.clear(); }
+
+        /**
+         *  A stored value that has not been decoded, either the packed bytes owned by
+         *  leveldb or a value that is already decoded in the cache or pending batch.
+         *  It is only valid inside the visit() callback or until its iterator moves.
+         *
+         *  Inside the callback visit() and exists() on the same map keep the view valid.
+         *  fetch() and fetch_optional() may evict a cached value and store() or remove()
+         *  replace a pending one, so a view of either must not be used after them.
+         */
+        class value_view
+        {
+           public:
+             /**
+              *  Decodes into @param v, reusing whatever storage it already owns.
+              *  @note fc::raw inserts into sets and maps without clearing them first
+              */
+             void unpack( Value& v )const
+             {
+                if( _value )
+                {
+                   v = *_value;
+                   return;
+                }
+                fc::datastream<const char*> ds( _packed.data(), _packed.size() );
+                fc::raw::unpack( ds, v );
+             }
+
+             Value value()const
+             {
+                Value tmp;
+                unpack( tmp );
+                return tmp;
+             }
+
+           private:
+             friend class level_map;
+             explicit value_view( const ldb::Slice& packed ):_value(nullptr),_packed(packed){}
+             explicit value_view( const Value& v ):_value(&v){}
+
+             const Value* _value;
+             ldb::Slice   _packed;
+        };
+
+        /**
+         *  Calls @param f with a value_view of the value stored under @param k.
+         *
+         *  @return false without calling @param f if @param k is not in the map
+         */
+        template<typename Functor>
+        bool visit( const Key& k, Functor&& f, const snapshot_ptr& snap = snapshot_ptr() )
         {
           try {
-             std::vector<char> kslice = fc::raw::pack( k );
-             ldb::Slice ks( kslice.data(), kslice.size() );
+             std::string kslice = _prefix + encode_key( k );
+             if( snap )
+             {
+                std::string value;
+                if( !read( kslice, snap, value ) )
+                {
+                   return false;
+                }
+                f( value_view( ldb::Slice( value ) ) );
+                return true;
+             }
+             if( _batch )
+             {
+                auto pending_itr = _pending.find( kslice );
+                if( pending_itr != _pending.end() )
+                {
+                   if( !pending_itr->second ) return false;
+                   f( value_view( *pending_itr->second ) );
+                   return true;
+                }
+             }
+             if( _cache.enabled() )
+             {
+                const Value* cached = _cache.get( kslice );
+                if( cached )
+                {
+                   f( value_view( *cached ) );
+                   return true;
+                }
+             }
+             // a buffer per call, f may visit the map again
              std::string value;
-             auto status = _db->Get( ldb::ReadOptions(), ks, &value );
-             if( status.IsNotFound() )
+             if( !read( kslice, snap, value ) )
+             {
+                return false;
+             }
+             f( value_view( ldb::Slice( value ) ) );
+             return true;
+          } FC_RETHROW_EXCEPTIONS( warn, "error visiting key ${key}", ("key",k) );
+        }
+
+        /**
+         *  Looks up many keys with a single iterator, calling @param f( i, view ) for
+         *  each keys[i] that is in the map.  Pending writes and the value cache are
+         *  consulted first, as in visit().  With @param keys sorted and unique the
+         *  iterator only seeks forward, so keys stored near each other share the
+         *  leveldb blocks that were already read.
+         *
+         *  @return the number of keys found
+         */
+        template<typename Functor>
+        size_t visit_sorted( const std::vector<Key>& keys, Functor&& f, const snapshot_ptr& snap = snapshot_ptr() )
+        {
+          try {
+             size_t found = 0;
+             std::unique_ptr<ldb::Iterator> it;
+             for( size_t i = 0; i < keys.size(); ++i )
+             {
+                std::string kslice = _prefix + encode_key( keys[i] );
+                if( !snap && _batch )
+                {
+                   auto pending_itr = _pending.find( kslice );
+                   if( pending_itr != _pending.end() )
+                   {
+                      if( pending_itr->second )
+                      {
+                         f( i, value_view( *pending_itr->second ) );
+                         ++found;
+                      }
+                      continue;
+                   }
+                }
+                if( !snap && _cache.enabled() )
+                {
+                   const Value* cached = _cache.get( kslice );
+                   if( cached )
+                   {
+                      f( i, value_view( *cached ) );
+                      ++found;
+                      continue;
+                   }
+                }
+
+                if( !it )
+                {
+                   it.reset( _db->NewIterator( read_options( snap ) ) );
+                   FC_ASSERT( it != nullptr );
+                }
+                // the previous key is often the one before this in the same block
+                if( !it->Valid() || it->key().compare( kslice ) >= 0 ) it->Seek( kslice );
+                else
+                {
+                   it->Next();
+                   if( it->Valid() && it->key().compare( kslice ) < 0 ) it->Seek( kslice );
+                }
+                if( !it->status().ok() )
+                {
+                   FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", it->status().ToString() ) );
+                }
+                if( it->Valid() && it->key() == ldb::Slice( kslice ) )
+                {
+                   f( i, value_view( it->value() ) );
+                   ++found;
+                }
+             }
+             return found;
+          } FC_RETHROW_EXCEPTIONS( warn, "error visiting ${n} keys", ("n",keys.size()) );
+        }
+
+        /** @return true if @param k is in the map, the value is not decoded */
+        bool exists( const Key& k, const snapshot_ptr& snap = snapshot_ptr() )
+        {
+           return visit( k, []( const value_view& ){}, snap );
+        }
+
+        Value fetch( const Key& k, const snapshot_ptr& snap = snapshot_ptr() )
+        {
+          try {
+             auto value = fetch_optional( k, snap );
+             if( !value )
              {
                FC_THROW_EXCEPTION( key_not_found_exception, "unable to find key ${key}", ("key",k) );
              }
-             if( !status.ok() )
+             return *value;
+          } FC_RETHROW_EXCEPTIONS( warn, "error fetching key ${key}", ("key",k) );
+        }
+
+        fc::optional<Value> fetch_optional( const Key& k, const snapshot_ptr& snap = snapshot_ptr() )
+        {
+          try {
+             std::string kslice = _prefix + encode_key( k );
+             if( snap )
              {
-                 FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
+                std::string value;
+                if( !read( kslice, snap, value ) )
+                {
+                   return fc::optional<Value>();
+                }
+                fc::datastream<const char*> ds( value.data(), value.size() );
+                Value tmp;
+                fc::raw::unpack( ds, tmp );
+                return tmp;
+             }
+             if( _batch )
+             {
+                auto pending_itr = _pending.find( kslice );
+                if( pending_itr != _pending.end() )
+                {
+                   return pending_itr->second;
+                }
+             }
+             if( _cache.enabled() )
+             {
+                const Value* cached = _cache.get( kslice );
+                if( cached )
+                {
+                   return *cached;
+                }
              }
-             fc::datastream<const char*> ds(value.c_str(), value.size());
+             std::string value;
+             if( !read( kslice, snap, value ) )
+             {
+               return fc::optional<Value>();
+             }
+             fc::datastream<const char*> ds(value.data(), value.size());
              Value tmp;
              fc::raw::unpack(ds, tmp);
+             _cache.put( kslice, tmp, value.size() );
              return tmp;
           } FC_RETHROW_EXCEPTIONS( warn, "error fetching key ${key}", ("key",k) );
         }
@@ -79,41 +350,55 @@ namespace bts { namespace db {
         {
            public:
              iterator(){}
-             bool valid()const 
+             bool valid()const
              {
-                return _it && _it->Valid(); 
+                return _it && _it->Valid() && _it->key().starts_with( _prefix );
              }
 
              Key key()const
              {
                  Key tmp_key;
-                 fc::datastream<const char*> ds2( _it->key().data(), _it->key().size() );
-                 fc::raw::unpack( ds2, tmp_key );
+                 key( tmp_key );
                  return tmp_key;
              }
 
+             void key( Key& k )const
+             {
+                 decode_key( _it->key().data() + _prefix.size(), _it->key().size() - _prefix.size(), k );
+             }
+
              Value value()const
              {
-               Value tmp_val;
-               fc::datastream<const char*> ds( _it->value().data(), _it->value().size() );
-               fc::raw::unpack( ds, tmp_val );
-               return tmp_val;
+               return view().value();
+             }
+
+             void value( Value& v )const
+             {
+               view().unpack( v );
+             }
+
+             /** the packed value in the iterator's memory, valid until the iterator moves */
+             value_view view()const
+             {
+               return value_view( _it->value() );
              }
 
              iterator& operator++() { _it->Next(); return *this; }
              iterator& operator--() { _it->Prev(); return *this; }
-           
+
            protected:
              friend class level_map;
-             iterator( ldb::Iterator* it )
-             :_it(it){}
+             iterator( ldb::Iterator* it, const std::string& prefix, const snapshot_ptr& snap )
+             :_snapshot(snap),_it(it),_prefix(prefix){}
 
+             snapshot_ptr                   _snapshot; // outlives _it
              std::shared_ptr<ldb::Iterator> _it;
+             std::string                    _prefix;
         };
-        iterator begin() 
+        iterator begin( const snapshot_ptr& snap = snapshot_ptr() )
         { try {
-           iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
-           itr._it->SeekToFirst();
+           iterator itr( _db->NewIterator( read_options( snap ) ), _prefix, snap );
+           itr._it->Seek( _prefix );
 
            if( itr._it->status().IsNotFound() )
            {
@@ -131,25 +416,24 @@ namespace bts { namespace db {
            return iterator();
         } FC_RETHROW_EXCEPTIONS( warn, "error seeking to first" ) }
 
-        iterator find( const Key& key )
+        iterator find( const Key& key, const snapshot_ptr& snap = snapshot_ptr() )
         { try {
-           std::vector<char> kslice = fc::raw::pack( key );
-           ldb::Slice key_slice( kslice.data(), kslice.size() );
-           iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
+           std::string key_slice = _prefix + encode_key( key );
+           iterator itr( _db->NewIterator( read_options( snap ) ), _prefix, snap );
            itr._it->Seek( key_slice );
-           if( itr.valid() && itr.key() == key ) 
+           if( itr.valid() && itr._it->key() == ldb::Slice( key_slice ) )
            {
               return itr;
            }
            return iterator();
         } FC_RETHROW_EXCEPTIONS( warn, "error finding ${key}", ("key",key) ) }
 
-        iterator lower_bound( const Key& key )
+        iterator lower_bound( const Key& key, const snapshot_ptr& snap = snapshot_ptr() )
         { try {
-           ldb::Slice key_slice( (char*)&key, sizeof(key) );
-           iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
+           std::string key_slice = _prefix + encode_key( key );
+           iterator itr( _db->NewIterator( read_options( snap ) ), _prefix, snap );
            itr._it->Seek( key_slice );
-           if( itr.valid()  ) 
+           if( itr.valid()  )
            {
               return itr;
            }
@@ -157,37 +441,33 @@ namespace bts { namespace db {
         } FC_RETHROW_EXCEPTIONS( warn, "error finding ${key}", ("key",key) ) }
 
 
-        bool last( Key& k )
+        bool last( Key& k, const snapshot_ptr& snap = snapshot_ptr() )
         {
           try {
-             std::unique_ptr<ldb::Iterator> it( _db->NewIterator( ldb::ReadOptions() ) );
+             std::unique_ptr<ldb::Iterator> it( _db->NewIterator( read_options( snap ) ) );
              FC_ASSERT( it != nullptr );
-             it->SeekToLast();
-             if( !it->Valid() )
+             if( !seek_to_last( *it ) )
              {
                return false;
              }
-             fc::datastream<const char*> ds2( it->key().data(), it->key().size() );
-             fc::raw::unpack( ds2, k );
+             decode_key( it->key().data() + _prefix.size(), it->key().size() - _prefix.size(), k );
              return true;
           } FC_RETHROW_EXCEPTIONS( warn, "error reading last item from database" );
         }
 
-        bool last( Key& k, Value& v )
+        bool last( Key& k, Value& v, const snapshot_ptr& snap = snapshot_ptr() )
         {
           try {
-           std::unique_ptr<ldb::Iterator> it( _db->NewIterator( ldb::ReadOptions() ) );
+           std::unique_ptr<ldb::Iterator> it( _db->NewIterator( read_options( snap ) ) );
            FC_ASSERT( it != nullptr );
-           it->SeekToLast();
-           if( !it->Valid() )
+           if( !seek_to_last( *it ) )
            {
              return false;
            }
            fc::datastream<const char*> ds( it->value().data(), it->value().size() );
            fc::raw::unpack( ds, v );
 
-           fc::datastream<const char*> ds2( it->key().data(), it->key().size() );
-           fc::raw::unpack( ds2, k );
+           decode_key( it->key().data() + _prefix.size(), it->key().size() - _prefix.size(), k );
            return true;
           } FC_RETHROW_EXCEPTIONS( warn, "error reading last item from database" );
         }
@@ -196,12 +476,20 @@ namespace bts { namespace db {
         {
           try
           {
-             std::vector<char> kslice = fc::raw::pack( k );
-             ldb::Slice ks( kslice.data(), kslice.size() );
+             std::string ks = _prefix + encode_key( k );
 
              auto vec = fc::raw::pack(v);
              ldb::Slice vs( vec.data(), vec.size() );
-             
+
+             _cache.erase( ks );
+             if( _batch )
+             {
+                record_undo( ks );
+                _batch->put( _db, ks, vs );
+                _pending[ks] = v;
+                return;
+             }
+
              auto status = _db->Put( ldb::WriteOptions(), ks, vs );
              if( !status.ok() )
              {
@@ -214,8 +502,17 @@ namespace bts { namespace db {
         {
           try
           {
-             std::vector<char> kslice = fc::raw::pack( k );
-             ldb::Slice ks( kslice.data(), kslice.size() );
+             std::string ks = _prefix + encode_key( k );
+
+             _cache.erase( ks );
+             if( _batch )
+             {
+                record_undo( ks );
+                _batch->remove( _db, ks );
+                _pending[ks] = fc::optional<Value>();
+                return;
+             }
+
              auto status = _db->Delete( ldb::WriteOptions(), ks );
              if( status.IsNotFound() )
              {
@@ -227,10 +524,147 @@ namespace bts { namespace db {
              }
           } FC_RETHROW_EXCEPTIONS( warn, "error removing ${key}", ("key",k) );
         }
-        
+
+        virtual void batch_committed() { _pending.clear(); _batch = nullptr; }
+        virtual void batch_discarded() { _pending.clear(); _batch = nullptr; }
+
+     protected:
+        /**
+         *  Opens the standalone database in @param dir, first converting it to the
+         *  ordered key encoding if it was created with the legacy comparator.
+         */
+        void open_db( const fc::path& dir, bool create, const database_options& opts,
+                      const ldb::Comparator* legacy_comparator, TRecodeKeyFunction recode_key )
+        {
+           /// \waring Given path must exist to succeed toNativeAnsiPath
+           fc::create_directories(dir);
+
+           UpgradeDbKeysIfNecessary( dir, legacy_comparator, recode_key );
+
+           auto standalone = std::make_shared<database>();
+           standalone->open( dir, create, opts );
+
+           _database = standalone;
+           _db       = standalone->get_db();
+           _prefix.clear();
+           UpgradeDbIfNecessary(dir,_db, fc::get_typename<Value>::name(),sizeof(Value));
+        }
+
+        void import_db( const fc::path& dir,
+                        const ldb::Comparator* legacy_comparator, TRecodeKeyFunction recode_key )
+        { try {
+           FC_ASSERT( _db && !_prefix.empty() );
+           if( !fc::exists( dir / "CURRENT" ) )
+           {
+              return;
+           }
+           ilog( "importing ${dir} into the shared database", ("dir",dir) );
+
+           UpgradeDbKeysIfNecessary( dir, legacy_comparator, recode_key );
+           {
+              database standalone;
+              standalone.open( dir, false );
+              UpgradeDbIfNecessary(dir,standalone.get_db(), fc::get_typename<Value>::name(),sizeof(Value));
+
+              std::unique_ptr<ldb::Iterator> itr( standalone.get_db()->NewIterator( ldb::ReadOptions() ) );
+              ldb::WriteBatch batch;
+              uint32_t        count = 0;
+              for( itr->SeekToFirst(); itr->Valid(); itr->Next() )
+              {
+                 batch.Put( _prefix + itr->key().ToString(), itr->value() );
+                 if( ++count % 1000 == 0 )
+                 {
+                    write_import_batch( batch );
+                 }
+              }
+              if( !itr->status().ok() )
+              {
+                 FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", itr->status().ToString() ) );
+              }
+              write_import_batch( batch );
+           }
+           _cache.clear();
+           fc::remove_all( dir );
+        } FC_RETHROW_EXCEPTIONS( warn, "error importing ${dir}", ("dir",dir) ) }
 
      private:
-        class key_compare : public leveldb::Comparator
+        static ldb::ReadOptions read_options( const snapshot_ptr& snap )
+        {
+           ldb::ReadOptions opts;
+           opts.snapshot = snap.get();
+           return opts;
+        }
+
+        /** reads the value stored under @param kslice into @param value */
+        bool read( const std::string& kslice, const snapshot_ptr& snap, std::string& value )const
+        {
+           auto status = _db->Get( read_options( snap ), kslice, &value );
+           if( status.IsNotFound() )
+           {
+              return false;
+           }
+           if( !status.ok() )
+           {
+               FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
+           }
+           return true;
+        }
+
+        /** adds the committed value of @param ks to the batch's undo journal the first time it is written */
+        void record_undo( const std::string& ks )
+        {
+           undo_journal* journal = _batch->get_undo_journal( _db );
+           if( !journal || !journal->needs( ks ) ) return;
+
+           fc::optional<std::string> prior;
+           std::string value;
+           if( read( ks, snapshot_ptr(), value ) ) prior = value;
+           journal->record( ks, prior );
+        }
+
+        void write_import_batch( ldb::WriteBatch& batch )
+        {
+           ldb::WriteOptions sync_opts;
+           sync_opts.sync = true;
+           auto status = _db->Write( sync_opts, &batch );
+           if( !status.ok() )
+           {
+               FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
+           }
+           batch.Clear();
+        }
+
+        /**
+         *  Positions @param it on the last key of this map.  The encoded map name
+         *  ends with the 0x01 string terminator, so incrementing that byte gives
+         *  the first key past the namespace.
+         */
+        bool seek_to_last( ldb::Iterator& it )const
+        {
+           if( _prefix.empty() )
+           {
+              it.SeekToLast();
+              return it.Valid();
+           }
+           std::string past_end = _prefix;
+           ++past_end[past_end.size()-1];
+           it.Seek( past_end );
+           if( it.Valid() ) it.Prev();
+           else             it.SeekToLast();
+           return it.Valid() && it.key().starts_with( _prefix );
+        }
+
+        /** databases created before the ordered key encoding stored fc::raw packed keys */
+        static std::string recode_legacy_key( const ldb::Slice& legacy_key )
+        {
+           Key tmp;
+           fc::datastream<const char*> ds( legacy_key.data(), legacy_key.size() );
+           fc::raw::unpack( ds, tmp );
+           return encode_key( tmp );
+        }
+
+        /** the comparator used by databases created before the ordered key encoding */
+        class legacy_key_compare : public leveldb::Comparator
         {
           public:
             int Compare( const leveldb::Slice& a, const leveldb::Slice& b )const
@@ -251,10 +685,18 @@ namespace bts { namespace db {
             void FindShortSuccessor( std::string* )const{};
         };
 
-        key_compare                  _comparer;
-public: //DLNFIX temporary, remove this
-        std::unique_ptr<leveldb::DB> _db;
-        
+        legacy_key_compare           _legacy_comparer;
+
+        /** writes buffered in _batch, an empty value marks a removed key */
+        write_batch*                                      _batch;
+        std::map<std::string, fc::optional<Value> >      _pending;
+
+        lru_cache<Value>                                  _cache;
+
+        database_ptr                                      _database;
+        ldb::DB*                                          _db;
+        std::string                                       _prefix;
+
   };
 
 
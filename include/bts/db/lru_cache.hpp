@@ -0,0 +1,132 @@
+#pragma once
+#include <fc/reflect/reflect.hpp>
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+namespace bts { namespace db {
+
+  struct cache_stats
+  {
+     cache_stats():hits(0),misses(0),evictions(0),entries(0),bytes(0){}
+
+     uint64_t hits;
+     uint64_t misses;
+     uint64_t evictions;
+     uint64_t entries;
+     uint64_t bytes;
+  };
+
+  /**
+   *  @brief bounded least-recently-used cache of decoded values
+   *
+   *  Entries are keyed by the encoded database key and charged the size of the
+   *  encoded key and value.  The cache is disabled until a limit is set; a limit
+   *  of 0 leaves that dimension unbounded.
+   *
+   *  @note like level_map this is not thread safe.
+   */
+  template<typename Value>
+  class lru_cache
+  {
+     public:
+        lru_cache():_max_entries(0),_max_bytes(0){}
+
+        void set_limits( uint64_t max_entries, uint64_t max_bytes )
+        {
+           _max_entries = max_entries;
+           _max_bytes   = max_bytes;
+           if( !enabled() )
+           {
+              clear();
+           }
+           shrink();
+        }
+
+        bool enabled()const { return _max_entries != 0 || _max_bytes != 0; }
+
+        /** @return the cached value or nullptr, the pointer is valid until the cache is modified */
+        const Value* get( const std::string& key )
+        {
+           auto itr = _entries.find( key );
+           if( itr == _entries.end() )
+           {
+              ++_stats.misses;
+              return nullptr;
+           }
+           ++_stats.hits;
+           _lru.splice( _lru.begin(), _lru, itr->second.lru_pos );
+           return &itr->second.value;
+        }
+
+        void put( const std::string& key, const Value& value, uint64_t encoded_size )
+        {
+           if( !enabled() ) return;
+           erase( key );
+
+           entry e;
+           e.value  = value;
+           e.bytes  = key.size() + encoded_size;
+           _lru.push_front( key );
+           e.lru_pos = _lru.begin();
+           _entries[key] = e;
+
+           ++_stats.entries;
+           _stats.bytes += e.bytes;
+           shrink();
+        }
+
+        void erase( const std::string& key )
+        {
+           auto itr = _entries.find( key );
+           if( itr == _entries.end() ) return;
+
+           --_stats.entries;
+           _stats.bytes -= itr->second.bytes;
+           _lru.erase( itr->second.lru_pos );
+           _entries.erase( itr );
+        }
+
+        void clear()
+        {
+           _entries.clear();
+           _lru.clear();
+           _stats.entries = 0;
+           _stats.bytes   = 0;
+        }
+
+        const cache_stats& stats()const { return _stats; }
+
+     private:
+        typedef std::list<std::string> lru_list;
+
+        struct entry
+        {
+           Value                       value;
+           uint64_t                    bytes;
+           typename lru_list::iterator lru_pos;
+        };
+
+        void shrink()
+        {
+           while( !_lru.empty() &&
+                  ( (_max_entries && _stats.entries > _max_entries) ||
+                    (_max_bytes   && _stats.bytes   > _max_bytes) ) )
+           {
+              std::string oldest = _lru.back();
+              erase( oldest );
+              ++_stats.evictions;
+           }
+        }
+
+        uint64_t                               _max_entries;
+        uint64_t                               _max_bytes;
+        std::unordered_map<std::string,entry>  _entries;
+        lru_list                               _lru;   // most recently used first
+        cache_stats                            _stats;
+  };
+
+} } // bts::db
+
+FC_REFLECT( bts::db::cache_stats, (hits)(misses)(evictions)(entries)(bytes) )
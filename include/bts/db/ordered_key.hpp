@@ -0,0 +1,298 @@
+#pragma once
+#include <fc/crypto/ripemd160.hpp>
+#include <fc/crypto/sha224.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/io/enum_type.hpp>
+#include <fc/array.hpp>
+#include <fc/uint128.hpp>
+#include <fc/time.hpp>
+
+#include <boost/preprocessor/seq/for_each.hpp>
+
+#include <string.h>
+#include <string>
+#include <type_traits>
+
+namespace bts { namespace db {
+
+  /**
+   *  @brief binary key encoding that preserves the order of the decoded keys
+   *
+   *  Keys are stored so that comparing the encoded bytes with memcmp gives the
+   *  same order as operator< on the keys, which lets leveldb use its default
+   *  bytewise comparator instead of decoding both keys on every comparison.
+   *
+   *  Integers are big-endian with the sign bit flipped, hashes and fixed arrays are
+   *  stored as raw bytes, strings are escaped and terminated so that a shorter
+   *  string sorts before any string it prefixes.  Composite keys are the
+   *  concatenation of their members in comparison order, see BTS_DB_ORDERED_KEY.
+   *
+   *  Every specialization provides:
+   *
+   *  @code
+   *    static void encode( std::string& out, const T& v );              // appends to out
+   *    static void decode( const char*& pos, const char* end, T& v );   // advances pos
+   *  @endcode
+   */
+  template<typename T, typename Enable = void>
+  struct ordered_key;
+
+  namespace detail
+  {
+     inline void check_remaining( const char* pos, const char* end, size_t len )
+     {
+        FC_ASSERT( pos <= end && size_t(end - pos) >= len, "truncated key" );
+     }
+
+     template<typename UnsignedInt>
+     void encode_big_endian( std::string& out, UnsignedInt v )
+     {
+        char buf[sizeof(UnsignedInt)];
+        for( int i = sizeof(UnsignedInt) - 1; i >= 0; --i )
+        {
+           buf[i] = char(v & 0xff);
+           v >>= 8;
+        }
+        out.append( buf, sizeof(buf) );
+     }
+
+     template<typename UnsignedInt>
+     UnsignedInt decode_big_endian( const char*& pos, const char* end )
+     {
+        check_remaining( pos, end, sizeof(UnsignedInt) );
+        UnsignedInt v = 0;
+        for( size_t i = 0; i < sizeof(UnsignedInt); ++i )
+        {
+           v = (v << 8) | UnsignedInt(uint8_t(pos[i]));
+        }
+        pos += sizeof(UnsignedInt);
+        return v;
+     }
+
+     /** hashes compare with memcmp over their raw bytes */
+     template<typename Hash>
+     struct ordered_hash_key
+     {
+        static void encode( std::string& out, const Hash& v )
+        {
+           out.append( v.data(), v.data_size() );
+        }
+        static void decode( const char*& pos, const char* end, Hash& v )
+        {
+           check_remaining( pos, end, v.data_size() );
+           memcpy( v.data(), pos, v.data_size() );
+           pos += v.data_size();
+        }
+     };
+  } // namespace detail
+
+  template<typename T>
+  struct ordered_key<T, typename std::enable_if<std::is_integral<T>::value>::type>
+  {
+     typedef typename std::make_unsigned<T>::type unsigned_type;
+     static const unsigned_type sign_flip = std::is_signed<T>::value ? unsigned_type(unsigned_type(1) << (sizeof(T)*8-1)) : 0;
+
+     static void encode( std::string& out, const T& v )
+     {
+        detail::encode_big_endian<unsigned_type>( out, unsigned_type(v) ^ sign_flip );
+     }
+     static void decode( const char*& pos, const char* end, T& v )
+     {
+        v = T( detail::decode_big_endian<unsigned_type>( pos, end ) ^ sign_flip );
+     }
+  };
+
+  template<typename T>
+  struct ordered_key<T, typename std::enable_if<std::is_enum<T>::value>::type>
+  {
+     typedef typename std::underlying_type<T>::type int_type;
+
+     static void encode( std::string& out, const T& v )
+     {
+        ordered_key<int_type>::encode( out, int_type(v) );
+     }
+     static void decode( const char*& pos, const char* end, T& v )
+     {
+        int_type i;
+        ordered_key<int_type>::decode( pos, end, i );
+        v = T(i);
+     }
+  };
+
+  template<typename IntType, typename EnumType>
+  struct ordered_key< fc::enum_type<IntType,EnumType> >
+  {
+     static void encode( std::string& out, const fc::enum_type<IntType,EnumType>& v )
+     {
+        ordered_key<IntType>::encode( out, IntType(v.value) );
+     }
+     static void decode( const char*& pos, const char* end, fc::enum_type<IntType,EnumType>& v )
+     {
+        IntType i;
+        ordered_key<IntType>::decode( pos, end, i );
+        v.value = EnumType(i);
+     }
+  };
+
+  template<> struct ordered_key<fc::ripemd160> : detail::ordered_hash_key<fc::ripemd160>{};
+  template<> struct ordered_key<fc::sha224>    : detail::ordered_hash_key<fc::sha224>{};
+  template<> struct ordered_key<fc::sha256>    : detail::ordered_hash_key<fc::sha256>{};
+
+  /** fc::array compares with memcmp over its raw bytes */
+  template<typename T, size_t N>
+  struct ordered_key< fc::array<T,N> >
+  {
+     static_assert( sizeof(T) == 1, "only byte arrays have a bytewise order" );
+
+     static void encode( std::string& out, const fc::array<T,N>& v )
+     {
+        out.append( (const char*)v.data, N );
+     }
+     static void decode( const char*& pos, const char* end, fc::array<T,N>& v )
+     {
+        detail::check_remaining( pos, end, N );
+        memcpy( (char*)v.data, pos, N );
+        pos += N;
+     }
+  };
+
+  template<>
+  struct ordered_key<fc::uint128>
+  {
+     static void encode( std::string& out, const fc::uint128& v )
+     {
+        detail::encode_big_endian<uint64_t>( out, v.high_bits() );
+        detail::encode_big_endian<uint64_t>( out, v.low_bits() );
+     }
+     static void decode( const char*& pos, const char* end, fc::uint128& v )
+     {
+        uint64_t hi = detail::decode_big_endian<uint64_t>( pos, end );
+        uint64_t lo = detail::decode_big_endian<uint64_t>( pos, end );
+        v = fc::uint128( hi, lo );
+     }
+  };
+
+  template<>
+  struct ordered_key<fc::time_point>
+  {
+     static void encode( std::string& out, const fc::time_point& v )
+     {
+        ordered_key<int64_t>::encode( out, v.time_since_epoch().count() );
+     }
+     static void decode( const char*& pos, const char* end, fc::time_point& v )
+     {
+        int64_t usec;
+        ordered_key<int64_t>::decode( pos, end, usec );
+        v = fc::time_point( fc::microseconds(usec) );
+     }
+  };
+
+  template<>
+  struct ordered_key<fc::time_point_sec>
+  {
+     static void encode( std::string& out, const fc::time_point_sec& v )
+     {
+        ordered_key<uint32_t>::encode( out, v.sec_since_epoch() );
+     }
+     static void decode( const char*& pos, const char* end, fc::time_point_sec& v )
+     {
+        uint32_t sec;
+        ordered_key<uint32_t>::decode( pos, end, sec );
+        v = fc::time_point_sec( sec );
+     }
+  };
+
+  /**
+   *  Each 0x00 byte is escaped as 0x00 0xff and the string is terminated with
+   *  0x00 0x01, so strings keep their lexicographic order even when followed by
+   *  other members of a composite key.
+   */
+  template<>
+  struct ordered_key<std::string>
+  {
+     static void encode( std::string& out, const std::string& v )
+     {
+        for( auto itr = v.begin(); itr != v.end(); ++itr )
+        {
+           out.push_back( *itr );
+           if( *itr == '\0' )
+           {
+              out.push_back( char(0xff) );
+           }
+        }
+        out.push_back( '\0' );
+        out.push_back( char(0x01) );
+     }
+     static void decode( const char*& pos, const char* end, std::string& v )
+     {
+        v.clear();
+        while( true )
+        {
+           detail::check_remaining( pos, end, 1 );
+           if( *pos != '\0' )
+           {
+              v.push_back( *pos++ );
+              continue;
+           }
+           detail::check_remaining( pos, end, 2 );
+           if( pos[1] == char(0x01) )
+           {
+              pos += 2;
+              return;
+           }
+           FC_ASSERT( pos[1] == char(0xff), "invalid string escape in key" );
+           v.push_back( '\0' );
+           pos += 2;
+        }
+     }
+  };
+
+  template<typename T>
+  std::string encode_key( const T& k )
+  {
+     std::string out;
+     ordered_key<T>::encode( out, k );
+     return out;
+  }
+
+  /** @throw if data does not hold exactly one encoded key */
+  template<typename T>
+  void decode_key( const char* data, size_t size, T& k )
+  {
+     const char* pos = data;
+     ordered_key<T>::decode( pos, data + size, k );
+     FC_ASSERT( pos == data + size, "unexpected trailing bytes in key" );
+  }
+
+} } // bts::db
+
+#define BTS_DB_ORDERED_KEY_ENCODE_MEMBER( r, v, elem ) \
+   bts::db::ordered_key<decltype(v.elem)>::encode( out, v.elem );
+
+#define BTS_DB_ORDERED_KEY_DECODE_MEMBER( r, v, elem ) \
+   bts::db::ordered_key<decltype(v.elem)>::decode( pos, end, v.elem );
+
+/**
+ *  Defines the ordered key encoding of a composite key as the concatenation of
+ *  MEMBERS, which must be listed in the same order operator< compares them.
+ *  Must be used from the global namespace.
+ *
+ *  @code
+ *    BTS_DB_ORDERED_KEY( bts::blockchain::trx_num, (block_num)(trx_idx) )
+ *  @endcode
+ */
+#define BTS_DB_ORDERED_KEY( TYPE, MEMBERS ) \
+namespace bts { namespace db { \
+  template<> struct ordered_key<TYPE> \
+  { \
+     static void encode( std::string& out, const TYPE& v ) \
+     { \
+        BOOST_PP_SEQ_FOR_EACH( BTS_DB_ORDERED_KEY_ENCODE_MEMBER, v, MEMBERS ) \
+     } \
+     static void decode( const char*& pos, const char* end, TYPE& v ) \
+     { \
+        BOOST_PP_SEQ_FOR_EACH( BTS_DB_ORDERED_KEY_DECODE_MEMBER, v, MEMBERS ) \
+     } \
+  }; \
+} }
@@ -0,0 +1,129 @@
+#pragma once
+#include <bts/db/level_map.hpp>
+#include <bts/db/write_batch.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/io/raw.hpp>
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+namespace bts { namespace db {
+
+  /**
+   *  @brief writes values packed with fc::raw one after another to a file
+   *
+   *  Every byte written goes into a sha256 that finish() appends to the file,
+   *  so a state_file_reader can reject a file that was truncated or corrupted
+   *  before anything is read from it.
+   */
+  class state_file_writer
+  {
+     public:
+        state_file_writer( const fc::path& file );
+
+        template<typename T>
+        void write( const T& v )
+        {
+           auto data = fc::raw::pack( v );
+           write( data.data(), data.size() );
+        }
+        void write( const char* data, size_t len );
+
+        /** appends the checksum of everything written and closes the file */
+        void finish();
+
+     private:
+        std::ofstream         _out;
+        fc::sha256::encoder   _checksum;
+  };
+
+  /**
+   *  @brief reads back the values written by a state_file_writer
+   *
+   *  Also the stream interface used by fc::raw::unpack.
+   */
+  class state_file_reader
+  {
+     public:
+        /** @throw if the checksum at the end of @param file does not match the rest of it */
+        state_file_reader( const fc::path& file );
+
+        template<typename T>
+        void read( T& v )
+        {
+           fc::raw::unpack( *this, v );
+        }
+        bool read( char* data, size_t len );
+        bool get( char& c )          { return read( &c, 1 ); }
+        bool get( unsigned char& c ) { return read( (char*)&c, 1 ); }
+
+     private:
+        std::ifstream         _in;
+        uint64_t              _remaining; ///< bytes before the checksum
+  };
+
+  /**
+   *  Writes every entry of @param map as of @param snap as a section called
+   *  @param name, in key order.
+   *
+   *  @return the number of entries written
+   */
+  template<typename Key, typename Value>
+  uint64_t write_section( state_file_writer& out, const std::string& name, level_map<Key,Value>& map,
+                          const snapshot_ptr& snap = snapshot_ptr() )
+  { try {
+     uint64_t count = 0;
+     out.write( name );
+     for( auto itr = map.begin( snap ); itr.valid(); ++itr, ++count )
+     {
+        out.write( true );
+        out.write( itr.key() );
+        out.write( itr.value() );
+     }
+     out.write( false );
+     return count;
+  } FC_RETHROW_EXCEPTIONS( warn, "error writing section ${name}", ("name",name) ) }
+
+  /**
+   *  Stores the entries of the section called @param name into @param map.  They
+   *  were written in key order, so each batch of @param batch_size entries is a
+   *  sorted run of keys.
+   *
+   *  @return the number of entries read
+   */
+  template<typename Key, typename Value>
+  uint64_t read_section( state_file_reader& in, const std::string& name, level_map<Key,Value>& map,
+                         uint32_t batch_size = 10000 )
+  { try {
+     std::string section;
+     in.read( section );
+     FC_ASSERT( section == name, "expected section ${name} but found ${section}", ("name",name)("section",section) );
+
+     std::unique_ptr<write_batch> batch( new write_batch() );
+     map.join( *batch );
+
+     uint64_t count = 0;
+     Key      k;
+     Value    v;
+     bool     more = false;
+     in.read( more );
+     while( more )
+     {
+        in.read( k );
+        in.read( v );
+        map.store( k, v );
+        if( ++count % batch_size == 0 )
+        {
+           batch->commit();
+           batch.reset( new write_batch() );
+           map.join( *batch );
+        }
+        in.read( more );
+     }
+     batch->commit();
+     return count;
+  } FC_RETHROW_EXCEPTIONS( warn, "error reading section ${name}", ("name",name) ) }
+
+} } // bts::db
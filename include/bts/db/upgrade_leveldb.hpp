@@ -24,6 +24,8 @@
 
 //*Database versioning is only supported for changes to database value types
 // (databases with modified key types cannot currently be upgraded).
+//*Databases created before keys were stored in their ordered encoding (see
+// ordered_key.hpp) are converted once by UpgradeDbKeysIfNecessary.
 //*The database versioning code requires that fc::get_typename is defined for
 // all value types which are to be versioned.
 
@@ -108,4 +110,16 @@ void UpgradeDb ## TYPE ## VERSIONNUM(leveldb::DB* dbase) \
 static int dummyResult ## TYPE ## VERSIONNUM  = \
   TUpgradeDbMapper::Instance()->Add(fc::get_typename<TYPE ## VERSIONNUM>::name(), UpgradeDb ## TYPE ## VERSIONNUM);
 
-void UpgradeDbIfNecessary(fc::path dir, leveldb::DB* dbase, const char* record_type, size_t record_type_size);
\ No newline at end of file
+void UpgradeDbIfNecessary(fc::path dir, leveldb::DB* dbase, const char* record_type, size_t record_type_size);
+
+typedef std::function<std::string(const leveldb::Slice&)> TRecodeKeyFunction;
+
+// If dir holds a database without a KEY_ENCODING file it was created with the
+// legacy_comparator; copy it to a fresh database using the default bytewise
+// comparator with every key converted by recode_key, and replace the original.
+// The original is kept in dir.old until the converted database is in place, and a
+// conversion that was interrupted is finished or rolled back the next time.
+void UpgradeDbKeysIfNecessary(fc::path dir, const leveldb::Comparator* legacy_comparator, TRecodeKeyFunction recode_key);
+
+// Records that the database in dir stores ordered keys.
+void MarkDbKeysOrdered(fc::path dir);
@@ -0,0 +1,137 @@
+#pragma once
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+#include <fc/optional.hpp>
+#include <fc/reflect/reflect.hpp>
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace bts { namespace db {
+
+  namespace ldb = leveldb;
+
+  /**
+   *  Implemented by maps that buffer their writes in a write_batch so that
+   *  they can be told when the batch has been written or thrown away.
+   */
+  class batch_participant
+  {
+     public:
+        virtual ~batch_participant(){}
+        virtual void batch_committed() = 0;
+        virtual void batch_discarded() = 0;
+  };
+
+  class write_batch;
+
+  /** the value a key had before a batch first wrote it, empty if it did not exist */
+  struct undo_entry
+  {
+     std::string                  key;
+     fc::optional<std::string>    value;
+  };
+
+  /**
+   *  @brief records how to revert the writes of a write_batch
+   *
+   *  Maps joined to a batch that records undo add the prior value of each key
+   *  the first time they store or remove it, so the journal holds one entry per
+   *  key touched no matter how often it was written.
+   */
+  class undo_journal
+  {
+     public:
+        /** @return true if @param key has not been recorded yet */
+        bool needs( const std::string& key )const { return _keys.find( key ) == _keys.end(); }
+
+        void record( const std::string& key, const fc::optional<std::string>& prior );
+
+        const std::vector<undo_entry>& entries()const { return _entries; }
+
+        /** queues the writes that restore every key in @param entries to its prior value */
+        static void revert( const std::vector<undo_entry>& entries, write_batch& batch, ldb::DB* db );
+
+     private:
+        std::vector<undo_entry>  _entries;
+        std::set<std::string>    _keys;
+  };
+
+  /**
+   *  @brief collects the writes of several level_maps and applies them together
+   *
+   *  Maps join the batch with level_map::join(), after which store() and remove()
+   *  are buffered here rather than written to the database.  Reads on a joined map
+   *  see its own pending writes.  Nothing reaches disk until commit() is called; if
+   *  the batch is destroyed without being committed all pending writes are dropped.
+   *
+   *  Writes are grouped into one leveldb::WriteBatch per database and each database
+   *  is written with a single atomic Write(), in the order the maps joined.  Maps
+   *  opened in the same shared database are therefore committed all at once.
+   */
+  class write_batch
+  {
+     public:
+        write_batch();
+        ~write_batch();
+
+        /**
+         *  Registers @param p as a participant writing to @param db.
+         */
+        void join( batch_participant* p, ldb::DB* db );
+
+        /**
+         *  Forgets @param p without notifying it, for a participant that is destroyed
+         *  before the batch.  The writes it buffered stay in the batch.
+         */
+        void leave( batch_participant* p );
+
+        void put( ldb::DB* db, const ldb::Slice& key, const ldb::Slice& value );
+        void remove( ldb::DB* db, const ldb::Slice& key );
+
+        /**
+         *  Writes all pending changes and releases the participants.
+         *  @param sync - wait for the write to reach stable storage
+         */
+        void commit( bool sync = true );
+
+        /** drops all pending changes and releases the participants */
+        void discard();
+
+        /** number of put/remove operations buffered */
+        uint32_t size()const { return _operations; }
+
+        /**
+         *  Records the prior value of every key written to @param db in @param journal,
+         *  which must outlive the batch.  Pass a null journal to stop recording.
+         */
+        void record_undo( ldb::DB* db, undo_journal* journal );
+
+        /** @return the journal recording writes to @param db, or nullptr */
+        undo_journal* get_undo_journal( ldb::DB* db )const { return db == _undo_db ? _undo : nullptr; }
+
+     private:
+        write_batch( const write_batch& ) = delete;
+        write_batch& operator=( const write_batch& ) = delete;
+
+        ldb::WriteBatch& batch_for( ldb::DB* db );
+
+        struct db_batch
+        {
+           db_batch( ldb::DB* d ):db(d),batch( new ldb::WriteBatch() ){}
+           ldb::DB*                         db;
+           std::shared_ptr<ldb::WriteBatch> batch;
+        };
+
+        std::vector<db_batch>            _batches;
+        std::vector<batch_participant*>  _participants;
+        uint32_t                         _operations;
+        ldb::DB*                         _undo_db;
+        undo_journal*                    _undo;
+  };
+
+} } // bts::db
+
+FC_REFLECT( bts::db::undo_entry, (key)(value) )
@@ -46,7 +46,9 @@ namespace std
 
 
 #include <fc/reflect/reflect.hpp>
+#include <bts/db/ordered_key.hpp>
 FC_REFLECT( bts::pts_address, (addr) )
+BTS_DB_ORDERED_KEY( bts::pts_address, (addr) )
 
 namespace fc 
 { 
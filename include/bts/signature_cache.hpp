@@ -0,0 +1,58 @@
+#pragma once
+#include <bts/config.hpp>
+#include <bts/address.hpp>
+#include <bts/pts_address.hpp>
+#include <bts/db/lru_cache.hpp>
+#include <fc/crypto/elliptic.hpp>
+#include <fc/crypto/sha256.hpp>
+
+#include <memory>
+#include <mutex>
+
+namespace bts {
+
+  /**
+   *  Everything derived from the public key recovered from a compact signature.
+   */
+  struct recovered_key
+  {
+     recovered_key( const fc::ecc::public_key& k );
+
+     fc::ecc::public_key  key;
+     address              addr;
+     /** uncompressed and compressed forms with the protoshares (56) and bitcoin (0) versions */
+     pts_address          pts_addrs[4];
+  };
+  typedef std::shared_ptr<const recovered_key> recovered_key_ptr;
+
+  /**
+   *  @brief bounded cache of public key recovery results shared by the whole process
+   *
+   *  The same signature is usually checked several times: when a transaction or
+   *  message arrives, when it is evaluated for a block and again when the block
+   *  is pushed.  Results are keyed by the signed digest and the signature so a
+   *  hit never does any elliptic curve math.  Safe to use from any thread, the
+   *  recovery itself runs outside the lock.
+   */
+  class signature_cache
+  {
+     public:
+        signature_cache( uint64_t max_entries = BTS_SIGNATURE_CACHE_ENTRIES );
+
+        static signature_cache& instance();
+
+        /** @throw if @param sig is not a valid signature of @param digest */
+        recovered_key_ptr recover( const fc::sha256& digest, const fc::ecc::compact_signature& sig );
+
+        void            set_max_entries( uint64_t max_entries );
+        db::cache_stats get_stats()const;
+
+     private:
+        mutable std::mutex                   _mutex;
+        db::lru_cache<recovered_key_ptr>     _cache;
+  };
+
+  /** shorthand for signature_cache::instance().recover( digest, sig )->key */
+  fc::ecc::public_key recover_public_key( const fc::ecc::compact_signature& sig, const fc::sha256& digest );
+
+} // bts
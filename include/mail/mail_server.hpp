@@ -2,6 +2,7 @@
 #include <mail/message.hpp>
 #include <mail/stcp_socket.hpp>
 #include <bts/db/fwd.hpp>
+#include <bts/db/database_options.hpp>
 #include <bts/config.hpp>
 
 #include <set>
@@ -49,6 +50,7 @@ namespace mail {
             uint16_t                 port;  ///< the port to listen for incoming connections on.
             std::vector<std::string> blacklist;  // host's that are blocked from connecting
             std::vector<fc::ip::endpoint> mirrors;  // host's that are blocked from connecting
+            bts::db::database_options     message_db_options;
         };
         
         server();
@@ -81,4 +83,4 @@ namespace mail {
 
 }  // mail
 
-FC_REFLECT( mail::server::config, (port)(mirrors) )
+FC_REFLECT( mail::server::config, (port)(mirrors)(message_db_options) )
@@ -47,8 +47,24 @@ namespace bts { namespace addressbook {
      {
         fc::create_directories( abook_dir );
      }
-     my->_key = key;
      my->_encrypted_contact_db.open( abook_dir / "contact_db" );
+     load_contacts( key );
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("directory", abook_dir) ) }
+
+  void addressbook::open( const db::database_ptr& db, const fc::uint512& key, const fc::path& legacy_dir )
+  { try {
+     my->_encrypted_contact_db.open( db, "addressbook.contact_db" );
+     my->_encrypted_contact_db.import_standalone( legacy_dir / "contact_db" );
+     if( fc::exists( legacy_dir ) )
+     {
+        fc::remove_all( legacy_dir );
+     }
+     load_contacts( key );
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("legacy_directory", legacy_dir) ) }
+
+  void addressbook::load_contacts( const fc::uint512& key )
+  {
+     my->_key = key;
      auto itr = my->_encrypted_contact_db.begin();
      while( itr.valid() )
      {
@@ -67,8 +83,7 @@ namespace bts { namespace addressbook {
         }
         ++itr;
      }
-
-  } FC_RETHROW_EXCEPTIONS( warn, "", ("directory", abook_dir) ) }
+  }
 
   fc::optional<wallet_contact> addressbook::get_contact_by_dac_id( const std::string& dac_id )const
   { try {
@@ -363,7 +363,7 @@ namespace bts { namespace bitchat {
   {
       auto dir = conf.data_dir / ("cache_chan_" + fc::variant(my->chan_id.id()).as_string());
       fc::create_directories( dir );
-      my->_message_cache.open( dir );
+      my->_message_cache.open( dir, conf.message_cache_options );
   }
 
 
@@ -13,6 +13,7 @@ struct age_index0
   fc::uint128        message_id;
 };
 FC_REFLECT( age_index0, (timestamp)(message_id) );
+BTS_DB_ORDERED_KEY( age_index0, (timestamp)(message_id) )
 
 struct age_index
 {
@@ -28,6 +29,7 @@ struct age_index
   fc::uint128    message_id;
 };
 FC_REFLECT( age_index, (timestamp)(message_id) );
+BTS_DB_ORDERED_KEY( age_index, (timestamp)(message_id) )
 
 bool operator < ( const age_index& a, const age_index& b )
 {
@@ -63,14 +65,21 @@ namespace bts { namespace bitchat {
           void purge_old()
           { try {
              fc::time_point expired = fc::time_point::now() - fc::seconds( BITCHAT_CACHE_WINDOW_SEC );
+             age_index         key;
+             encrypted_message msg;
              auto itr = _age_index.begin();
              while( itr.valid() )
              {
-                auto key = itr.key();
-                if( key.timestamp < expired )
+                itr.key( key );
+                // the index is ordered by timestamp so everything after this is newer
+                if( !(key.timestamp < expired) )
+                {
+                  break;
+                }
+                _age_index.remove(key);
+                if( _cache_by_id.visit( key.message_id,
+                      [&]( const db::level_map<fc::uint128,encrypted_message>::value_view& v ){ v.unpack( msg ); } ) )
                 {
-                  _age_index.remove(key);
-                  auto msg = _cache_by_id.fetch(key.message_id);
                   _stats->cache_size -= msg.data.size();
                   _cache_by_id.remove(key.message_id);
                 }
@@ -103,10 +112,11 @@ namespace bts { namespace bitchat {
 
   message_cache::~message_cache(){}
 
-  void    message_cache::open( const fc::path& db_dir )
+  void    message_cache::open( const fc::path& db_dir, const db::database_options& opts )
   { try {
        fc::create_directories( db_dir / "message_cache" );
-       my->_cache_by_id.open( db_dir / "message_cache" / "by_id"  );
+       my->_cache_by_id.open( db_dir / "message_cache" / "by_id", true, opts );
+       my->_cache_by_id.set_cache_limits( BITCHAT_MESSAGE_CACHE_ENTRIES, BITCHAT_MESSAGE_CACHE_BYTES );
        fc::path age_index_path(db_dir / "message_cache" / "age_index1");
        if (fc::exists(age_index_path))
        {
@@ -130,7 +140,7 @@ namespace bts { namespace bitchat {
 
 
        my->purge_old();
-  } FC_RETHROW_EXCEPTIONS( warn, "", ("db_dir",db_dir) ) }
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("db_dir",db_dir)("options",opts) ) }
 
   void    message_cache::cache( const encrypted_message& msg )
   { try {
@@ -2,6 +2,7 @@
 #include <fc/reflect/variant.hpp>
 #include <fc/exception/exception.hpp>
 #include <bts/db/level_pod_map.hpp>
+#include <bts/db/database.hpp>
 
 
 
@@ -39,6 +40,16 @@ namespace bts { namespace bitchat {
           db::level_pod_map<message_header,uint32_t>    _index;
           db::level_pod_map<fc::uint256,std::vector<char> > _digest_to_data;
           db::level_pod_map<fc::uint256, message_header>    _digest_to_header;
+
+          /** the index key is the whole header, so drop the entry for the header stored with digest */
+          void remove_index( const fc::uint256& digest )
+          {
+             auto stored_header = _digest_to_header.fetch_optional( digest );
+             if( stored_header )
+             {
+                _index.remove( *stored_header );
+             }
+          }
      };
 
   } // namespace detail
@@ -55,19 +66,37 @@ namespace bts { namespace bitchat {
         fc::create_directories(dbdir);
         my->_index.open(dbdir/"index");
         my->_digest_to_data.open(dbdir/"digest_to_data");
-        if(!fc::is_directory(dbdir/"digest_to_header"))
-          update_digest_to_header(dbdir);
-        else
-          my->_digest_to_header.open(dbdir/"digest_to_header");
+        bool rebuild = !fc::is_directory(dbdir/"digest_to_header");
+        my->_digest_to_header.open(dbdir/"digest_to_header");
+        if( rebuild )
+          update_digest_to_header();
   } FC_RETHROW_EXCEPTIONS( warn, "", ("dir", dbdir)("key",key)("create",create)) }
 
-  void message_db::update_digest_to_header(const fc::path& dbdir)
+  void message_db::open( const db::database_ptr& db, const std::string& name,
+                         const fc::uint512& key, const fc::path& legacy_dir )
+  { try {
+        my->_index.open( db, name + ".index" );
+        my->_digest_to_data.open( db, name + ".digest_to_data" );
+        my->_digest_to_header.open( db, name + ".digest_to_header" );
+
+        my->_index.import_standalone( legacy_dir/"index" );
+        my->_digest_to_data.import_standalone( legacy_dir/"digest_to_data" );
+        my->_digest_to_header.import_standalone( legacy_dir/"digest_to_header" );
+        if( fc::exists( legacy_dir ) )
+          fc::remove_all( legacy_dir );
+
+        // databases that predate digest_to_header only have the index
+        if( !my->_digest_to_header.begin().valid() )
+          update_digest_to_header();
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("name", name)("legacy_dir",legacy_dir) ) }
+
+  void message_db::update_digest_to_header()
   {
-    my->_digest_to_header.open(dbdir/"digest_to_header");
+    message_header cur_val;
     auto itr = my->_index.begin();
     while( itr.valid() )
     {
-      auto cur_val = itr.key();
+      itr.key( cur_val );
       my->_digest_to_header.store(cur_val.digest, cur_val);
       ++itr;
     }
@@ -77,7 +106,10 @@ namespace bts { namespace bitchat {
                                            const message_header* previous_msg_header )
   { try {
       if (previous_msg_header)
+      {
+        my->remove_index(previous_msg_header->digest);
         my->_index.remove(*previous_msg_header);
+      }
   
       FC_ASSERT( msg.from_sig    );
       FC_ASSERT( msg.from_key    );
@@ -102,6 +134,7 @@ namespace bts { namespace bitchat {
   //remove entire message (msg_header and message contents)
   void message_db::remove_message(const message_header& msg_header)
   {
+      my->remove_index(msg_header.digest);
       my->_index.remove(msg_header);    
       my->_digest_to_data.remove(msg_header.digest);
       my->_digest_to_header.remove(msg_header.digest);
@@ -111,12 +144,14 @@ namespace bts { namespace bitchat {
   //used for equivalence, you need to first remove the unmodified form of the msg_header.
   void message_db::store_message_header(const message_header& msg_header)
   {
+      my->remove_index(msg_header.digest);
       my->_index.store(msg_header,0);
       my->_digest_to_header.store(msg_header.digest, msg_header);
   } 
 
   void message_db::remove_message_header(const message_header& msg_header)
   {
+      my->remove_index(msg_header.digest);
       my->_index.remove(msg_header);
       my->_digest_to_header.remove(msg_header.digest);
   } 
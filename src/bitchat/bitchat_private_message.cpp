@@ -1,5 +1,6 @@
 #include <bts/bitchat/bitchat_private_message.hpp>
 #include <bts/momentum.hpp>
+#include <bts/signature_cache.hpp>
 #include <fc/crypto/aes.hpp>
 #include <fc/crypto/sha256.hpp>
 #include <fc/crypto/sha512.hpp>
@@ -59,7 +60,7 @@ bool  encrypted_message0::decrypt( const fc::ecc::private_key& with, decrypted_m
     if( m.from_sig )
     {
         try {
-           m.from_key  = fc::ecc::public_key( *m.from_sig, m.digest() );
+           m.from_key  = recover_public_key( *m.from_sig, m.digest() );
         } FC_RETHROW_EXCEPTIONS( warn, "error reconstructing public key ${msg}", ("msg",m) );
     } 
     m.decrypt_key = with; 
@@ -165,7 +166,7 @@ bool  encrypted_message::decrypt( const fc::ecc::private_key& with, decrypted_me
     if( m.from_sig )
     {
         try {
-           m.from_key  = fc::ecc::public_key( *m.from_sig, m.digest() );
+           m.from_key  = recover_public_key( *m.from_sig, m.digest() );
         } FC_RETHROW_EXCEPTIONS( warn, "error reconstructing public key ${msg}", ("msg",m) );
     } 
     m.decrypt_key = with; 
@@ -822,8 +822,8 @@ namespace bts { namespace bitname {
   {
       fc::create_directories( c.name_db_dir / "forks" );
 
-      my->_name_db.open( c.name_db_dir, true/*create*/ );
-      my->_fork_db.open( c.name_db_dir / "forks" , true/*create*/ );
+      my->_name_db.open( c.name_db_dir, true/*create*/, c.db_options );
+      my->_fork_db.open( c.name_db_dir / "forks" , true/*create*/, c.db_options );
 
       my->_fetch_loop = fc::async( [=](){ my->fetch_loop(); } );
       // TODO: connect to the network and attempt to download the chain...
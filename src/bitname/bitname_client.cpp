@@ -193,6 +193,7 @@ namespace bts { namespace bitname {
      fc::create_directories( my->_config.data_dir / "bitname" );
      bitname::name_channel::config chan_config;
      chan_config.name_db_dir =  my->_config.data_dir / "bitname" / "channel";
+     chan_config.db_options  =  my->_config.database;
      my->_chan->configure( chan_config );
   } FC_RETHROW_EXCEPTIONS( warn, "error configuring bitname client", ("config",client_config) ) }
 
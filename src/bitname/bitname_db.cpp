@@ -113,10 +113,12 @@ namespace bts { namespace bitname {
                  if( rebuild_header_ids )
                  {
                     ilog( "load indexes" );
+                    name_header header;
                     auto itr = _block_num_to_header.begin();
                     while( itr.valid() )
                     {
-                      push_header_id( itr.value().id() );
+                      itr.value( header );
+                      push_header_id( header.id() );
                       ++itr;
                     }
                     // TODO: save to disk
@@ -201,7 +203,14 @@ namespace bts { namespace bitname {
       }
     }
 
-    void name_db::open( const fc::path& db_dir, bool create )
+    db::database_options name_db::default_database_options()
+    {
+       db::database_options opts;
+       opts.cache_size = BITNAME_DB_CACHE_BYTES;
+       return opts;
+    }
+
+    void name_db::open( const fc::path& db_dir, bool create, const db::database_options& opts )
     { try {
        if( !fc::exists( db_dir ) )
        {
@@ -212,16 +221,29 @@ namespace bts { namespace bitname {
          fc::create_directories( db_dir );
        }
 
-       my->_block_num_to_header.open( db_dir / "block_num_to_header" );
-       my->_block_num_to_name_trxs.open( db_dir / "block_num_to_name_trxs" );
-       my->_name_hash_to_locs.open( db_dir / "name_hash_to_locs" );
+       auto names_db = std::make_shared<db::database>();
+       names_db->open( db_dir / "database", create, opts );
+
+       my->_block_num_to_header.open( names_db, "block_num_to_header" );
+       my->_block_num_to_name_trxs.open( names_db, "block_num_to_name_trxs" );
+       my->_name_hash_to_locs.open( names_db, "name_hash_to_locs" );
+
+       my->_block_num_to_header.import_standalone( db_dir / "block_num_to_header" );
+       my->_block_num_to_name_trxs.import_standalone( db_dir / "block_num_to_name_trxs" );
+       my->_name_hash_to_locs.import_standalone( db_dir / "name_hash_to_locs" );
 
        my->load_indexes(db_dir);
        my->load_genesis();
        my->init_timekeeper();
        ilog( "open name db" );
        dump(); // DEBUG
-    } FC_RETHROW_EXCEPTIONS( warn, "unable to open name db at path ${path}", ("path", db_dir)("create",create) ) }
+    } FC_RETHROW_EXCEPTIONS( warn, "unable to open name db at path ${path}", ("path", db_dir)("create",create)("options",opts) ) }
+
+    db::database_options name_db::get_database_options()const
+    {
+       FC_ASSERT( my->_block_num_to_header.get_database() );
+       return my->_block_num_to_header.get_database()->get_options();
+    }
 
     void name_db::close()
     { try {
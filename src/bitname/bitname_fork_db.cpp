@@ -34,6 +34,7 @@ bool operator == ( const fork_index& a, const fork_index& b )
 }
 
 FC_REFLECT( fork_index, (fork_difficulty)(fork_header) );
+BTS_DB_ORDERED_KEY( fork_index, (fork_difficulty)(fork_header) )
 
 namespace fc {
 //  template<> struct get_typename<bts::bitname::meta_header>   { static const char* name()   { return "bts::bitname::meta_header";   } };
@@ -178,17 +179,26 @@ namespace bts { namespace bitname {
   fork_db::~fork_db()
   {}
 
-  void fork_db::open( const fc::path& db_dir, bool create )
+  void fork_db::open( const fc::path& db_dir, bool create, const db::database_options& opts )
   { try {
      if( create ) 
      {
         fc::create_directories( db_dir );
      }
-     my->_headers.open( db_dir / "headers", create );
-     my->_blocks.open( db_dir / "blocks", create );
-     my->_forks.open( db_dir / "forks", create );
-     my->_nexts.open( db_dir / "nexts", create );
-     my->_unknown.open( db_dir / "unknown", create );
+     auto forks_db = std::make_shared<db::database>();
+     forks_db->open( db_dir / "database", create, opts );
+
+     my->_headers.open( forks_db, "headers" );
+     my->_blocks.open( forks_db, "blocks" );
+     my->_forks.open( forks_db, "forks" );
+     my->_nexts.open( forks_db, "nexts" );
+     my->_unknown.open( forks_db, "unknown" );
+
+     my->_headers.import_standalone( db_dir / "headers" );
+     my->_blocks.import_standalone( db_dir / "blocks" );
+     my->_forks.import_standalone( db_dir / "forks" );
+     my->_nexts.import_standalone( db_dir / "nexts" );
+     my->_unknown.import_standalone( db_dir / "unknown" );
 
      cache_block( create_genesis_block() );
 
@@ -0,0 +1,244 @@
+#include <bts/blockchain/block_archive.hpp>
+#include <bts/db/level_map.hpp>
+#include <bts/db/write_batch.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/io/varint.hpp>
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace bts { namespace blockchain {
+
+  namespace detail
+  {
+     class block_archive_impl
+     {
+        public:
+          block_archive_impl():_segment_bytes(BLOCKCHAIN_ARCHIVE_SEGMENT_BYTES),_first_segment(0),_segment(0),_end(0),_out(nullptr){}
+
+          fc::path                                   _dir;
+          uint64_t                                   _segment_bytes;
+          db::level_map<uint32_t,block_location>     _index;
+          /** segments before this one have been deleted */
+          uint32_t                                   _first_segment;
+          /** the head block when each segment not yet deleted was found without indexed blocks */
+          std::map<uint32_t,uint32_t>                _unused_since;
+
+          /** the segment being appended to and where the next block goes in it */
+          uint32_t                                   _segment;
+          uint32_t                                   _end;
+          FILE*                                      _out;
+
+          fc::path segment_path( uint32_t segment )const
+          {
+             std::ostringstream name;
+             name << "blocks-" << std::setw(6) << std::setfill('0') << segment << ".dat";
+             return _dir / name.str();
+          }
+
+          /** @param truncate - the segment only holds bytes no block is indexed in */
+          void open_segment( uint32_t segment, bool truncate )
+          {
+             close_segment();
+             auto file = segment_path( segment ).generic_string();
+             _out = truncate ? nullptr : fopen( file.c_str(), "r+b" );
+             if( !_out ) _out = fopen( file.c_str(), "w+b" );
+             FC_ASSERT( _out, "unable to open ${file}", ("file",file) );
+             _segment = segment;
+          }
+
+          void close_segment()
+          {
+             if( _out ) fclose( _out );
+             _out = nullptr;
+          }
+
+          /** the index must never point at bytes that could still be lost */
+          void write( const std::vector<char>& data )
+          {
+             FC_ASSERT( fseek( _out, _end, SEEK_SET ) == 0 );
+             FC_ASSERT( fwrite( data.data(), 1, data.size(), _out ) == data.size(), "error writing the block archive" );
+             FC_ASSERT( fflush( _out ) == 0 );
+#ifdef WIN32
+             _commit( _fileno( _out ) );
+#else
+             fsync( fileno( _out ) );
+#endif
+          }
+
+          bool read( const block_location& loc, uint32_t offset, uint32_t size, std::vector<char>& data )
+          {
+             FC_ASSERT( offset + size <= loc.size );
+             std::ifstream in( segment_path( loc.segment ).generic_string().c_str(), std::ios::binary );
+             FC_ASSERT( in.good(), "unable to open segment ${s} of the block archive", ("s",loc.segment) );
+             in.seekg( loc.offset + offset );
+             data.resize( size );
+             in.read( data.data(), size );
+             FC_ASSERT( in.good(), "segment ${s} of the block archive is truncated", ("s",loc.segment) );
+             return true;
+          }
+     };
+
+  } // namespace detail
+
+  block_archive::block_archive()
+  :my( new detail::block_archive_impl() )
+  {
+  }
+
+  block_archive::~block_archive()
+  {
+     my->close_segment();
+  }
+
+  void block_archive::open( const fc::path& dir, const db::database_ptr& db, uint64_t segment_bytes )
+  { try {
+     fc::create_directories( dir );
+     my->_dir           = dir;
+     my->_segment_bytes = segment_bytes;
+     my->_index.open( db, "block_locations" );
+     my->_index.set_cache_limits( BLOCKCHAIN_BLOCK_CACHE_ENTRIES, 0 );
+
+     // anything after the last indexed block was never committed or was popped
+     uint32_t       last_num;
+     block_location last;
+     if( my->_index.last( last_num, last ) )
+     {
+        my->open_segment( last.segment, false );
+        my->_end = last.offset + last.size;
+     }
+     else
+     {
+        my->open_segment( 0, false );
+        my->_end = 0;
+     }
+  } FC_RETHROW_EXCEPTIONS( warn, "unable to open the block archive ${dir}", ("dir",dir) ) }
+
+  void block_archive::clear_cache()
+  {
+     my->_index.clear_cache();
+     my->_unused_since.clear();
+  }
+
+  void block_archive::close()
+  {
+     my->close_segment();
+     my->_index.close();
+  }
+
+  void block_archive::join( db::write_batch& batch )
+  {
+     my->_index.join( batch );
+  }
+
+  void block_archive::store( const trx_block& b )
+  { try {
+     FC_ASSERT( my->_out, "the block archive is not open" );
+
+     // the same bytes as fc::raw::pack( b ), the header followed by the trx vector
+     block_location loc;
+     std::vector<char> data = fc::raw::pack( static_cast<const block_header&>(b) );
+     auto count = fc::raw::pack( fc::unsigned_int( b.trxs.size() ) );
+     data.insert( data.end(), count.begin(), count.end() );
+     loc.trx_offsets.reserve( b.trxs.size() );
+     for( auto itr = b.trxs.begin(); itr != b.trxs.end(); ++itr )
+     {
+        loc.trx_offsets.push_back( data.size() );
+        auto trx = fc::raw::pack( *itr );
+        data.insert( data.end(), trx.begin(), trx.end() );
+     }
+
+     if( my->_end > 0 && uint64_t(my->_end) + data.size() > my->_segment_bytes )
+     {
+        my->open_segment( my->_segment + 1, true );
+        my->_end = 0;
+     }
+     my->write( data );
+
+     loc.segment = my->_segment;
+     loc.offset  = my->_end;
+     loc.size    = data.size();
+     my->_end   += data.size();
+     my->_index.store( b.block_num, loc );
+  } FC_RETHROW_EXCEPTIONS( warn, "unable to archive block ${n}", ("n",b.block_num) ) }
+
+  void block_archive::remove( uint32_t block_num )
+  {
+     my->_index.remove( block_num );
+  }
+
+  void block_archive::remove_unused_segments( uint32_t head_block_num )
+  { try {
+     auto first = my->_index.begin();
+     if( !first.valid() ) return;
+
+     uint32_t used = std::min( first.value().segment, my->_segment );
+     for( uint32_t segment = my->_first_segment; segment < used; ++segment )
+     {
+        my->_unused_since.insert( std::make_pair( segment, head_block_num ) );
+     }
+
+     // the blocks that may still be popped could restore entries of the later segments
+     for( ; my->_first_segment < used; ++my->_first_segment )
+     {
+        auto since = my->_unused_since.find( my->_first_segment );
+        if( head_block_num < since->second + BLOCKCHAIN_UNDO_BLOCKS ) break;
+        my->_unused_since.erase( since );
+
+        auto file = my->segment_path( my->_first_segment );
+        if( fc::exists( file ) )
+        {
+           ilog( "removing ${file}, all of its blocks were pruned", ("file",file) );
+           fc::remove_all( file );
+        }
+     }
+  } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+  fc::optional<block_location> block_archive::fetch_location( uint32_t block_num, const db::snapshot_ptr& snap )
+  {
+     return my->_index.fetch_optional( block_num, snap );
+  }
+
+  bool block_archive::fetch_packed( uint32_t block_num, std::vector<char>& packed, const db::snapshot_ptr& snap )
+  { try {
+     auto loc = fetch_location( block_num, snap );
+     if( !loc ) return false;
+     return my->read( *loc, 0, loc->size, packed );
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("block_num",block_num) ) }
+
+  bool block_archive::fetch( uint32_t block_num, trx_block& b, const db::snapshot_ptr& snap )
+  { try {
+     std::vector<char> packed;
+     if( !fetch_packed( block_num, packed, snap ) ) return false;
+     b = fc::raw::unpack<trx_block>( packed );
+     return true;
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("block_num",block_num) ) }
+
+  bool block_archive::fetch_trx( uint32_t block_num, uint16_t trx_idx, signed_transaction& trx, const db::snapshot_ptr& snap )
+  { try {
+     auto loc = fetch_location( block_num, snap );
+     if( !loc ) return false;
+     FC_ASSERT( trx_idx < loc->trx_offsets.size() );
+
+     uint32_t begin = loc->trx_offsets[trx_idx];
+     uint32_t end   = trx_idx + 1u < loc->trx_offsets.size() ? loc->trx_offsets[trx_idx+1] : loc->size;
+     std::vector<char> packed;
+     my->read( *loc, begin, end - begin, packed );
+     trx = fc::raw::unpack<signed_transaction>( packed );
+     return true;
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("block_num",block_num)("trx_idx",trx_idx) ) }
+
+} } // bts::blockchain
@@ -0,0 +1,295 @@
+#include <bts/blockchain/block_pipeline.hpp>
+#include <bts/blockchain/signature_recovery.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+#include <deque>
+
+namespace bts { namespace blockchain {
+
+  void pipeline_stage_stats::record( const fc::microseconds& elapsed )
+  {
+     uint64_t us = std::max<int64_t>( 0, elapsed.count() );
+     ++blocks;
+     total_us += us;
+     max_us    = std::max( max_us, us );
+  }
+
+  namespace detail
+  {
+     /**
+      *  A block moving through the pipeline, each stage only writes its own
+      *  fields and the apply stage reads them after ready completes.
+      */
+     struct staged_block
+     {
+        staged_block():snapshot_head(0),keys_recovered(false){}
+
+        std::vector<char>            packed;
+        trx_block                    block;
+
+        chain_snapshot_ptr           snapshot;
+        uint32_t                     snapshot_head;
+        prefetched_inputs            inputs;
+        assume_valid_chain_ptr       assume_valid;
+        bool                         keys_recovered;
+        std::vector<signature_keys>  keys;
+
+        fc::microseconds             decode_time;
+        fc::microseconds             prefetch_time;
+        fc::microseconds             verify_time;
+        fc::future<void>             ready;
+     };
+     typedef std::shared_ptr<staged_block> staged_block_ptr;
+
+     /** the outputs spent by a block the pipeline applied */
+     struct applied_block
+     {
+        uint32_t                       block_num;
+        std::vector<output_reference>  spent;
+     };
+
+     class block_pipeline_impl
+     {
+        public:
+          block_pipeline_impl():_chain(nullptr),_depth(BLOCKCHAIN_PIPELINE_DEPTH){}
+
+          blockchain_db*                            _chain;
+          uint32_t                                  _depth;
+          std::function<void(const trx_block&)>     _applied_handler;
+
+          std::deque<staged_block_ptr>              _in_flight;
+          /** consecutive blocks ending at the last one applied, at most _depth */
+          std::deque<applied_block>                 _applied;
+          block_pipeline_stats                      _stats;
+
+          std::unique_ptr<fc::thread>               _decode_thread;
+          std::unique_ptr<fc::thread>               _prefetch_thread;
+          std::unique_ptr<fc::thread>               _verify_thread;
+          /** only used from _verify_thread */
+          signature_recovery_pool                   _signature_pool;
+
+          void start( const staged_block_ptr& s )
+          {
+             if( !_decode_thread )
+             {
+                _decode_thread.reset( new fc::thread( "block_decode" ) );
+                _prefetch_thread.reset( new fc::thread( "block_prefetch" ) );
+                _verify_thread.reset( new fc::thread( "block_verify" ) );
+             }
+             // taken here, the chain must only be read on the thread that applies blocks
+             s->snapshot      = _chain->get_snapshot();
+             s->snapshot_head = s->snapshot->head_block_num();
+             s->assume_valid  = _chain->get_assume_valid_chain();
+             s->ready         = _decode_thread->async( [=](){ prepare( s ); } );
+             _in_flight.push_back( s );
+          }
+
+          /**
+           *  Runs on _decode_thread.  Waiting on the later stages yields, so the
+           *  decode thread moves on to the next block while this one is prefetched
+           *  and verified.
+           */
+          void prepare( const staged_block_ptr& s )
+          {
+             auto decode_start = fc::time_point::now();
+             if( s->packed.size() )
+             {
+                s->block = fc::raw::unpack<trx_block>( s->packed );
+                s->packed = std::vector<char>();
+             }
+             FC_ASSERT( s->block.trx_mroot == s->block.calculate_merkle_root() );
+             s->decode_time = fc::time_point::now() - decode_start;
+
+             _prefetch_thread->async( [=](){
+                auto start = fc::time_point::now();
+                s->inputs = s->snapshot->prefetch_inputs( s->block.trxs );
+                s->snapshot.reset();
+                s->prefetch_time = fc::time_point::now() - start;
+             } ).wait();
+
+             // push_block does not check the signatures of blocks the checkpoint covers
+             if( s->assume_valid && s->assume_valid->covers( s->block.block_num, s->block.id() ) )
+             {
+                return;
+             }
+             _verify_thread->async( [=](){
+                auto start = fc::time_point::now();
+                s->keys = _signature_pool.recover( s->block.trxs );
+                s->keys_recovered = true;
+                s->verify_time = fc::time_point::now() - start;
+             } ).wait();
+          }
+
+          /**
+           *  The snapshot s was prefetched from may be older than the head, remove
+           *  the outputs spent by the blocks applied since.  If some of those were
+           *  pushed around the pipeline the prefetched inputs can not be trusted.
+           */
+          void drop_spent_since( staged_block& s )
+          {
+             uint32_t head          = _chain->head_block_num();
+             uint32_t applied_since = head - s.snapshot_head; // wraps from INVALID_BLOCK_NUM before genesis
+             if( applied_since == 0 ) return;
+
+             if( _applied.empty() || _applied.back().block_num != head || applied_since > _applied.size() )
+             {
+                s.inputs.clear();
+                return;
+             }
+             for( auto itr = _applied.end() - applied_since; itr != _applied.end(); ++itr )
+             {
+                for( auto out = itr->spent.begin(); out != itr->spent.end(); ++out )
+                {
+                   s.inputs.erase( *out );
+                }
+             }
+          }
+
+          void remember_spent( const trx_block& b )
+          {
+             if( !_applied.empty() && _applied.back().block_num + 1 != b.block_num )
+             {
+                _applied.clear();
+             }
+             applied_block a;
+             a.block_num = b.block_num;
+             for( auto trx = b.trxs.begin(); trx != b.trxs.end(); ++trx )
+             {
+                for( auto in = trx->inputs.begin(); in != trx->inputs.end(); ++in )
+                {
+                   a.spent.push_back( in->output_ref );
+                }
+             }
+             _applied.push_back( std::move(a) );
+             while( _applied.size() > _depth )
+             {
+                _applied.pop_front();
+             }
+          }
+
+          void apply_next()
+          {
+             staged_block_ptr s = _in_flight.front();
+             _in_flight.pop_front();
+             try {
+                auto start = fc::time_point::now();
+                s->ready.wait();
+                _stats.stalled_us += std::max<int64_t>( 0, (fc::time_point::now() - start).count() );
+                _stats.decode.record( s->decode_time );
+                _stats.prefetch.record( s->prefetch_time );
+                _stats.verify.record( s->verify_time );
+
+                drop_spent_since( *s );
+
+                start = fc::time_point::now();
+                _chain->push_block( s->block, s->keys_recovered ? &s->keys : nullptr, &s->inputs );
+                _stats.apply.record( fc::time_point::now() - start );
+             }
+             catch ( const fc::exception& e )
+             {
+                // every block after this one builds on it
+                wlog( "discarding ${n} blocks after a failed block\n${e}", ("n",_in_flight.size())("e",e.to_detail_string()) );
+                clear();
+                throw;
+             }
+             remember_spent( s->block );
+
+             if( _applied_handler )
+             {
+                try {
+                   _applied_handler( s->block );
+                }
+                catch ( const fc::exception& e )
+                {
+                   wlog( "error handling applied block ${n}\n${e}", ("n",s->block.block_num)("e",e.to_detail_string()) );
+                }
+             }
+          }
+
+          /** the workers reference the blocks in flight and this pipeline, wait for them */
+          void clear()
+          {
+             for( auto itr = _in_flight.begin(); itr != _in_flight.end(); ++itr )
+             {
+                try {
+                   (*itr)->ready.wait();
+                }
+                catch ( const fc::exception& )
+                {
+                   // the block is discarded, its error no longer matters
+                }
+             }
+             _in_flight.clear();
+          }
+     };
+
+  } // namespace detail
+
+  block_pipeline::block_pipeline( blockchain_db* chain, uint32_t depth )
+  :my( new detail::block_pipeline_impl() )
+  {
+     FC_ASSERT( chain != nullptr );
+     my->_chain = chain;
+     my->_depth = std::max( 1u, depth );
+  }
+
+  block_pipeline::~block_pipeline()
+  {
+     my->clear();
+  }
+
+  void block_pipeline::set_applied_handler( const std::function<void(const trx_block&)>& handler )
+  {
+     my->_applied_handler = handler;
+  }
+
+  void block_pipeline::push( const trx_block& b )
+  { try {
+     while( my->_in_flight.size() >= my->_depth )
+     {
+        my->apply_next();
+     }
+     auto s   = std::make_shared<detail::staged_block>();
+     s->block = b;
+     my->start( s );
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("block_num",b.block_num) ) }
+
+  void block_pipeline::push( std::vector<char> packed_block )
+  { try {
+     while( my->_in_flight.size() >= my->_depth )
+     {
+        my->apply_next();
+     }
+     auto s    = std::make_shared<detail::staged_block>();
+     s->packed = std::move(packed_block);
+     my->start( s );
+  } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+  void block_pipeline::flush()
+  { try {
+     while( my->_in_flight.size() )
+     {
+        my->apply_next();
+     }
+  } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+  void block_pipeline::clear()
+  {
+     my->clear();
+  }
+
+  size_t block_pipeline::size()const
+  {
+     return my->_in_flight.size();
+  }
+
+  block_pipeline_stats block_pipeline::get_stats()const
+  {
+     return my->_stats;
+  }
+
+} } // bts::blockchain
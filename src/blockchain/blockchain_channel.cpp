@@ -1,10 +1,13 @@
 #include <bts/blockchain/blockchain_channel.hpp>
+#include <bts/blockchain/block_pipeline.hpp>
 #include <bts/blockchain/blockchain_db.hpp>
 #include <bts/blockchain/blockchain_messages.hpp>
+#include <bts/blockchain/mempool.hpp>
 
 #include <fc/reflect/variant.hpp>
 #include <fc/log/logger.hpp>
 
+#include <algorithm>
 #include <map>
 
 namespace bts { namespace blockchain {
@@ -19,6 +22,8 @@ namespace bts { namespace blockchain {
      class chan_data : public network::channel_data
      {
         public:
+          chan_data():first_full_block(0){}
+
           std::unordered_set<uint160>        known_trx_inv;
           std::unordered_set<block_id_type>  known_block_inv;
 
@@ -32,6 +37,9 @@ namespace bts { namespace blockchain {
           // only one request at a time, null hash means nothing pending
           block_id_type                     requested_full_block; 
           block_id_type                     requested_trx_block; 
+
+          /** the peer pruned the blocks below this one, they must not be requested from it */
+          uint32_t                          first_full_block;
      };
 
 
@@ -53,7 +61,10 @@ namespace bts { namespace blockchain {
           std::map<fc::time_point, uint160>                _trx_time_index;
 
           /** validated transactions that are sent out with get inv msgs */
-          std::unordered_map<uint160,signed_transaction>   _pending_trx;
+          std::unique_ptr<mempool>                         _mempool;
+
+          /** decodes and verifies downloaded blocks on other threads before they are applied */
+          std::unique_ptr<block_pipeline>                  _pipeline;
 
           // full blocks that are awaiting verification, these should not be forwarded
           std::unordered_map<block_id_type,full_block>        _pending_full_blocks;
@@ -77,8 +88,6 @@ namespace bts { namespace blockchain {
           std::unordered_set<uint160>                      _trxs_pending_fetch;
           std::unordered_set<block_id_type>                _blocks_pending_fetch;
 
-          std::vector<signed_transaction>                  _verify_queue;
-
           chan_data& get_channel_data( const connection_ptr& c )
           {
               auto cd = c->get_channel_data( _chan_id );
@@ -91,15 +100,58 @@ namespace bts { namespace blockchain {
               return cdat;
           }
           
+          /**
+           *  Asks @param c for the block @param block_id, the block @param block_num of the chain,
+           *  with its trxs or only their ids if @param full.  Only one request of each kind is in
+           *  flight per connection and a peer is never asked for a block it has pruned.
+           *
+           *  @return false if the request was not sent
+           */
+          bool request_block( const connection_ptr& c, chan_data& cdat, const block_id_type& block_id,
+                              uint32_t block_num, bool full )
+          {
+              if( block_num < cdat.first_full_block ) return false;
+
+              block_id_type& requested = full ? cdat.requested_full_block : cdat.requested_trx_block;
+              if( requested != block_id_type() ) return false;
+              requested = block_id;
+
+              if( full ) c->send( network::message( get_full_block_message( block_id ), _chan_id ) );
+              else       c->send( network::message( get_trx_block_message( block_id ), _chan_id ) );
+              return true;
+          }
+
+          /**
+           *  Hands the downloaded block to the pipeline packed, so that it is decoded on
+           *  a worker like the rest of its validation.  The blocks stay in flight while
+           *  more are downloaded and are only flushed once none are left to fetch.
+           */
           void attempt_push_download_block()
           { try {
-              _db->push_block( trx_block( _block_download.full_blk, std::move( _block_download.trxs) ) );
+              // the same bytes as fc::raw::pack( trx_block ), the header followed by the trxs
+              auto block_id = _block_download.full_blk.id();
+              std::vector<char> packed = fc::raw::pack( static_cast<const block_header&>(_block_download.full_blk) );
+              auto trxs = fc::raw::pack( _block_download.trxs );
+              packed.insert( packed.end(), trxs.begin(), trxs.end() );
+              _block_download = block_download_state();
+
+              _blocks_pending_fetch.erase( block_id );
+              _pipeline->push( std::move( packed ) );
+              if( _blocks_pending_fetch.empty() )
+              {
+                 _pipeline->flush();
+              }
           } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
 
           virtual void handle_subscribe( const connection_ptr& c )
           {
               get_channel_data(c); // creates it... 
+
+              chain_status_message status;
+              status.head_block_num   = _db->head_block_num();
+              status.first_full_block = _db->first_full_block();
+              c->send( network::message( status, _chan_id ) );
           //    request_latest_blocks();
           }
 
@@ -156,6 +208,10 @@ namespace bts { namespace blockchain {
                       handle_trx_block( c, cdat, m.as<trx_block_message>() );
                       break;
 
+                  case chain_status_msg:
+                      handle_chain_status( c, cdat, m.as<chain_status_message>() );
+                      break;
+
                   default:
                      // TODO: figure out how to document this / punish the connection that sent us this 
                      // message.
@@ -193,13 +249,8 @@ namespace bts { namespace blockchain {
           { try {
              // TODO: only allow this request once every couple of minutes to prevent flood attacks
              
-             // TODO: make sure these inventory items are sorted by fees
              trx_inv_message reply;
-             reply.items.reserve( TRX_INV_QUERY_LIMIT ); 
-             for( auto itr = _pending_trx.begin(); reply.items.size() < TRX_INV_QUERY_LIMIT && itr != _pending_trx.end(); ++itr )
-             {
-                reply.items.push_back( itr->first );
-             }
+             reply.items = _mempool->get_ids( TRX_INV_QUERY_LIMIT );
              c->send( network::message( reply, _chan_id ) );
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) } // provide stack trace for errors
 
@@ -218,6 +269,13 @@ namespace bts { namespace blockchain {
                  }
                  _blocks_pending_fetch.insert( *itr );
               }
+
+              // the items are consecutive, the one after our head is the next block of the chain
+              auto head = std::find( msg.items.begin(), msg.items.end(), _db->head_block_id() );
+              if( head != msg.items.end() && head + 1 != msg.items.end() )
+              {
+                 request_block( c, cdat, *(head + 1), _db->head_block_num() + 1, false );
+              }
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) } // provide stack trace for errors
 
           /**
@@ -234,19 +292,21 @@ namespace bts { namespace blockchain {
               FC_ASSERT( msg.items.size() < TRX_INV_QUERY_LIMIT );
               reply.trxs.reserve( msg.items.size() );
               
+              chain_snapshot_ptr snap;
               for( auto itr = msg.items.begin(); itr != msg.items.end(); ++itr )
               {
-                  auto pending_itr = _pending_trx.find( *itr );
-                  if( pending_itr == _pending_trx.end() )
+                  auto pending = _mempool->get( *itr );
+                  if( !pending )
                   {
                      // TODO DB queries are far more expensive, and therefore must be rationed and potentialy
                      // require a proof of work paying us to fetch them
-                     auto tx_num = _db->fetch_trx_num( *itr );
-                     reply.trxs.push_back( _db->fetch_trx(tx_num) );
+                     if( !snap ) snap = _db->get_snapshot();
+                     auto tx_num = snap->fetch_trx_num( *itr );
+                     reply.trxs.push_back( snap->fetch_trx(tx_num) );
                   }
                   else
                   {
-                     reply.trxs.push_back( pending_itr->second );
+                     reply.trxs.push_back( pending->trx.trx() );
                   }
               }
               c->send( network::message( reply, _chan_id ) );
@@ -261,8 +321,10 @@ namespace bts { namespace blockchain {
               // this request must hit the DB... cost in proof of work is proportional to age to prevent
               // cache thrashing attacks and allowing us to keep newer blocks in the cache 
               // penalize connections that request too many full blocks...
-              uint32_t blk_num = _db->fetch_block_num( msg.block_id );
-              full_block blk   = _db->fetch_full_block( blk_num );
+              auto     snap    = _db->get_snapshot();
+              uint32_t blk_num = snap->fetch_block_num( msg.block_id );
+              FC_ASSERT( blk_num >= _db->first_full_block(), "block ${n} has been pruned", ("n",blk_num) );
+              full_block blk   = snap->fetch_full_block( blk_num );
               c->send( network::message(full_block_message( blk ), _chan_id ) );
 
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) } // provide stack trace for errors
@@ -273,9 +335,18 @@ namespace bts { namespace blockchain {
           void handle_get_trx_block( const connection_ptr& c, chan_data& cdat, get_trx_block_message msg )
           { try {
               // TODO: throttle attempts to query blocks by a single connection
-              uint32_t blk_num = _db->fetch_block_num( msg.block_id );
-              trx_block blk    = _db->fetch_trx_block( blk_num );
-              c->send( network::message(trx_block_message( blk ), _chan_id ) );
+              auto     snap    = _db->get_snapshot();
+              uint32_t blk_num = snap->fetch_block_num( msg.block_id );
+              FC_ASSERT( blk_num >= _db->first_full_block(), "block ${n} has been pruned", ("n",blk_num) );
+
+              // a trx_block_message packs to the archived bytes of the block, send them as they are
+              network::message reply;
+              reply.proto    = _chan_id.proto;
+              reply.chan_num = _chan_id.chan;
+              reply.msg_type = trx_block_message::type;
+              reply.data     = snap->fetch_packed_trx_block( blk_num );
+              reply.size     = reply.data.size();
+              c->send( reply );
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) } // provide stack trace for errors
 
           /**
@@ -285,19 +356,27 @@ namespace bts { namespace blockchain {
           { try {
               for( auto itr = msg.trxs.begin(); itr != msg.trxs.end(); ++itr )
               {
-                 auto item_id = itr->id();
+                 hashed_transaction trx( *itr );
+                 auto item_id = trx.id();
                  if( cdat.requested_trxs.find( item_id ) == cdat.requested_trxs.end() )
                  {
                     FC_THROW_EXCEPTION( exception, "unsolicited transaction ${trx_id}", 
-                                                    ("trx_id", item_id)("trx", *itr) );
+                                                    ("trx_id", item_id)("trx", trx.trx()) );
+                 }
+                 try {
+                    _mempool->add( trx );
+                 }
+                 catch ( const fc::exception& e )
+                 {
+                    wlog( "rejected trx ${trx_id}\n${e}", ("trx_id",item_id)("e",e.to_detail_string()) );
+                    _recently_invalid_trx.insert( item_id );
                  }
-                 _verify_queue.push_back( *itr ); 
 
                  // is this trx part of a block download
                  auto trx_idx_itr =  _block_download.missing_trx_idx.find( item_id );
                  if( trx_idx_itr != _block_download.missing_trx_idx.end() )
                  {
-                    _block_download.trxs[trx_idx_itr->second] = *itr;
+                    _block_download.trxs[trx_idx_itr->second] = trx.trx();
                     _block_download.missing_trx_idx.erase(trx_idx_itr);
                     if( _block_download.missing_trx_idx.size() == 0 )
                     {
@@ -319,6 +398,7 @@ namespace bts { namespace blockchain {
                   FC_THROW_EXCEPTION( exception, "unsolicited full block ${block_id}", 
                                       ("block_id", block_id)("block", msg.block_data) );
               }
+              cdat.requested_full_block = block_id_type();
               // attempt to create a trx_block by looking up missing transactions
 
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) } // provide stack trace for errors
@@ -334,8 +414,18 @@ namespace bts { namespace blockchain {
                   FC_THROW_EXCEPTION( exception, "unsolicited trx block ${block_id}", 
                                                 ("block_id", block_id)("block", msg.block_data) );
               }
+              cdat.requested_trx_block = block_id_type();
               // attempt to push it onto the block db... if successful broadcast a block inv
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) } // provide stack trace for errors
+
+          void handle_chain_status( const connection_ptr& c, chan_data& cdat, chain_status_message msg )
+          { try {
+              if( msg.first_full_block > 0 )
+              {
+                 ilog( "peer has pruned the blocks below ${n}", ("n",msg.first_full_block) );
+              }
+              cdat.first_full_block = msg.first_full_block;
+          } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) } // provide stack trace for errors
      };
 
   } // namespace detail 
@@ -351,12 +441,25 @@ namespace bts { namespace blockchain {
      my->_chan_id = c;
      my->_db      = db;
      my->_del     = d;
+     my->_mempool.reset( new mempool( db.get() ) );
+     my->_pipeline.reset( new block_pipeline( db.get() ) );
+
+     auto pool = my->_mempool.get();
+     my->_pipeline->set_applied_handler( [=]( const trx_block& b ){ pool->handle_block( b ); } );
 
      my->_peers->subscribe_to_channel( my->_chan_id, my );
   }
 
   channel::~channel()
   {
+     // apply the blocks still in flight rather than downloading them again
+     try {
+        my->_pipeline->flush();
+     }
+     catch ( const fc::exception& e )
+     {
+        wlog( "unable to apply the downloaded blocks\n${e}", ("e",e.to_detail_string()) );
+     }
   }
   
   network::channel_id channel::get_id()const
@@ -368,9 +471,9 @@ namespace bts { namespace blockchain {
    *  All transactions that are known but that have not been included in 
    *  a block that has been added to the blockchain_db
    */
-  const std::unordered_map<uint160,signed_transaction>& channel::get_pending_pool()const
+  const mempool& channel::get_pending_pool()const
   {
-      return my->_pending_trx;
+      return *my->_mempool;
   }
 
        /**
@@ -32,7 +32,8 @@ namespace bts { namespace blockchain {
   void blockchain_client::configure( const config& aconfig )
   {
      my->_config = aconfig;
-     my->_chain_db->open( my->_config.data_dir / fc::variant(my->_config.chan_num).as_string() / "chaindb", true );
+     my->_chain_db->open( my->_config.data_dir / fc::variant(my->_config.chan_num).as_string() / "chaindb", true, my->_config.database );
+     my->_chain_db->set_unspent_cache_size( my->_config.unspent_cache_bytes );
      
      // TODO: init chain with gensis block if necessary
 
@@ -2,10 +2,14 @@
 #include <bts/blockchain/trx_validation_state.hpp>
 #include <bts/blockchain/blockchain_db.hpp>
 #include <bts/blockchain/blockchain_market_db.hpp>
+#include <bts/blockchain/block_archive.hpp>
+#include <bts/blockchain/signature_recovery.hpp>
 #include <bts/blockchain/asset.hpp>
 #include <leveldb/db.h>
 #include <bts/db/level_pod_map.hpp>
 #include <bts/db/level_map.hpp>
+#include <bts/db/write_batch.hpp>
+#include <bts/db/state_file.hpp>
 #include <fc/io/enum_type.hpp>
 #include <fc/reflect/variant.hpp>
 #include <fc/io/raw.hpp>
@@ -14,9 +18,12 @@
 #include <fc/filesystem.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/io/json.hpp>
+#include <fc/thread/thread.hpp>
 
 #include <algorithm>
+#include <functional>
 #include <sstream>
+#include <thread>
 
 namespace fc {
   template<> struct get_typename<std::vector<uint160>>    { static const char* name()  { return "std::vector<uint160>";  } };
@@ -24,15 +31,16 @@ namespace fc {
 
 struct trx_stat
 {
-   uint16_t trx_idx;
+   uint32_t trx_idx;
+   uint64_t fee_rate;
    bts::blockchain::trx_eval eval;
 };
-// sort with highest fees first
+// sort with highest fees per byte first
 bool operator < ( const trx_stat& a, const trx_stat& b )
 {
-  return a.eval.fees.amount > b.eval.fees.amount;
+  return a.fee_rate > b.fee_rate;
 }
-FC_REFLECT( trx_stat, (trx_idx)(eval) )
+FC_REFLECT( trx_stat, (trx_idx)(fee_rate)(eval) )
 
 namespace bts { namespace blockchain {
     namespace ldb = leveldb;
@@ -43,38 +51,403 @@ namespace bts { namespace blockchain {
       class blockchain_db_impl
       {
          public:
-            blockchain_db_impl(){}
+            blockchain_db_impl()
+            :address_index(BLOCKCHAIN_ADDRESS_INDEX),match_threads(BLOCKCHAIN_MATCH_THREADS),prune_depth(BLOCKCHAIN_PRUNE_DEPTH){}
 
             //std::unique_ptr<ldb::DB> blk_id2num;  // maps blocks to unique IDs
             bts::db::level_map<block_id_type,uint32_t>          blk_id2num;
             bts::db::level_map<uint160,trx_num>                 trx_id2num;
+            /** the transactions of blocks pushed before the block archive, new ones are only archived */
             bts::db::level_map<trx_num,meta_trx>                meta_trxs;
             bts::db::level_map<uint32_t,block_header>           blocks;
             bts::db::level_map<uint32_t,std::vector<uint160> >  block_trxs; 
+            /** every block pushed as a single record, with the location of each trx in it */
+            block_archive                                       archive;
+
+            /** outputs that may still be spent, removed when they are */
+            bts::db::level_map<output_reference,unspent_output> unspent;
+            /** where each spent output was spent, merged into meta_trx::meta_outputs on fetch */
+            bts::db::level_map<output_num,meta_trx_output>      spent_outputs;
+
+            /** the unspent outputs paying each owner, kept while address_index is set */
+            bool                                                          address_index;
+            bts::db::level_map<address_output_key,unspent_output>         address_outputs;
+            bts::db::level_map<pts_address_output_key,unspent_output>     pts_address_outputs;
+
+            /** the prior value of every key a block wrote, for the last BLOCKCHAIN_UNDO_BLOCKS blocks */
+            bts::db::level_map<uint32_t,std::vector<db::undo_entry> > block_undo;
 
             market_db                                           _market_db;
 
+            /** recovers the signing keys of blocks and batches before they are evaluated */
+            signature_recovery_pool                             _signature_pool;
+
+            /** match the orders of different asset pairs at the same time, started on first use */
+            std::vector<std::unique_ptr<fc::thread> >           _match_threads;
+            /** see set_match_threads() */
+            uint32_t                                            match_threads;
+
+            /** signatures are not checked for these blocks, see set_assume_valid() */
+            assume_valid_chain_ptr                              assume_valid;
+
+            /** history kept below the head, 0 keeps everything, see set_prune_depth() */
+            uint32_t                                            prune_depth;
+
             /** cache this information because it is required in many calculations  */
             trx_block                                           head_block;
             block_id_type                                       head_block_id;
 
+            /**
+             *  Routes every write to the chain state through batch so that a block is
+             *  either applied completely or not at all.  All maps share one database
+             *  so the batch is committed with a single atomic write.
+             */
+            void join( db::write_batch& batch )
+            {
+               _market_db.join( batch );
+               trx_id2num.join( batch );
+               meta_trxs.join( batch );
+               unspent.join( batch );
+               spent_outputs.join( batch );
+               address_outputs.join( batch );
+               pts_address_outputs.join( batch );
+               block_undo.join( batch );
+               block_trxs.join( batch );
+               blocks.join( batch );
+               blk_id2num.join( batch );
+               archive.join( batch );
+            }
+
+            /**
+             *  Resolves @param refs against the unspent index in key order with a single
+             *  iterator, so inputs that share a source trx are read once and neighbouring
+             *  keys come from the same blocks of the table.
+             */
+            prefetched_inputs prefetch_inputs( std::vector<output_reference> refs )
+            {
+               std::sort( refs.begin(), refs.end() );
+               refs.erase( std::unique( refs.begin(), refs.end() ), refs.end() );
+
+               prefetched_inputs result;
+               result.reserve( refs.size() );
+               unspent.visit_sorted( refs,
+                  [&]( size_t i, const db::level_map<output_reference,unspent_output>::value_view& v ){ v.unpack( result[refs[i]] ); } );
+               return result;
+            }
+
+            /**
+             *  Moves @param o from the unspent outputs to the spent outputs, the
+             *  transaction that created it is not read or written.
+             */
             void mark_spent( const output_reference& o, const trx_num& intrx, uint16_t in )
             {
-               auto tid    = trx_id2num.fetch( o.trx_hash );
-               meta_trx   mtrx   = meta_trxs.fetch( tid );
-               FC_ASSERT( mtrx.meta_outputs.size() > o.output_idx );
+               // outputs created earlier in the same block are only in the pending batch
+               unspent_output uo;
+               bool found = unspent.visit( o,
+                             [&]( const db::level_map<output_reference,unspent_output>::value_view& v ){ v.unpack( uo ); } );
+               FC_ASSERT( found, "output ${o} is not unspent", ("o",o) );
+
+               meta_trx_output spent;
+               spent.trx_id    = intrx;
+               spent.input_num = in;
+               spent_outputs.store( output_num( uo.source, o.output_idx ), spent );
+               unspent.remove( o );
+               index_owner( o, uo, false );
+
+               remove_market_orders( o, uo.output );
+            }
+
+            /** the first block whose transactions are still stored */
+            uint32_t first_full_block()
+            {
+               auto itr = block_trxs.begin();
+               return itr.valid() ? itr.key() : head_block.block_num + 1;
+            }
+
+            /**
+             *  Every output ever created by trx_id is in the database already, those
+             *  spent by the block being pushed are only removed in the pending batch.
+             */
+            bool is_fully_spent( const transaction_id_type& trx_id )
+            {
+               output_reference ref;
+               for( auto itr = unspent.lower_bound( output_reference( trx_id, 0 ) ); itr.valid(); ++itr )
+               {
+                  itr.key( ref );
+                  if( !(ref.trx_hash == trx_id) ) break;
+                  if( unspent.exists( ref ) ) return false;
+               }
+               return true;
+            }
+
+            /** drops the id and spent status of trx_id, @param b is the block being pushed */
+            void prune_trx( const transaction_id_type& trx_id, const trx_num& tn, const trx_block& b )
+            {
+               trx_id2num.remove( trx_id );
+               meta_trxs.remove( tn );
+
+               output_num on;
+               for( auto itr = spent_outputs.lower_bound( output_num( tn, 0 ) ); itr.valid(); ++itr )
+               {
+                  itr.key( on );
+                  if( !(on.trx_id == tn) ) break;
+                  spent_outputs.remove( on );
+               }
+               // the outputs spent by b are only in the pending batch
+               for( auto trx = b.trxs.begin(); trx != b.trxs.end(); ++trx )
+               {
+                  for( auto in = trx->inputs.begin(); in != trx->inputs.end(); ++in )
+                  {
+                     if( in->output_ref.trx_hash == trx_id )
+                        spent_outputs.remove( output_num( tn, in->output_ref.output_idx ) );
+                  }
+               }
+            }
+
+            /**
+             *  Called while pushing @param b.  Drops the transactions of the blocks more
+             *  than prune_depth below it, a few blocks at a time so that enabling pruning
+             *  on a long chain does not stall a single push.  Trx ids are kept until all
+             *  outputs of the trx are spent, so they are also checked when b spends the
+             *  last outputs of a trx in a block that was pruned before.
+             */
+            void prune( const trx_block& b )
+            {
+               if( prune_depth == 0 || b.block_num < prune_depth ) return;
+
+               uint32_t last = b.block_num - prune_depth;
+               uint32_t next = first_full_block();
+               for( uint32_t count = 0; next <= last && count < BLOCKCHAIN_PRUNE_BLOCKS_PER_PUSH; ++next, ++count )
+               {
+                  auto trx_ids = block_trxs.fetch_optional( next );
+                  if( !trx_ids ) continue;
+                  for( uint16_t i = 0; i < trx_ids->size(); ++i )
+                  {
+                     if( is_fully_spent( (*trx_ids)[i] ) )
+                        prune_trx( (*trx_ids)[i], trx_num( next, i ), b );
+                  }
+                  block_trxs.remove( next );
+                  archive.remove( next );
+               }
+
+               for( auto trx = b.trxs.begin(); trx != b.trxs.end(); ++trx )
+               {
+                  for( auto in = trx->inputs.begin(); in != trx->inputs.end(); ++in )
+                  {
+                     const auto& trx_id = in->output_ref.trx_hash;
+                     auto tn = trx_id2num.fetch_optional( trx_id );
+                     if( tn && tn->block_num < next && is_fully_spent( trx_id ) )
+                        prune_trx( trx_id, *tn, b );
+                  }
+               }
+            }
+
+            void store_unspent( const signed_transaction& t, const transaction_id_type& trx_id, const trx_num& tn )
+            {
+               for( uint16_t i = 0; i < t.outputs.size(); ++i )
+               {
+                  output_reference o( trx_id, i );
+                  unspent_output   uo( t.outputs[i], tn );
+                  unspent.store( o, uo );
+                  index_owner( o, uo, true );
+               }
+            }
+
+            /** the address an output pays, if it is one the address index covers */
+            static fc::optional<address> output_owner( const trx_output& out )
+            {
+               switch( out.claim_func )
+               {
+                  case claim_by_signature:
+                     return out.as<claim_by_signature_output>().owner;
+                  case claim_by_bid:
+                     return out.as<claim_by_bid_output>().pay_address;
+                  case claim_by_long:
+                     return out.as<claim_by_long_output>().pay_address;
+                  case claim_by_cover:
+                     return out.as<claim_by_cover_output>().owner;
+                  default:
+                     return fc::optional<address>();
+               }
+            }
+
+            /**
+             *  Adds or removes @param o in the address index, the writes go through the
+             *  block's batch so pop_block() reverts them with the rest of the block.
+             */
+            void index_owner( const output_reference& o, const unspent_output& uo, bool add )
+            {
+               if( !address_index ) return;
+               if( uo.output.claim_func == claim_by_pts )
+               {
+                  pts_address_output_key key( uo.output.as<claim_by_pts_output>().owner, o );
+                  if( add ) pts_address_outputs.store( key, uo );
+                  else      pts_address_outputs.remove( key );
+                  return;
+               }
+               auto owner = output_owner( uo.output );
+               if( !owner ) return;
+               address_output_key key( *owner, o );
+               if( add ) address_outputs.store( key, uo );
+               else      address_outputs.remove( key );
+            }
+
+            /**
+             *  Builds the address index from the unspent outputs when it is on and empty,
+             *  or drops it when it is off so that it is built again when turned back on.
+             */
+            void update_address_index()
+            {
+               bool indexed = address_outputs.begin().valid() || pts_address_outputs.begin().valid();
+               if( address_index == indexed ) return;
+
+               std::unique_ptr<db::write_batch> batch( new db::write_batch() );
+               address_outputs.join( *batch );
+               pts_address_outputs.join( *batch );
+               auto next_batch = [&]()
+               {
+                  batch->commit();
+                  batch.reset( new db::write_batch() );
+                  address_outputs.join( *batch );
+                  pts_address_outputs.join( *batch );
+               };
+
+               uint64_t count = 0;
+               if( address_index )
+               {
+                  ilog( "building the address index" );
+                  output_reference o;
+                  unspent_output   uo;
+                  for( auto itr = unspent.begin(); itr.valid(); ++itr )
+                  {
+                     itr.key( o );
+                     itr.value( uo );
+                     index_owner( o, uo, true );
+                     if( ++count % 10000 == 0 ) next_batch();
+                  }
+                  batch->commit();
+                  ilog( "indexed the owners of ${count} unspent outputs", ("count",count) );
+               }
+               else
+               {
+                  ilog( "dropping the address index" );
+                  address_output_key     key;
+                  pts_address_output_key pts_key;
+                  for( auto itr = address_outputs.begin(); itr.valid(); ++itr )
+                  {
+                     itr.key( key );
+                     address_outputs.remove( key );
+                     if( ++count % 10000 == 0 ) next_batch();
+                  }
+                  for( auto itr = pts_address_outputs.begin(); itr.valid(); ++itr )
+                  {
+                     itr.key( pts_key );
+                     pts_address_outputs.remove( pts_key );
+                     if( ++count % 10000 == 0 ) next_batch();
+                  }
+                  batch->commit();
+               }
+            }
+
+            /** the entries of @param index owned by @param owner, in output order */
+            template<typename Key, typename Owner>
+            std::vector<owned_output> fetch_owned( db::level_map<Key,unspent_output>& index, const Owner& owner,
+                                                   const db::snapshot_ptr& snap )
+            {
+               FC_ASSERT( address_index, "the address index is off" );
+               std::vector<owned_output> result;
+               Key          key;
+               owned_output owned;
+               for( auto itr = index.lower_bound( Key( owner, output_reference() ), snap ); itr.valid(); ++itr )
+               {
+                  itr.key( key );
+                  if( key.owner != owner ) break;
+                  owned.location = key.output;
+                  itr.value( owned.output );
+                  result.push_back( owned );
+               }
+               return result;
+            }
+
+            /**
+             *  Fills @param meta_outputs with the spent status recorded for the outputs of
+             *  @param tn, they are stored next to each other so this is a single seek.
+             */
+            void fetch_spent( const trx_num& tn, std::vector<meta_trx_output>& meta_outputs,
+                              const db::snapshot_ptr& snap )
+            {
+               std::fill( meta_outputs.begin(), meta_outputs.end(), meta_trx_output() );
+               output_num on;
+               for( auto itr = spent_outputs.lower_bound( output_num( tn, 0 ), snap ); itr.valid(); ++itr )
+               {
+                  itr.key( on );
+                  if( !(on.trx_id == tn) ) break;
+                  if( on.output_idx < meta_outputs.size() )
+                  {
+                     itr.value( meta_outputs[on.output_idx] );
+                  }
+               }
+            }
+
+            /**
+             *  Databases written before the unspent index kept the spent status in
+             *  meta_trxs, this builds the index from it once.
+             */
+            void build_unspent_index()
+            {
+               if( unspent.begin().valid() || spent_outputs.begin().valid() || !meta_trxs.begin().valid() )
+               {
+                  return;
+               }
+               ilog( "building the unspent output index" );
 
-               mtrx.meta_outputs[o.output_idx].trx_id    = intrx;
-               mtrx.meta_outputs[o.output_idx].input_num = in;
+               std::unique_ptr<db::write_batch> batch( new db::write_batch() );
+               join( *batch );
 
-               meta_trxs.store( tid, mtrx );
-               remove_market_orders( o );
+               uint32_t count = 0;
+               trx_num  tn;
+               meta_trx mtrx;
+               for( auto itr = meta_trxs.begin(); itr.valid(); ++itr )
+               {
+                  itr.key( tn );
+                  mtrx.sigs.clear();
+                  itr.value( mtrx );
+                  auto trx_id = mtrx.id();
+                  for( uint16_t i = 0; i < mtrx.outputs.size(); ++i )
+                  {
+                     if( i < mtrx.meta_outputs.size() && mtrx.meta_outputs[i].is_spent() )
+                        spent_outputs.store( output_num( tn, i ), mtrx.meta_outputs[i] );
+                     else
+                        unspent.store( output_reference( trx_id, i ), unspent_output( mtrx.outputs[i], tn ) );
+                  }
+                  // the spent status now lives in spent_outputs only
+                  mtrx.meta_outputs.assign( mtrx.outputs.size(), meta_trx_output() );
+                  meta_trxs.store( tn, mtrx );
+
+                  if( ++count % 1000 == 0 )
+                  {
+                     batch->commit();
+                     batch.reset( new db::write_batch() );
+                     join( *batch );
+                  }
+               }
+               batch->commit();
+               ilog( "indexed the outputs of ${count} transactions", ("count",count) );
             }
 
+            /** undo records are written to the shared database without going through the maps */
+            void clear_caches()
+            {
+               trx_id2num.clear_cache();
+               meta_trxs.clear_cache();
+               blocks.clear_cache();
+               unspent.clear_cache();
+               archive.clear_cache();
+               _market_db.reload();
+            }
 
-            void remove_market_orders( const output_reference& o )
+            void remove_market_orders( const output_reference& o, const trx_output& trx_out )
             {
-               auto trx_out = get_output( o );
                if( trx_out.claim_func == claim_by_bid )
                {
                   auto cbb = trx_out.as<claim_by_bid_output>();
@@ -101,29 +474,161 @@ namespace bts { namespace blockchain {
             }
 
 
-            trx_output get_output( const output_reference& ref )
+            trx_output get_output( const output_reference& ref, const db::snapshot_ptr& snap = db::snapshot_ptr() )
             { try {
-               auto tid    = trx_id2num.fetch( ref.trx_hash );
-               meta_trx   mtrx   = meta_trxs.fetch( tid );
+               unspent_output uo;
+               if( unspent.visit( ref,
+                     [&]( const db::level_map<output_reference,unspent_output>::value_view& v ){ v.unpack( uo ); }, snap ) )
+               {
+                  return uo.output;
+               }
+               // spent outputs are only kept by the transaction that created them
+               auto tid    = trx_id2num.fetch( ref.trx_hash, snap );
+               meta_trx   mtrx;
+               fetch_trx( tid, mtrx, snap );
                FC_ASSERT( mtrx.outputs.size() > ref.output_idx );
                return mtrx.outputs[ref.output_idx];
             } FC_RETHROW_EXCEPTIONS( warn, "", ("ref",ref) ) }
+
+            // reads shared by blockchain_db and chain_snapshot, an empty snap reads the latest state
+
+            void fetch_trx( const trx_num& trx_id, meta_trx& trx, const db::snapshot_ptr& snap )
+            {
+               trx.sigs.clear(); // unpacking inserts into the existing set
+               bool found = archive.fetch_trx( trx_id.block_num, trx_id.trx_idx, trx, snap ) ||
+                            meta_trxs.visit( trx_id,
+                             [&]( const db::level_map<trx_num,meta_trx>::value_view& v ){ v.unpack( trx ); }, snap );
+               if( !found )
+               {
+                  FC_THROW_EXCEPTION( key_not_found_exception, "unable to find trx ${trx_id}", ("trx_id",trx_id) );
+               }
+               trx.meta_outputs.resize( trx.outputs.size() );
+               fetch_spent( trx_id, trx.meta_outputs, snap );
+            }
+
+            void fetch_full_block( uint32_t block_num, full_block& blk, const db::snapshot_ptr& snap )
+            {
+               bool found = blocks.visit( block_num,
+                             [&]( const db::level_map<uint32_t,block_header>::value_view& v ){ v.unpack( blk ); }, snap );
+               found = found && block_trxs.visit( block_num,
+                             [&]( const db::level_map<uint32_t,std::vector<uint160> >::value_view& v ){ v.unpack( blk.trx_ids ); }, snap );
+               if( !found )
+               {
+                  FC_THROW_EXCEPTION( key_not_found_exception, "unable to find block ${block}", ("block",block_num) );
+               }
+            }
+
+            trx_block fetch_trx_block( uint32_t block_num, const db::snapshot_ptr& snap )
+            {
+               trx_block fb;
+               if( archive.fetch( block_num, fb, snap ) )
+               {
+                  return fb;
+               }
+               fb = blocks.fetch( block_num, snap );
+               auto trx_ids = block_trxs.fetch( block_num, snap );
+               meta_trx mtrx;
+               for( uint32_t i = 0; i < trx_ids.size(); ++i )
+               {
+                  auto tn = trx_id2num.fetch( trx_ids[i], snap );
+                  fetch_trx( tn, mtrx, snap );
+                  fb.trxs.push_back( mtrx );
+               }
+               return fb;
+            }
+
+            std::vector<char> fetch_packed_trx_block( uint32_t block_num, const db::snapshot_ptr& snap )
+            {
+               std::vector<char> packed;
+               if( !archive.fetch_packed( block_num, packed, snap ) )
+               {
+                  packed = fc::raw::pack( fetch_trx_block( block_num, snap ) );
+               }
+               return packed;
+            }
+
+            /** the amounts get_market() reports for an order, 0 once its output is spent */
+            uint64_t order_amount( const market_order& m )
+            {
+               unspent_output uo;
+               if( !unspent.visit( m.location,
+                     [&]( const db::level_map<output_reference,unspent_output>::value_view& v ){ v.unpack( uo ); } ) )
+               {
+                  return 0;
+               }
+               if( uo.output.claim_func == claim_by_long )
+               {
+                  auto ask_price = uo.output.as<claim_by_long_output>().ask_price;
+                  return (uo.output.amount*ask_price).get_rounded_amount();
+               }
+               return uo.output.amount.get_rounded_amount();
+            }
+
+            market_data get_market( asset::type quote, asset::type base, const db::snapshot_ptr& snap )
+            {
+               market_data d;
+               auto bids = _market_db.get_bids( quote, base, snap );
+               for( auto itr = bids.begin(); itr != bids.end(); ++itr )
+               {
+                   auto working_bid = get_output( itr->location, snap );
+                   if( working_bid.claim_func == claim_by_long )
+                   {
+                      claim_by_long_output long_claim = working_bid.as<claim_by_long_output>();
+                      d.shorts.push_back( short_data( long_claim.ask_price, working_bid.amount.get_rounded_amount()  ) );
+                      d.bids.push_back( bid_data( long_claim.ask_price, (working_bid.amount*long_claim.ask_price).get_rounded_amount()) );
+                      d.bids.back().is_short = true;
+                   }
+                   else
+                   {
+                      claim_by_bid_output bid_claim = working_bid.as<claim_by_bid_output>();
+                      d.bids.push_back( bid_data( bid_claim.ask_price, working_bid.amount.get_rounded_amount() ) );
+                   }
+               }
+
+               auto asks = _market_db.get_asks( quote, base, snap );
+               for( auto itr = asks.begin(); itr != asks.end(); ++itr )
+               {
+                   auto working_ask = get_output( itr->location, snap );
+                   claim_by_bid_output ask_claim = working_ask.as<claim_by_bid_output>();
+                   d.asks.push_back( ask_data( ask_claim.ask_price, working_ask.amount.get_rounded_amount() ) );
+               }
+               return d;
+            }
+
+            std::vector<price_point> get_market_history( asset::type quote, asset::type base,
+                                                         fc::time_point_sec from, fc::time_point_sec to,
+                                                         uint32_t blocks_per_point, const db::snapshot_ptr& snap )
+            {
+               FC_ASSERT( quote != base );
+               // the points are kept under the pair with the greater unit as the quote
+               if( quote < base ) std::swap( quote, base );
+               return _market_db.get_history( quote, base, from, to, blocks_per_point, snap );
+            }
+
+            std::vector<price_point> get_market_candles( asset::type quote, asset::type base, uint32_t resolution,
+                                                         fc::time_point_sec from, fc::time_point_sec to,
+                                                         const db::snapshot_ptr& snap )
+            {
+               FC_ASSERT( quote != base );
+               if( quote < base ) std::swap( quote, base );
+               return _market_db.get_candles( quote, base, resolution, from, to, snap );
+            }
             
             /**
              *   Stores a transaction and updates the spent status of all 
              *   outputs doing one last check to make sure they are unspent.
              */
-            void store( const signed_transaction& t, const trx_num& tn )
+            void store( const signed_transaction& t, const transaction_id_type& trx_id, const trx_num& tn )
             {
-               ilog( "trxid: ${id}   ${tn}\n\n  ${trx}\n\n", ("id",t.id())("tn",tn)("trx",t) );
+               ilog( "trxid: ${id}   ${tn}\n\n  ${trx}\n\n", ("id",trx_id)("tn",tn)("trx",t) );
 
-               trx_id2num.store( t.id(), tn ); 
-               meta_trxs.store( tn, meta_trx(t) );
+               trx_id2num.store( trx_id, tn ); 
 
                for( uint16_t i = 0; i < t.inputs.size(); ++i )
                {
                   mark_spent( t.inputs[i].output_ref, tn, i ); 
                }
+               store_unspent( t, trx_id, tn );
                
                for( uint16_t i = 0; i < t.outputs.size(); ++i )
                {
@@ -132,30 +637,30 @@ namespace bts { namespace blockchain {
                      claim_by_bid_output cbb = t.outputs[i].as<claim_by_bid_output>();
                      if( cbb.is_bid(t.outputs[i].amount.unit) )
                      {
-                        elog( "Insert Bid: ${bid}", ("bid",market_order(cbb.ask_price, output_reference( t.id(), i )) ) );
-                        _market_db.insert_bid( market_order(cbb.ask_price, output_reference( t.id(), i )), 0 );
+                        elog( "Insert Bid: ${bid}", ("bid",market_order(cbb.ask_price, output_reference( trx_id, i )) ) );
+                        _market_db.insert_bid( market_order(cbb.ask_price, output_reference( trx_id, i )), 0 );
                      }
                      else
                      {
-                        elog( "Insert Ask: ${bid}", ("bid",market_order(cbb.ask_price, output_reference( t.id(), i )) ) );
-                        _market_db.insert_ask( market_order(cbb.ask_price, output_reference( t.id(), i )), 
+                        elog( "Insert Ask: ${bid}", ("bid",market_order(cbb.ask_price, output_reference( trx_id, i )) ) );
+                        _market_db.insert_ask( market_order(cbb.ask_price, output_reference( trx_id, i )), 
                                                t.outputs[i].amount.get_rounded_amount() );
                      }
                   }
                   else if( t.outputs[i].claim_func == claim_by_long )
                   {
                     auto cbl = t.outputs[i].as<claim_by_long_output>();
-                    elog( "Insert Short Ask: ${bid}", ("bid",market_order(cbl.ask_price, output_reference( t.id(), i )) ) );
+                    elog( "Insert Short Ask: ${bid}", ("bid",market_order(cbl.ask_price, output_reference( trx_id, i )) ) );
 
                     /// TODO: should I divide the depth amount by the margin ratio to keep things weighted fairly?
-                    _market_db.insert_bid( market_order(cbl.ask_price, output_reference( t.id(), i )), 
+                    _market_db.insert_bid( market_order(cbl.ask_price, output_reference( trx_id, i )), 
                                            t.outputs[i].amount.get_rounded_amount() );
                   }
                   else if( t.outputs[i].claim_func == claim_by_cover )
                   {
                     /// TODO: should I divide the depth amount by the margin ratio to keep things weighted fairly?
                      auto cbc = t.outputs[i].as<claim_by_cover_output>();
-                     _market_db.insert_call( margin_call( cbc.get_call_price(t.outputs[i].amount), output_reference( t.id(), i ) ),
+                     _market_db.insert_call( margin_call( cbc.get_call_price(t.outputs[i].amount), output_reference( trx_id, i ) ),
                                              t.outputs[i].amount.get_rounded_amount() );
                   }
                }
@@ -164,32 +669,61 @@ namespace bts { namespace blockchain {
             void store( const trx_block& b )
             {
                 std::vector<uint160> trxs_ids;
+                trxs_ids.reserve( b.trxs.size() );
                 for( uint16_t t = 0; t < b.trxs.size(); ++t )
                 {
-                   store( b.trxs[t], trx_num( b.block_num, t) );
                    trxs_ids.push_back( b.trxs[t].id() );
+                   store( b.trxs[t], trxs_ids.back(), trx_num( b.block_num, t) );
                 }
-                head_block    = b;
-                head_block_id = b.id();
 
                 blocks.store( b.block_num, b );
                 block_trxs.store( b.block_num, trxs_ids );
+                archive.store( b );
+            }
+
+            /**
+             *  Everything match_orders() reads for one pair apart from the outputs, which are
+             *  read through snap.  It is taken on the thread that pushes blocks before the pairs
+             *  are matched on other threads, other fibers may push a block while it waits.
+             */
+            struct match_view
+            {
+               match_view():depth(0){}
+
+               block_header               head;
+               db::snapshot_ptr           snap;
+               uint64_t                   depth;
+               std::vector<market_order>  asks;
+               std::vector<market_order>  bids;
+            };
+
+            match_view get_match_view( asset::type quote, asset::type base, const db::snapshot_ptr& snap )
+            {
+               match_view view;
+               view.head  = head_block;
+               view.snap  = snap;
+               view.depth = _market_db.get_depth( quote );
+               view.asks  = _market_db.get_asks( quote, base );
+               view.bids  = _market_db.get_bids( quote, base );
+               return view;
             }
 
             /**
              *  Pushes a new transaction into matched that pairs all bids/asks for a single quote/base pair
              */
-            void match_orders( std::vector<signed_transaction>& matched,  asset::type quote, asset::type base, price_point& stats )
+            void match_orders( std::vector<signed_transaction>& matched,  asset::type quote, asset::type base, price_point& stats,
+                               const match_view& view )
             { try {
+               const auto& snap = view.snap;
                ilog( "match orders.." );
                uint64_t initial_depth = 0;
                if( base == asset::bts )
                {
-                  initial_depth = _market_db.get_depth( quote );
-                  if( initial_depth <  head_block.total_shares/100 )
+                  initial_depth = view.depth;
+                  if( initial_depth <  view.head.total_shares/100 )
                   {
                      wlog( "initial depth of ${initial_depth} is less than 1% of supply ${supply}",
-                            ("initial_depth",initial_depth)("supply", head_block.total_shares) );
+                            ("initial_depth",initial_depth)("supply", view.head.total_shares) );
                      return;
                   }
                }
@@ -198,8 +732,8 @@ namespace bts { namespace blockchain {
                 */
                uint64_t consumed_depth = 0;
 
-               auto asks = _market_db.get_asks( quote, base );
-               auto bids = _market_db.get_bids( quote, base );
+               const auto& asks = view.asks;
+               const auto& bids = view.bids;
                wlog( "asks: ${asks}", ("asks",asks) );
                wlog( "bids: ${bids}", ("bids",bids) );
 
@@ -242,22 +776,22 @@ namespace bts { namespace blockchain {
                trx_output working_ask;
                trx_output working_bid;
 
-               stats.from_block   = head_block.block_num;
+               stats.from_block   = view.head.block_num;
                stats.to_block     = stats.from_block + 1;
-               stats.from_time    = head_block.timestamp;
-               stats.to_time      = head_block.timestamp;
+               stats.from_time    = view.head.timestamp;
+               stats.to_time      = view.head.timestamp;
                stats.quote_volume = pay_asker; // asker has bts, wants usd... usd is quote
                stats.base_volume  = pay_bidder; // bidder has usd, wants bts... bts is base
 
                if( ask_itr != asks.end() )
                {
-                    working_ask   = get_output( ask_itr->location );
+                    working_ask   = get_output( ask_itr->location, snap );
                     if( working_ask.claim_func == claim_by_bid )
                        stats.low_ask = working_ask.as<claim_by_bid_output>().ask_price;
                }
                if( bid_itr != bids.rend() )
                {
-                   working_bid = get_output( bid_itr->location );
+                   working_bid = get_output( bid_itr->location, snap );
 
                    if( working_ask.claim_func == claim_by_bid )
                       stats.high_bid = working_ask.as<claim_by_bid_output>().ask_price;
@@ -342,7 +876,7 @@ namespace bts { namespace blockchain {
                             market_trx.outputs.push_back( trx_output( claim_by_signature_output( ask_claim.pay_address ), pay_asker) );
                          pay_asker = asset(ULLCONST(0),pay_asker.unit);
                          ++ask_itr;
-                         if( ask_itr != asks.end() )  working_ask = get_output( ask_itr->location );
+                         if( ask_itr != asks.end() )  working_ask = get_output( ask_itr->location, snap );
                      }
                      else // we have filled the bid (short sell) 
                      {
@@ -367,7 +901,7 @@ namespace bts { namespace blockchain {
                          loan_amount       = asset(ULLCONST(0),loan_amount.unit);
                          collateral_amount = asset();
                          ++bid_itr;
-                         if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location );
+                         if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location, snap );
 
                          if( working_ask.amount.get_rounded_amount() == 0 )
                          {
@@ -379,7 +913,7 @@ namespace bts { namespace blockchain {
                             }
                             pay_asker = asset(ULLCONST(0),pay_asker.unit);
                             ++ask_itr;
-                            if( ask_itr != asks.end() )  working_ask = get_output( ask_itr->location );
+                            if( ask_itr != asks.end() )  working_ask = get_output( ask_itr->location, snap );
                          }
                      }
                   }
@@ -429,7 +963,7 @@ namespace bts { namespace blockchain {
                         }
                         pay_asker = asset(ULLCONST(0),pay_asker.unit);
                         ++ask_itr;
-                        if( ask_itr != asks.end() )  working_ask = get_output( ask_itr->location );
+                        if( ask_itr != asks.end() )  working_ask = get_output( ask_itr->location, snap );
                      }
                      else // then we have filled the bid or we have filled BOTH
                      {
@@ -459,7 +993,7 @@ namespace bts { namespace blockchain {
                         pay_bidder = asset(ULLCONST(0),pay_bidder.unit);
 
                         ++bid_itr;
-                        if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location );
+                        if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location, snap );
 
                         if( working_ask.amount.get_rounded_amount() == 0 )
                         {
@@ -469,7 +1003,7 @@ namespace bts { namespace blockchain {
                               market_trx.outputs.push_back( trx_output( claim_by_signature_output( ask_claim.pay_address ), pay_asker) );
                            pay_asker = asset(ULLCONST(0),pay_asker.unit);
                            ++ask_itr;
-                           if( ask_itr != asks.end() )  working_ask = get_output( ask_itr->location );
+                           if( ask_itr != asks.end() )  working_ask = get_output( ask_itr->location, snap );
                         }
                      }
                   }
@@ -482,13 +1016,13 @@ namespace bts { namespace blockchain {
 
                if( ask_itr != asks.end() )
                {
-                    working_ask   = get_output( ask_itr->location );
+                    working_ask   = get_output( ask_itr->location, snap );
                     if( working_ask.claim_func == claim_by_bid )
                        stats.high_ask = working_ask.as<claim_by_bid_output>().ask_price;
                }
                if( bid_itr != bids.rend() )
                {
-                   working_bid = get_output( bid_itr->location );
+                   working_bid = get_output( bid_itr->location, snap );
 
                    if( working_ask.claim_func == claim_by_bid )
                       stats.low_bid = working_ask.as<claim_by_bid_output>().ask_price;
@@ -522,7 +1056,7 @@ namespace bts { namespace blockchain {
                      call_price = working_bid.as<claim_by_bid_output>().ask_price;
                   
                   // all of these margin positions must accept the highest bid
-                  auto margin_positions = _market_db.get_calls( call_price );
+                  auto margin_positions = _market_db.get_calls( call_price, snap );
                   ilog( "\n\nMARGIN POSITIONS:\n${p}\n\n", ("p", margin_positions ) );
 
                   trx_output            working_call;
@@ -531,7 +1065,7 @@ namespace bts { namespace blockchain {
                   auto call_itr = margin_positions.begin();
                   if( call_itr != margin_positions.end() )
                   {
-                     working_call = get_output( call_itr->location );
+                     working_call = get_output( call_itr->location, snap );
                      cover_claim  = working_call.as<claim_by_cover_output>();
                   }
 
@@ -564,7 +1098,7 @@ namespace bts { namespace blockchain {
 
                             // goto next bid
                             ++bid_itr;
-                            if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location );
+                            if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location, snap );
                          }
                          else if( payoff < bid_usd )
                          { 
@@ -586,7 +1120,7 @@ namespace bts { namespace blockchain {
                             ++call_itr;
                             if( call_itr != margin_positions.end() )
                             {
-                               working_call = get_output( call_itr->location );
+                               working_call = get_output( call_itr->location, snap );
                                cover_claim  = working_call.as<claim_by_cover_output>();
                             }
                          }
@@ -612,12 +1146,12 @@ namespace bts { namespace blockchain {
                             market_trx.inputs.push_back( bid_itr->location );
 
                             ++bid_itr;
-                            if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location );
+                            if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location, snap );
 
                             ++call_itr;
                             if( call_itr != margin_positions.end() )
                             {
-                               working_call = get_output( call_itr->location );
+                               working_call = get_output( call_itr->location, snap );
                                cover_claim  = working_call.as<claim_by_cover_output>();
                             }
                          }
@@ -644,7 +1178,7 @@ namespace bts { namespace blockchain {
 
                             // goto next bid
                             ++bid_itr;
-                            if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location );
+                            if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location, snap );
                             pay_bidder = asset( 0.0, quote );
                          }
                          else if( payoff < bid_usd )
@@ -663,7 +1197,7 @@ namespace bts { namespace blockchain {
                             ++call_itr;
                             if( call_itr != margin_positions.end() )
                             {
-                               working_call = get_output( call_itr->location );
+                               working_call = get_output( call_itr->location, snap );
                                cover_claim  = working_call.as<claim_by_cover_output>();
                             }
                          }
@@ -689,13 +1223,13 @@ namespace bts { namespace blockchain {
                             market_trx.inputs.push_back( bid_itr->location );
 
                             ++bid_itr;
-                            if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location );
+                            if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location, snap );
                             pay_bidder = asset( 0.0, quote );
 
                             ++call_itr;
                             if( call_itr != margin_positions.end() )
                             {
-                               working_call = get_output( call_itr->location );
+                               working_call = get_output( call_itr->location, snap );
                                cover_claim  = working_call.as<claim_by_cover_output>();
                             }
                          }
@@ -704,7 +1238,7 @@ namespace bts { namespace blockchain {
 
                   if( margin_positions.end() != call_itr ) // 
                   {
-                     auto orig = get_output(call_itr->location);
+                     auto orig = get_output( call_itr->location, snap );
                      if( orig.amount != working_call.amount )
                      {
                         // then we have some change in the margin call... apparently there
@@ -761,13 +1295,25 @@ namespace bts { namespace blockchain {
      blockchain_db::blockchain_db()
      :my( new detail::blockchain_db_impl() )
      {
+        if( std::string( BLOCKCHAIN_ASSUME_VALID_BLOCK_ID ).size() )
+        {
+           set_assume_valid( BLOCKCHAIN_ASSUME_VALID_BLOCK_NUM, block_id_type( std::string( BLOCKCHAIN_ASSUME_VALID_BLOCK_ID ) ) );
+        }
      }
 
      blockchain_db::~blockchain_db()
      {
      }
 
-     void blockchain_db::open( const fc::path& dir, bool create )
+     db::database_options blockchain_db::default_database_options()
+     {
+        db::database_options opts;
+        opts.cache_size        = BLOCKCHAIN_DB_CACHE_BYTES;
+        opts.write_buffer_size = BLOCKCHAIN_DB_WRITE_BUFFER_BYTES;
+        return opts;
+     }
+
+     void blockchain_db::open( const fc::path& dir, bool create, const db::database_options& opts )
      {
        try {
          if( !fc::exists( dir ) )
@@ -779,13 +1325,39 @@ namespace bts { namespace blockchain {
               }
               fc::create_directories( dir );
          }
-         my->blk_id2num.open( dir / "blk_id2num", create );
-         my->trx_id2num.open( dir / "trx_id2num", create );
-         my->meta_trxs.open(  dir / "meta_trxs",  create );
-         my->blocks.open(     dir / "blocks",     create );
-         my->block_trxs.open( dir / "block_trxs", create );
-         my->_market_db.open( dir / "market" );
-
+         // all chain state lives in one leveldb so a block is committed with a single write
+         auto chain_db = std::make_shared<db::database>();
+         chain_db->open( dir / "database", create, opts );
+
+         my->blk_id2num.open( chain_db, "blk_id2num" );
+         my->trx_id2num.open( chain_db, "trx_id2num" );
+         my->meta_trxs.open(  chain_db, "meta_trxs" );
+         my->unspent.open(    chain_db, "unspent" );
+         my->spent_outputs.open( chain_db, "spent_outputs" );
+         my->address_outputs.open( chain_db, "address_outputs" );
+         my->pts_address_outputs.open( chain_db, "pts_address_outputs" );
+         my->block_undo.open( chain_db, "block_undo" );
+         my->blocks.open(     chain_db, "blocks" );
+         my->block_trxs.open( chain_db, "block_trxs" );
+         my->_market_db.open( chain_db );
+         my->archive.open( dir / "archive", chain_db );
+
+         // databases created before the shared database kept one leveldb per map
+         my->blk_id2num.import_standalone( dir / "blk_id2num" );
+         my->trx_id2num.import_standalone( dir / "trx_id2num" );
+         my->meta_trxs.import_standalone(  dir / "meta_trxs" );
+         my->blocks.import_standalone(     dir / "blocks" );
+         my->block_trxs.import_standalone( dir / "block_trxs" );
+         my->_market_db.import_standalone( dir / "market" );
+         my->build_unspent_index();
+         my->update_address_index();
+         auto self = my.get();
+         my->_market_db.set_order_amounts( [self]( const market_order& m ){ return self->order_amount( m ); } );
+
+         my->trx_id2num.set_cache_limits( BLOCKCHAIN_TRX_CACHE_ENTRIES, BLOCKCHAIN_TRX_CACHE_BYTES );
+         my->meta_trxs.set_cache_limits( BLOCKCHAIN_TRX_CACHE_ENTRIES, BLOCKCHAIN_TRX_CACHE_BYTES );
+         my->blocks.set_cache_limits( BLOCKCHAIN_BLOCK_CACHE_ENTRIES, 0 );
+         my->unspent.set_cache_limits( 0, BLOCKCHAIN_UNSPENT_CACHE_BYTES );
          
          // read the last block from the DB
          my->blocks.last( my->head_block.block_num, my->head_block );
@@ -794,7 +1366,13 @@ namespace bts { namespace blockchain {
             my->head_block_id = my->head_block.id();
          }
 
-       } FC_RETHROW_EXCEPTIONS( warn, "error loading blockchain database ${dir}", ("dir",dir)("create",create) );
+       } FC_RETHROW_EXCEPTIONS( warn, "error loading blockchain database ${dir}", ("dir",dir)("create",create)("options",opts) );
+     }
+
+     db::database_options blockchain_db::get_database_options()const
+     {
+        FC_ASSERT( my->blocks.get_database() );
+        return my->blocks.get_database()->get_options();
      }
 
      void blockchain_db::close()
@@ -804,8 +1382,124 @@ namespace bts { namespace blockchain {
         my->blocks.close();
         my->block_trxs.close();
         my->meta_trxs.close();
+        my->unspent.close();
+        my->spent_outputs.close();
+        my->address_outputs.close();
+        my->pts_address_outputs.close();
+        my->block_undo.close();
+        my->_market_db.close();
+        my->archive.close();
+     }
+
+     std::map<std::string,db::cache_stats> blockchain_db::get_cache_stats()const
+     {
+        std::map<std::string,db::cache_stats> stats;
+        stats["trx_id2num"] = my->trx_id2num.get_cache_stats();
+        stats["meta_trxs"]  = my->meta_trxs.get_cache_stats();
+        stats["blocks"]     = my->blocks.get_cache_stats();
+        stats["unspent"]    = my->unspent.get_cache_stats();
+        return stats;
+     }
+
+     void blockchain_db::set_unspent_cache_size( uint64_t max_bytes )
+     {
+        my->unspent.set_cache_limits( 0, max_bytes );
+     }
+
+     void blockchain_db::set_assume_valid( uint32_t block_num, const block_id_type& block_id )
+     {
+        if( block_num == INVALID_BLOCK_NUM )
+        {
+           my->assume_valid.reset();
+           return;
+        }
+        ilog( "not checking signatures of the ancestors of block ${n} ${id}", ("n",block_num)("id",block_id) );
+        auto checkpoint = std::make_shared<assume_valid_chain>();
+        checkpoint->first_block_num = block_num;
+        checkpoint->ids.push_back( block_id );
+        my->assume_valid = checkpoint;
+     }
+
+     uint32_t blockchain_db::assume_valid_block_num()const
+     {
+        return my->assume_valid ? my->assume_valid->checkpoint_num() : INVALID_BLOCK_NUM;
+     }
+
+     void blockchain_db::add_assume_valid_headers( const std::vector<block_header>& headers )
+     { try {
+        FC_ASSERT( my->assume_valid, "there is no assume valid checkpoint" );
+        if( headers.empty() ) return;
+
+        // the last header must be a known block, each one before it the prev of the next
+        const auto& known = *my->assume_valid;
+        FC_ASSERT( known.covers( headers.back().block_num, headers.back().id() ),
+                   "block ${n} is not a known ancestor of the checkpoint", ("n",headers.back().block_num) );
+
+        std::vector<block_id_type> ancestors;
+        for( size_t i = headers.size() - 1; i > 0; --i )
+        {
+           const auto& parent = headers[i-1];
+           FC_ASSERT( parent.block_num + 1 == headers[i].block_num && parent.id() == headers[i].prev,
+                      "header ${n} is not the prev of the header after it", ("n",parent.block_num) );
+           if( parent.block_num < known.first_block_num ) ancestors.push_back( parent.id() );
+        }
+        if( ancestors.empty() ) return;
+
+        auto extended = std::make_shared<assume_valid_chain>();
+        extended->first_block_num = known.first_block_num - ancestors.size();
+        extended->ids.assign( ancestors.rbegin(), ancestors.rend() );
+        extended->ids.insert( extended->ids.end(), known.ids.begin(), known.ids.end() );
+        my->assume_valid = extended;
+        ilog( "not checking signatures from block ${n} up to the checkpoint", ("n",extended->first_block_num) );
+     } FC_RETHROW_EXCEPTIONS( warn, "unable to add assume valid headers" ) }
+
+     assume_valid_chain_ptr blockchain_db::get_assume_valid_chain()const
+     {
+        return my->assume_valid;
+     }
+
+     void blockchain_db::set_prune_depth( uint32_t depth )
+     {
+        FC_ASSERT( depth == 0 || depth >= BLOCKCHAIN_MIN_PRUNE_DEPTH, "blocks that may still be popped can not be pruned",
+                   ("depth",depth)("min",BLOCKCHAIN_MIN_PRUNE_DEPTH) );
+        my->prune_depth = depth;
+     }
+
+     uint32_t blockchain_db::prune_depth()const
+     {
+        return my->prune_depth;
+     }
+
+     void blockchain_db::set_match_threads( uint32_t threads )
+     {
+        my->match_threads = threads;
+     }
+
+     uint32_t blockchain_db::first_full_block()const
+     {
+        return my->first_full_block();
      }
 
+     void blockchain_db::set_address_index( bool enabled )
+     {
+        my->address_index = enabled;
+     }
+
+     bool blockchain_db::has_address_index()const
+     {
+        return my->address_index;
+     }
+
+     std::vector<owned_output> blockchain_db::fetch_unspent_outputs( const address& owner )
+     { try {
+        return my->fetch_owned( my->address_outputs, owner, db::snapshot_ptr() );
+     } FC_RETHROW_EXCEPTIONS( warn, "", ("owner",owner) ) }
+
+     std::vector<owned_output> blockchain_db::fetch_unspent_outputs( const pts_address& owner )
+     { try {
+        return my->fetch_owned( my->pts_address_outputs, owner, db::snapshot_ptr() );
+     } FC_RETHROW_EXCEPTIONS( warn, "", ("owner",owner) ) }
+
     uint32_t blockchain_db::head_block_num()const
     {
        return my->head_block.block_num;
@@ -838,6 +1532,11 @@ namespace bts { namespace blockchain {
     }
      */
 
+    bool       blockchain_db::has_transaction( const transaction_id_type& trx_id )
+    {
+       return my->trx_id2num.exists( trx_id );
+    }
+
     trx_num    blockchain_db::fetch_trx_num( const uint160& trx_id )
     { try {
        return my->trx_id2num.fetch(trx_id);
@@ -845,7 +1544,14 @@ namespace bts { namespace blockchain {
 
     meta_trx    blockchain_db::fetch_trx( const trx_num& trx_id )
     { try {
-       return my->meta_trxs.fetch( trx_id );
+       meta_trx trx;
+       my->fetch_trx( trx_id, trx, db::snapshot_ptr() );
+       return trx;
+    } FC_RETHROW_EXCEPTIONS( warn, "trx_id ${trx_id}", ("trx_id",trx_id) ) }
+
+    void        blockchain_db::fetch_trx( const trx_num& trx_id, meta_trx& trx )
+    { try {
+       my->fetch_trx( trx_id, trx, db::snapshot_ptr() );
     } FC_RETHROW_EXCEPTIONS( warn, "trx_id ${trx_id}", ("trx_id",trx_id) ) }
 
     uint32_t    blockchain_db::fetch_block_num( const block_id_type& block_id )
@@ -865,18 +1571,14 @@ namespace bts { namespace blockchain {
        return fb;
     } FC_RETHROW_EXCEPTIONS( warn, "block ${block}", ("block",block_num) ) }
 
+    void        blockchain_db::fetch_full_block( uint32_t block_num, full_block& blk )
+    { try {
+       my->fetch_full_block( block_num, blk, db::snapshot_ptr() );
+    } FC_RETHROW_EXCEPTIONS( warn, "block ${block}", ("block",block_num) ) }
+
     trx_block  blockchain_db::fetch_trx_block( uint32_t block_num )
     { try {
-       trx_block fb = my->blocks.fetch(block_num);
-       auto trx_ids = my->block_trxs.fetch( block_num );
-       for( uint32_t i = 0; i < trx_ids.size(); ++i )
-       {
-          auto trx_num = fetch_trx_num(trx_ids[i]);
-          fb.trxs.push_back( fetch_trx( trx_num ) );
-       }
-       // TODO: fetch each trx and add it to the trx block
-       //fb.trx_ids = my->block_trxs.fetch( block_num );
-       return fb;
+       return my->fetch_trx_block( block_num, db::snapshot_ptr() );
     } FC_RETHROW_EXCEPTIONS( warn, "block ${block}", ("block",block_num) ) }
 
     signed_transaction blockchain_db::fetch_transaction( const transaction_id_type& id )
@@ -886,7 +1588,9 @@ namespace bts { namespace blockchain {
     } FC_RETHROW_EXCEPTIONS( warn, "", ("id",id) ) }
 
 
-    std::vector<meta_trx_input> blockchain_db::fetch_inputs( const std::vector<trx_input>& inputs, uint32_t head )
+    std::vector<meta_trx_input> blockchain_db::fetch_inputs( const std::vector<trx_input>& inputs, uint32_t head,
+                                                             const pending_outputs* pending,
+                                                             const prefetched_inputs* prefetched )
     {
        try
        {
@@ -897,9 +1601,50 @@ namespace bts { namespace blockchain {
 
           std::vector<meta_trx_input> rtn;
           rtn.reserve( inputs.size() );
+          unspent_output uo;
           for( uint32_t i = 0; i < inputs.size(); ++i )
           {
             try {
+             bool is_unspent = false;
+             if( prefetched )
+             {
+                auto prefetched_itr = prefetched->find( inputs[i].output_ref );
+                if( prefetched_itr != prefetched->end() )
+                {
+                   uo = prefetched_itr->second;
+                   is_unspent = true;
+                }
+             }
+             if( !is_unspent )
+             {
+                is_unspent = my->unspent.visit( inputs[i].output_ref,
+                      [&]( const db::level_map<output_reference,unspent_output>::value_view& v ){ v.unpack( uo ); } );
+             }
+             if( is_unspent )
+             {
+                meta_trx_input metin;
+                metin.source       = uo.source;
+                metin.output_num   = inputs[i].output_ref.output_idx;
+                metin.output       = uo.output;
+                rtn.push_back( metin );
+                continue;
+             }
+
+             if( pending )
+             {
+                auto pending_itr = pending->find( inputs[i].output_ref );
+                if( pending_itr != pending->end() )
+                {
+                   meta_trx_input metin;
+                   metin.source       = trx_num( head, 0 ); // not in a block yet, no coindays to destroy
+                   metin.output_num   = inputs[i].output_ref.output_idx;
+                   metin.output       = pending_itr->second;
+                   rtn.push_back( metin );
+                   continue;
+                }
+             }
+
+             // spent or invalid, load the transaction to report where it was spent
              trx_num tn   = fetch_trx_num( inputs[i].output_ref.trx_hash );
              meta_trx trx = fetch_trx( tn );
              
@@ -927,6 +1672,19 @@ namespace bts { namespace blockchain {
        } FC_RETHROW_EXCEPTIONS( warn, "error fetching transaction inputs", ("inputs", inputs) );
     }
 
+    prefetched_inputs blockchain_db::prefetch_inputs( const std::vector<signed_transaction>& trxs )
+    { try {
+       std::vector<output_reference> refs;
+       for( auto trx = trxs.begin(); trx != trxs.end(); ++trx )
+       {
+          for( auto in = trx->inputs.begin(); in != trx->inputs.end(); ++in )
+          {
+             refs.push_back( in->output_ref );
+          }
+       }
+       return my->prefetch_inputs( std::move(refs) );
+    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
 
     /**
      *  Validates that trx could be included in a future block, that
@@ -938,7 +1696,9 @@ namespace bts { namespace blockchain {
      *
      *  @throw exception if trx can not be applied to the current chain state.
      */
-    trx_eval blockchain_db::evaluate_signed_transaction( const signed_transaction& trx, bool ignore_fees, bool is_market  )       
+    trx_eval blockchain_db::evaluate_signed_transaction( const signed_transaction& trx, bool ignore_fees, bool is_market,
+                                                         const signature_keys* keys, const pending_outputs* pending,
+                                                         const prefetched_inputs* prefetched, bool check_signatures )
     {
        try {
            FC_ASSERT( trx.inputs.size() || trx.outputs.size() );
@@ -953,8 +1713,9 @@ namespace bts { namespace blockchain {
            }
            */
 
-           trx_validation_state vstate( trx, this ); 
+           trx_validation_state vstate( trx, this, true, -1, keys, pending, prefetched ); 
            vstate.allow_short_long_matching = is_market;
+           vstate.check_signatures          = check_signatures;
            vstate.prev_block_id1 = get_stake();
            vstate.prev_block_id2 = get_stake2();
            vstate.validate();
@@ -989,16 +1750,43 @@ namespace bts { namespace blockchain {
 
 
 
-    trx_eval blockchain_db::evaluate_signed_transactions( const std::vector<signed_transaction>& trxs, uint64_t ignore_first_n_fees )
+    trx_eval blockchain_db::evaluate_signed_transactions( const std::vector<signed_transaction>& trxs, uint64_t ignore_first_n_fees,
+                                                          const std::vector<signature_keys>* recovered,
+                                                          const prefetched_inputs* prefetched, bool check_signatures )
     {
       try {
+        // the only part of validation that does not depend on the chain state, without
+        // check_signatures the few trxs that need their keys recover them when evaluated
+        std::vector<signature_keys> keys;
+        if( recovered )
+        {
+           FC_ASSERT( recovered->size() == trxs.size() );
+        }
+        else if( check_signatures )
+        {
+           keys      = my->_signature_pool.recover( trxs );
+           recovered = &keys;
+        }
+        auto keys_of = [&]( uint32_t n ) -> const signature_keys* { return recovered ? &(*recovered)[n] : nullptr; };
+
+        // nothing is written until the block is stored, so the inputs of every trx can be read up front
+        prefetched_inputs inputs;
+        if( !prefetched )
+        {
+           inputs     = prefetch_inputs( trxs );
+           prefetched = &inputs;
+        }
+
+        // outputs of the trxs evaluated so far, which those after them may spend
+        pending_outputs pending;
+
         trx_eval total_eval;
         for( uint32_t i = 0; i < trxs.size(); ++i )
         {
             // ignore fees for the market trxs and for the mining transaction... assuming there is a mining trx??
             if( i < ignore_first_n_fees )
             {
-               total_eval += evaluate_signed_transaction( trxs[i], true, true );
+               total_eval += evaluate_signed_transaction( trxs[i], true, true, keys_of(i), &pending, prefetched, check_signatures );
             }
             bts::address mining_addr;
             if( i == trxs.size() - 1 ) // last trx..
@@ -1015,7 +1803,7 @@ namespace bts { namespace blockchain {
                            FC_ASSERT( trxs.back().outputs.size() == 1 ); // only allowed 1 output
                            FC_ASSERT( trxs.back().outputs.back().as<claim_by_signature_output>().owner == mining_addr ); // must match
 
-                           auto prev_eval = evaluate_signed_transaction( trxs[i-1], true );
+                           auto prev_eval = evaluate_signed_transaction( trxs[i-1], true, false, keys_of(i-1), &pending, prefetched, check_signatures );
 
                            auto rew = (total_eval.fees.get_rounded_amount() * prev_eval.coindays_destroyed )/
                                                 total_eval.coindays_destroyed;
@@ -1028,14 +1816,15 @@ namespace bts { namespace blockchain {
                }
                if( mining_addr == bts::address() ) // process like normal
                {
-                  total_eval += evaluate_signed_transaction( trxs[i], false );
+                  total_eval += evaluate_signed_transaction( trxs[i], false, false, keys_of(i), &pending, prefetched, check_signatures );
                }
             }
             else 
             {
                total_eval += evaluate_signed_transaction( trxs[i], 
-                                    (i == trxs.size()-1) || (i < ignore_first_n_fees) );
+                                    (i == trxs.size()-1) || (i < ignore_first_n_fees), false, keys_of(i), &pending, prefetched, check_signatures );
             }
+            add_pending_outputs( pending, trxs[i], trxs[i].id() );
         }
         ilog( "summary: ${totals}", ("totals",total_eval) );
         return total_eval;
@@ -1061,7 +1850,8 @@ namespace bts { namespace blockchain {
     /**
      *  Attempts to append block b to the block chain with the given trxs.
      */
-    void blockchain_db::push_block( const trx_block& b )
+    void blockchain_db::push_block( const trx_block& b, const std::vector<signature_keys>* keys,
+                                    const prefetched_inputs* prefetched )
     {
       try {
         FC_ASSERT( b.version      == 0                                                         );
@@ -1088,6 +1878,20 @@ namespace bts { namespace blockchain {
         //validate_issuance( b, my->head_block /*aka new prev*/ );
         validate_unique_inputs( b.trxs );
 
+        // only the checkpoint and the blocks whose headers are known to lead to it are
+        // trusted, the height alone does not prove a block is on the checkpoint's chain
+        bool check_signatures = true;
+        if( my->assume_valid )
+        {
+           const auto& checkpoint = *my->assume_valid;
+           if( b.block_num == checkpoint.checkpoint_num() )
+           {
+              FC_ASSERT( b.id() == checkpoint.ids.back(), "block ${n} does not match the assume valid checkpoint ${id}",
+                         ("n",b.block_num)("id",checkpoint.ids.back()) );
+           }
+           check_signatures = !checkpoint.covers( b.block_num, b.id() );
+        }
+
         std::vector<price_point> order_stats;
         // the order matching must be deterministic and the first set of transactions in 
         // every block.
@@ -1099,10 +1903,15 @@ namespace bts { namespace blockchain {
         }
 
         // evaluate all trx and sum the results
-        trx_eval total_eval = evaluate_signed_transactions( b.trxs, matched.size() );
+        trx_eval total_eval = evaluate_signed_transactions( b.trxs, matched.size(), keys, prefetched, check_signatures );
         
         wlog( "total_fees: ${tf}", ("tf", total_eval.fees ) );
 
+        db::write_batch  batch;
+        db::undo_journal undo;
+        batch.record_undo( my->blocks.get_database()->get_db(), &undo );
+        my->join( batch );
+
         my->store( b );
 
         for( auto pt : order_stats )
@@ -1111,19 +1920,139 @@ namespace bts { namespace blockchain {
         }
 
         my->blk_id2num.store( b.id(), b.block_num );
+        my->prune( b );
+
+        my->block_undo.store( b.block_num, undo.entries() );
+        if( b.block_num >= BLOCKCHAIN_UNDO_BLOCKS && my->block_undo.exists( b.block_num - BLOCKCHAIN_UNDO_BLOCKS ) )
+        {
+           my->block_undo.remove( b.block_num - BLOCKCHAIN_UNDO_BLOCKS );
+        }
+
+        batch.commit();
+
+        my->head_block    = b;
+        my->head_block_id = b.id();
+        if( my->prune_depth )
+        {
+           my->archive.remove_unused_segments( b.block_num );
+        }
         
       } FC_RETHROW_EXCEPTIONS( warn, "unable to push block", ("b", b) );
     }
 
     /**
-     *  Removes the top block from the stack and marks all spent outputs as 
-     *  unspent.
+     *  Removes the top block from the stack by restoring the undo record
+     *  written when it was pushed, in time proportional to the block size.
      */
     void blockchain_db::pop_block( full_block& b, std::vector<signed_transaction>& trxs )
-    {
-       FC_ASSERT( !"TODO: implement pop_block" );
-    }
+    { try {
+       uint32_t block_num = head_block_num();
+       FC_ASSERT( block_num != trx_num::invalid_block_id, "there are no blocks to pop" );
+
+       auto undo = my->block_undo.fetch_optional( block_num );
+       FC_ASSERT( undo, "block ${n} is too old to be popped", ("n",block_num) );
+
+       trx_block popped = my->fetch_trx_block( block_num, db::snapshot_ptr() );
+
+       // restoring the prior value of every key the block wrote also reverts the
+       // spent outputs, market orders, depth and price history it changed
+       db::write_batch batch;
+       db::undo_journal::revert( *undo, batch, my->blocks.get_database()->get_db() );
+       my->block_undo.join( batch );
+       my->block_undo.remove( block_num );
+       batch.commit();
+       my->clear_caches();
+
+       if( block_num == 0 )
+       {
+          my->head_block    = trx_block();
+          my->head_block_id = block_id_type();
+       }
+       else
+       {
+          my->head_block    = trx_block( my->blocks.fetch( block_num - 1 ) );
+          my->head_block_id = my->head_block.id();
+       }
+
+       b    = popped;
+       trxs = std::move( popped.trxs );
+    } FC_RETHROW_EXCEPTIONS( warn, "unable to pop block" ) }
+
+
+    void blockchain_db::export_state( const fc::path& file )
+    { try {
+       uint32_t head = head_block_num();
+       FC_ASSERT( head != INVALID_BLOCK_NUM, "there is no chain state to export" );
+       auto snap = my->blocks.get_database()->create_snapshot();
+
+       db::state_file_writer out( file );
+       out.write( std::string( BLOCKCHAIN_STATE_FILE_MAGIC ) );
+       out.write( uint32_t( BLOCKCHAIN_STATE_FILE_VERSION ) );
+       out.write( head );
+       out.write( my->head_block_id );
+
+       // only the headers the next blocks are validated and generated against
+       uint32_t first = head < BLOCKCHAIN_STATE_FILE_HEADERS ? 0 : head - BLOCKCHAIN_STATE_FILE_HEADERS + 1;
+       out.write( std::string( "blocks" ) );
+       for( auto itr = my->blocks.lower_bound( first, snap ); itr.valid(); ++itr )
+       {
+          out.write( true );
+          out.write( itr.key() );
+          out.write( itr.value() );
+       }
+       out.write( false );
+
+       auto trxs    = db::write_section( out, "trx_id2num", my->trx_id2num, snap );
+       auto outputs = db::write_section( out, "unspent", my->unspent, snap );
+       my->_market_db.export_state( out, snap );
+       out.finish();
+
+       ilog( "exported the chain state at block ${n} with ${trxs} trxs and ${outputs} unspent outputs to ${file}",
+             ("n",head)("trxs",trxs)("outputs",outputs)("file",file) );
+    } FC_RETHROW_EXCEPTIONS( warn, "unable to export the chain state to ${file}", ("file",file) ) }
 
+    void blockchain_db::import_state( const fc::path& file )
+    { try {
+       FC_ASSERT( head_block_num() == INVALID_BLOCK_NUM, "the chain state can only be imported into an empty chain" );
+
+       db::state_file_reader in( file );
+       std::string magic;
+       uint32_t    version = 0;
+       in.read( magic );
+       FC_ASSERT( magic == BLOCKCHAIN_STATE_FILE_MAGIC, "${file} is not a chain state file", ("file",file) );
+       in.read( version );
+       FC_ASSERT( version == BLOCKCHAIN_STATE_FILE_VERSION, "unsupported chain state file version ${v}", ("v",version) );
+
+       uint32_t      head = INVALID_BLOCK_NUM;
+       block_id_type head_id;
+       in.read( head );
+       in.read( head_id );
+
+       // the block ids are not in the file, they are indexed from the headers
+       auto headers = db::read_section( in, "blocks", my->blocks );
+       db::write_batch batch;
+       my->blk_id2num.join( batch );
+       for( auto itr = my->blocks.begin(); itr.valid(); ++itr )
+       {
+          my->blk_id2num.store( itr.value().id(), itr.key() );
+       }
+       batch.commit();
+
+       auto trxs    = db::read_section( in, "trx_id2num", my->trx_id2num );
+       auto outputs = db::read_section( in, "unspent", my->unspent );
+       my->_market_db.import_state( in );
+       my->clear_caches();
+       // the owners of the outputs are not in the file either
+       my->update_address_index();
+
+       my->blocks.last( my->head_block.block_num, my->head_block );
+       FC_ASSERT( headers > 0 && my->head_block.block_num == head && my->head_block.id() == head_id,
+                  "the head block of ${file} does not match its header", ("file",file) );
+       my->head_block_id = head_id;
+
+       ilog( "imported the chain state at block ${n} with ${trxs} trxs and ${outputs} unspent outputs from ${file}",
+             ("n",head)("trxs",trxs)("outputs",outputs)("file",file) );
+    } FC_RETHROW_EXCEPTIONS( warn, "unable to import the chain state from ${file}", ("file",file) ) }
 
     uint64_t blockchain_db::current_bitshare_supply()
     {
@@ -1133,18 +2062,77 @@ namespace bts { namespace blockchain {
     /**
      *  Generates transactions that match all compatiable bids, asks, and shorts for
      *  all possible asset combinations and returns the result.
+     *
+     *  Each pair is matched on one of the order matching threads against a copy of its
+     *  order book and a snapshot of the outputs, so blocks pushed while the calling
+     *  thread waits do not change what the pairs see.
      */
     std::vector<signed_transaction> blockchain_db::match_orders( std::vector<price_point>* stats )
     { try {
-       std::vector<signed_transaction> matched;
+       std::vector<std::pair<asset::type,asset::type> > pairs;
        for( uint32_t base = asset::bts; base < asset::count; ++base )
        {
           for( uint32_t quote = base+1; quote < asset::count; ++quote )
           {
-              price_point pt;
-              my->match_orders( matched, asset::type(quote), asset::type(base), pt );
-              if( stats ) stats->push_back( pt );
+              pairs.push_back( std::make_pair( asset::type(quote), asset::type(base) ) );
+          }
+       }
+
+       // every pair only reads its own orders, taken together with the snapshot before any thread starts
+       auto snap = my->blocks.get_database()->create_snapshot();
+       std::vector<detail::blockchain_db_impl::match_view> views;
+       views.reserve( pairs.size() );
+       for( auto itr = pairs.begin(); itr != pairs.end(); ++itr )
+       {
+          views.push_back( my->get_match_view( itr->first, itr->second, snap ) );
+       }
+
+       std::vector<std::vector<signed_transaction> > pair_matched( pairs.size() );
+       std::vector<price_point>                      pair_stats( pairs.size() );
+       auto run = [&]( size_t i )
+       {
+          my->match_orders( pair_matched[i], pairs[i].first, pairs[i].second, pair_stats[i], views[i] );
+       };
+
+       uint32_t num_threads = my->match_threads ? my->match_threads : std::thread::hardware_concurrency();
+       num_threads = std::min<size_t>( std::max( 1u, num_threads ), pairs.size() );
+       if( num_threads <= 1 )
+       {
+          for( size_t i = 0; i < pairs.size(); ++i ) run( i );
+       }
+       else
+       {
+          while( my->_match_threads.size() < num_threads )
+          {
+             my->_match_threads.push_back( std::unique_ptr<fc::thread>( new fc::thread( "order_matching" ) ) );
+          }
+          std::vector<fc::future<void> > done;
+          done.reserve( pairs.size() );
+          for( size_t i = 0; i < pairs.size(); ++i )
+          {
+             done.push_back( my->_match_threads[i % num_threads]->async( [=,&run](){ run( i ); } ) );
+          }
+          // wait for every pair before rethrowing, they reference this frame
+          fc::exception_ptr error;
+          for( auto itr = done.begin(); itr != done.end(); ++itr )
+          {
+             try {
+                itr->wait();
+             }
+             catch ( const fc::exception& e )
+             {
+                if( !error ) error = e.dynamic_copy_exception();
+             }
           }
+          if( error ) error->dynamic_rethrow_exception();
+       }
+
+       // merged in pair order so that every node generates the same transactions
+       std::vector<signed_transaction> matched;
+       for( size_t i = 0; i < pairs.size(); ++i )
+       {
+          matched.insert( matched.end(), pair_matched[i].begin(), pair_matched[i].end() );
+          if( stats ) stats->push_back( pair_stats[i] );
        }
        return matched;
     } FC_RETHROW_EXCEPTIONS( warn, "" ) }
@@ -1155,6 +2143,11 @@ namespace bts { namespace blockchain {
      *  filter out incompatible transactions (those that share the same inputs).
      */
     trx_block  blockchain_db::generate_next_block( const std::vector<signed_transaction>& in_trxs )
+    {
+       return generate_next_block( std::vector<hashed_transaction>( in_trxs.begin(), in_trxs.end() ) );
+    }
+
+    trx_block  blockchain_db::generate_next_block( const std::vector<hashed_transaction>& in_trxs )
     {
       try {
          std::vector<signed_transaction> trxs = match_orders();
@@ -1163,43 +2156,82 @@ namespace bts { namespace blockchain {
          std::vector<trx_stat>  stats;
          stats.reserve(in_trxs.size());
          ilog( "." );
-         for( uint32_t i = 0; i < in_trxs.size(); ++i )
+         // a single invalid signature must not stop the other candidates from being considered
+         std::vector<signature_keys> keys;
+         try {
+            keys = my->_signature_pool.recover( in_trxs );
+         }
+         catch ( const fc::exception& e )
+         {
+            wlog( "falling back to recovering signatures one trx at a time\n ${e}", ("e",e.to_detail_string()) );
+         }
+         for( uint32_t i = 0; i < keys.size(); ++i )
          {
-            ilog( "trx: ${t} signed by ${s}", ( "t",in_trxs[i])("s",in_trxs[i].get_signed_addresses() ) );
+            ilog( "trx: ${t} signed by ${s}", ( "t",in_trxs[i].trx())("s",keys[i].addresses() ) );
          }
          ilog( "." );
          
+         std::vector<output_reference> refs;
+         for( auto trx = in_trxs.begin(); trx != in_trxs.end(); ++trx )
+         {
+            for( auto in = trx->trx().inputs.begin(); in != trx->trx().inputs.end(); ++in )
+            {
+               refs.push_back( in->output_ref );
+            }
+         }
+         auto prefetched = my->prefetch_inputs( std::move(refs) );
+
+         // outputs of the candidates evaluated so far, a candidate may spend those
+         // before it so chained trxs must be passed parent first
+         pending_outputs pending;
+         std::unordered_map<transaction_id_type,uint32_t> evaluated;
+         std::vector<std::vector<uint32_t> > parents( in_trxs.size() );
+
          // filter out all trx that generate coins from nothing or don't pay fees
          for( uint32_t i = 0; i < in_trxs.size(); ++i )
          {
             try 
             {
                 trx_stat s;
-                s.eval = evaluate_signed_transaction( in_trxs[i] );
+                // the minimum fee is checked below against the cached size
+                s.eval = evaluate_signed_transaction( in_trxs[i], true, false, keys.empty() ? nullptr : &keys[i], &pending, &prefetched );
                 ilog( "eval: ${eval}", ("eval",s.eval) );
 
                // TODO: enforce fees
                 if( s.eval.fees.get_rounded_amount() < (get_fee_rate() * in_trxs[i].size()).get_rounded_amount() )
                 {
                   wlog( "ignoring transaction ${trx} because it doesn't pay minimum fee ${f}\n\n state: ${s}", 
-                        ("trx",in_trxs[i])("s",s.eval)("f", get_fee_rate()*in_trxs[i].size()) );
+                        ("trx",in_trxs[i].trx())("s",s.eval)("f", get_fee_rate()*in_trxs[i].size()) );
                   continue;
                 }
-                s.trx_idx = i + trxs.size(); // market trx will go first...
+                s.trx_idx  = i;
+                s.fee_rate = s.eval.fee_rate( in_trxs[i].size() );
                 stats.push_back( s );
+
+                const signed_transaction& trx = in_trxs[i].trx();
+                for( auto in = trx.inputs.begin(); in != trx.inputs.end(); ++in )
+                {
+                   auto parent = evaluated.find( in->output_ref.trx_hash );
+                   if( parent != evaluated.end() ) parents[i].push_back( parent->second );
+                }
+                add_pending_outputs( pending, trx, in_trxs[i].id() );
+                evaluated[in_trxs[i].id()] = i;
             } 
             catch ( const fc::exception& e )
             {
-               wlog( "unable to use trx ${t}\n ${e}", ("t", in_trxs[i] )("e",e.to_detail_string()) );
+               wlog( "unable to use trx ${t}\n ${e}", ("t", in_trxs[i].trx() )("e",e.to_detail_string()) );
             }
          }
          ilog( "." );
 
-         // order the trx by fees (don't sort the market orders which are added next)
-         std::sort( stats.begin(), stats.end() ); 
+         // order the trx by fee rate (don't sort the market orders which are added next),
+         // stable so that a mempool block template keeps its order
+         std::stable_sort( stats.begin(), stats.end() ); 
+         std::vector<const trx_stat*> stat_of( in_trxs.size(), nullptr );
          for( uint32_t i = 0; i < stats.size(); ++i )
          {
            ilog( "sort ${i} => ${n}", ("i", i)("n",stats[i]) );
+           stat_of[stats[i].trx_idx] = &stats[i];
          }
          ilog( "." );
 
@@ -1213,55 +2245,70 @@ namespace bts { namespace blockchain {
                           "output can only be referenced once", ("in",in)("output_ref",itr->inputs[in].output_ref) )
             }
          }
-         trxs.insert( trxs.end(), in_trxs.begin(), in_trxs.end() );
          ilog( "trxs: ${t}", ("t",trxs) );
 
          // calculate the block size as we go
-         fc::datastream<size_t>  block_size;
-         uint32_t conflicts = 0;
+         size_t   block_size = 0;
 
          asset    total_fees;
          uint64_t total_cdd = 0;
          uint64_t invalid_cdd = 0;
          uint64_t total_spent  = 0;
 
-         ilog( "." );
-         // insert other transactions
-         for( size_t i = 0; i < stats.size(); ++i )
+         // candidates in the order they go in the block, every trx after the trxs it spends
+         std::vector<uint32_t>  included;
+         enum { unvisited, added, skipped };
+         std::vector<uint8_t>   state( in_trxs.size(), unvisited );
+
+         std::function<bool(uint32_t)> include = [&]( uint32_t i ) -> bool
          {
-            const signed_transaction& trx = trxs[stats[i].trx_idx]; 
-            for( size_t in = 0; in < trx.inputs.size(); ++in )
+            if( state[i] != unvisited ) return state[i] == added;
+            state[i] = skipped;
+            for( auto p = parents[i].begin(); p != parents[i].end(); ++p )
             {
-               ilog( "input ${in}", ("in", trx.inputs[in]) );
+               if( !include( *p ) ) return false;
+            }
 
-               if( !consumed_outputs.insert( trx.inputs[in].output_ref ).second )
+            const signed_transaction& trx = in_trxs[i].trx(); 
+            for( size_t in = 0; in < trx.inputs.size(); ++in )
+            {
+               if( consumed_outputs.find( trx.inputs[in].output_ref ) != consumed_outputs.end() )
                {
-                    stats[i].trx_idx = uint16_t(-1); // mark it to be skipped, input conflict
-                    wlog( "INPUT CONFLICT!" );
-                    ++conflicts;
-                    break; //in = trx.inputs.size(); // exit inner loop
+                  wlog( "INPUT CONFLICT! ${in}", ("in", trx.inputs[in]) );
+                  return false;
                }
             }
-            if( stats[i].trx_idx != uint16_t(-1) )
+            if( block_size + in_trxs[i].size() > MAX_BLOCK_TRXS_SIZE )
             {
-               fc::raw::pack( block_size, trx );
-               if( block_size.tellp() > MAX_BLOCK_TRXS_SIZE )
-               {
-                  stats.resize(i); // this trx put us over the top, we can stop processing
-                                   // the other trxs.
-                  break;
-               }
-               FC_ASSERT( i < stats.size() );
-               ilog( "total fees ${tf} += ${fees},  total cdd ${tcdd} += ${cdd}", 
-                     ("tf", total_fees)
-                     ("fees",stats[i].eval.fees)
-                     ("tcdd",total_cdd)
-                     ("cdd",stats[i].eval.coindays_destroyed) );
-               total_fees   += stats[i].eval.fees;
-               total_cdd    += stats[i].eval.coindays_destroyed;
-               invalid_cdd  += stats[i].eval.invalid_coindays_destroyed;
-               total_spent  += stats[i].eval.total_spent;
+               return false;
             }
+            for( size_t in = 0; in < trx.inputs.size(); ++in )
+            {
+               consumed_outputs.insert( trx.inputs[in].output_ref );
+            }
+            block_size += in_trxs[i].size();
+
+            const trx_eval& eval = stat_of[i]->eval;
+            ilog( "total fees ${tf} += ${fees},  total cdd ${tcdd} += ${cdd}", 
+                  ("tf", total_fees)
+                  ("fees",eval.fees)
+                  ("tcdd",total_cdd)
+                  ("cdd",eval.coindays_destroyed) );
+            total_fees   += eval.fees;
+            total_cdd    += eval.coindays_destroyed;
+            invalid_cdd  += eval.invalid_coindays_destroyed;
+            total_spent  += eval.total_spent;
+
+            included.push_back( i );
+            state[i] = added;
+            return true;
+         };
+
+         ilog( "." );
+         // insert other transactions, pulling in the parents of each one first
+         for( size_t i = 0; i < stats.size(); ++i )
+         {
+            include( stats[i].trx_idx );
          }
          ilog( "." );
 
@@ -1275,18 +2322,15 @@ namespace bts { namespace blockchain {
         // wlog( "miner fees: ${t}", ("t", miner_fees) );
 
          trx_block new_blk;
-         new_blk.trxs.reserve( 1 + stats.size() - conflicts + num_orders ); 
+         new_blk.trxs.reserve( 1 + included.size() + num_orders ); 
 
          // add all orders first
          new_blk.trxs.insert( new_blk.trxs.begin(), trxs.begin(), trxs.begin() + num_orders );
 
          // add all other transactions to the block
-         for( size_t i = 0; i < stats.size(); ++i )
+         for( auto itr = included.begin(); itr != included.end(); ++itr )
          {
-           if( stats[i].trx_idx != uint16_t(-1) )
-           {
-             new_blk.trxs.push_back( trxs[ stats[i].trx_idx] );
-           }
+           new_blk.trxs.push_back( in_trxs[*itr].trx() );
          }
 
          new_blk.timestamp                 = fc::time_point::now();
@@ -1328,33 +2372,12 @@ namespace bts { namespace blockchain {
 
     market_data blockchain_db::get_market( asset::type quote, asset::type base )
     {
-       market_data d;
-       auto bids = my->_market_db.get_bids( quote, base );
-       for( auto itr = bids.begin(); itr != bids.end(); ++itr )
-       {
-           auto working_bid = my->get_output( itr->location );
-           if( working_bid.claim_func == claim_by_long )
-           {
-              claim_by_long_output long_claim = working_bid.as<claim_by_long_output>();
-              d.shorts.push_back( short_data( long_claim.ask_price, working_bid.amount.get_rounded_amount()  ) );
-              d.bids.push_back( bid_data( long_claim.ask_price, (working_bid.amount*long_claim.ask_price).get_rounded_amount()) );
-              d.bids.back().is_short = true;
-           }
-           else
-           {
-              claim_by_bid_output bid_claim = working_bid.as<claim_by_bid_output>();
-              d.bids.push_back( bid_data( bid_claim.ask_price, working_bid.amount.get_rounded_amount() ) );
-           }
-       }
+       return my->get_market( quote, base, db::snapshot_ptr() );
+    }
 
-       auto asks = my->_market_db.get_asks( quote, base );
-       for( auto itr = asks.begin(); itr != asks.end(); ++itr )
-       {
-           auto working_ask = my->get_output( itr->location );
-           claim_by_bid_output ask_claim = working_ask.as<claim_by_bid_output>();
-           d.asks.push_back( ask_data( ask_claim.ask_price, working_ask.amount.get_rounded_amount() ) );
-       }
-       return d;
+    order_book_summary blockchain_db::get_order_book( asset::type quote, asset::type base, uint32_t levels )
+    {
+       return my->_market_db.get_order_book( quote, base, levels );
     }
 
     std::string blockchain_db::dump_market( asset::type quote, asset::type base )
@@ -1412,11 +2435,137 @@ namespace bts { namespace blockchain {
                                                 fc::time_point_sec from, fc::time_point_sec to, 
                                                 uint32_t blocks_per_point  )
     { try {
-       FC_ASSERT( quote != base );
-       if( quote > base ) std::swap( quote, base );
-       return my->_market_db.get_history( quote, base, from, to, blocks_per_point );
+       return my->get_market_history( quote, base, from, to, blocks_per_point, db::snapshot_ptr() );
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("quote",quote)("base",base)("from",from)("to",to)("blocks_per_point",blocks_per_point) ) }
+
+    std::vector<price_point> blockchain_db::get_market_candles( asset::type quote, asset::type base, uint32_t resolution,
+                                                                fc::time_point_sec from, fc::time_point_sec to )
+    { try {
+       return my->get_market_candles( quote, base, resolution, from, to, db::snapshot_ptr() );
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("quote",quote)("base",base)("resolution",resolution)("from",from)("to",to) ) }
+
+    chain_snapshot_ptr blockchain_db::get_snapshot()
+    { try {
+       FC_ASSERT( my->blocks.get_database() );
+       return chain_snapshot_ptr( new chain_snapshot( my.get(), my->blocks.get_database()->create_snapshot(),
+                                                      head_block_num(), my->head_block_id ) );
+    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+    chain_snapshot::chain_snapshot( detail::blockchain_db_impl* chain, const db::snapshot_ptr& snap,
+                                    uint32_t head_num, const block_id_type& head_id )
+    :_chain(chain),_snapshot(snap),_head_block_num(head_num),_head_block_id(head_id){}
+
+    uint32_t      chain_snapshot::head_block_num()const { return _head_block_num; }
+    block_id_type chain_snapshot::head_block_id()const  { return _head_block_id;  }
+
+    trx_num    chain_snapshot::fetch_trx_num( const uint160& trx_id )const
+    { try {
+       return _chain->trx_id2num.fetch( trx_id, _snapshot );
+    } FC_RETHROW_EXCEPTIONS( warn, "trx_id ${trx_id}", ("trx_id",trx_id) ) }
+
+    meta_trx   chain_snapshot::fetch_trx( const trx_num& trx_id )const
+    { try {
+       meta_trx trx;
+       _chain->fetch_trx( trx_id, trx, _snapshot );
+       return trx;
+    } FC_RETHROW_EXCEPTIONS( warn, "trx_id ${trx_id}", ("trx_id",trx_id) ) }
+
+    void       chain_snapshot::fetch_trx( const trx_num& trx_id, meta_trx& trx )const
+    { try {
+       _chain->fetch_trx( trx_id, trx, _snapshot );
+    } FC_RETHROW_EXCEPTIONS( warn, "trx_id ${trx_id}", ("trx_id",trx_id) ) }
+
+    signed_transaction chain_snapshot::fetch_transaction( const transaction_id_type& id )const
+    { try {
+       return fetch_trx( fetch_trx_num( id ) );
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("id",id) ) }
+
+    uint32_t     chain_snapshot::fetch_block_num( const block_id_type& block_id )const
+    { try {
+       return _chain->blk_id2num.fetch( block_id, _snapshot );
+    } FC_RETHROW_EXCEPTIONS( warn, "block id: ${block_id}", ("block_id",block_id) ) }
+
+    block_header chain_snapshot::fetch_block( uint32_t block_num )const
+    { try {
+       return _chain->blocks.fetch( block_num, _snapshot );
+    } FC_RETHROW_EXCEPTIONS( warn, "block ${block}", ("block",block_num) ) }
+
+    full_block   chain_snapshot::fetch_full_block( uint32_t block_num )const
+    {
+       full_block fb;
+       fetch_full_block( block_num, fb );
+       return fb;
+    }
+
+    void         chain_snapshot::fetch_full_block( uint32_t block_num, full_block& blk )const
+    { try {
+       _chain->fetch_full_block( block_num, blk, _snapshot );
+    } FC_RETHROW_EXCEPTIONS( warn, "block ${block}", ("block",block_num) ) }
+
+    trx_block    chain_snapshot::fetch_trx_block( uint32_t block_num )const
+    { try {
+       return _chain->fetch_trx_block( block_num, _snapshot );
+    } FC_RETHROW_EXCEPTIONS( warn, "block ${block}", ("block",block_num) ) }
+
+    std::vector<char> chain_snapshot::fetch_packed_trx_block( uint32_t block_num )const
+    { try {
+       return _chain->fetch_packed_trx_block( block_num, _snapshot );
+    } FC_RETHROW_EXCEPTIONS( warn, "block ${block}", ("block",block_num) ) }
+
+    prefetched_inputs chain_snapshot::prefetch_inputs( const std::vector<signed_transaction>& trxs )const
+    { try {
+       std::vector<output_reference> refs;
+       for( auto trx = trxs.begin(); trx != trxs.end(); ++trx )
+       {
+          for( auto in = trx->inputs.begin(); in != trx->inputs.end(); ++in )
+          {
+             refs.push_back( in->output_ref );
+          }
+       }
+       std::sort( refs.begin(), refs.end() );
+       refs.erase( std::unique( refs.begin(), refs.end() ), refs.end() );
+
+       prefetched_inputs result;
+       result.reserve( refs.size() );
+       _chain->unspent.visit_sorted( refs,
+          [&]( size_t i, const db::level_map<output_reference,unspent_output>::value_view& v ){ v.unpack( result[refs[i]] ); },
+          _snapshot );
+       return result;
+    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+    std::vector<owned_output> chain_snapshot::fetch_unspent_outputs( const address& owner )const
+    { try {
+       return _chain->fetch_owned( _chain->address_outputs, owner, _snapshot );
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("owner",owner) ) }
+
+    std::vector<owned_output> chain_snapshot::fetch_unspent_outputs( const pts_address& owner )const
+    { try {
+       return _chain->fetch_owned( _chain->pts_address_outputs, owner, _snapshot );
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("owner",owner) ) }
+
+    uint64_t     chain_snapshot::get_market_depth( asset::type quote )const
+    {
+       return _chain->_market_db.get_depth( quote, _snapshot );
+    }
+
+    market_data  chain_snapshot::get_market( asset::type quote, asset::type base )const
+    { try {
+       return _chain->get_market( quote, base, _snapshot );
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("quote",quote)("base",base) ) }
+
+    std::vector<price_point> chain_snapshot::get_market_history( asset::type quote, asset::type base,
+                                                                 fc::time_point_sec from, fc::time_point_sec to,
+                                                                 uint32_t blocks_per_point )const
+    { try {
+       return _chain->get_market_history( quote, base, from, to, blocks_per_point, _snapshot );
     } FC_RETHROW_EXCEPTIONS( warn, "", ("quote",quote)("base",base)("from",from)("to",to)("blocks_per_point",blocks_per_point) ) }
 
+    std::vector<price_point> chain_snapshot::get_market_candles( asset::type quote, asset::type base, uint32_t resolution,
+                                                                 fc::time_point_sec from, fc::time_point_sec to )const
+    { try {
+       return _chain->get_market_candles( quote, base, resolution, from, to, _snapshot );
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("quote",quote)("base",base)("resolution",resolution)("from",from)("to",to) ) }
+
 }  } // bts::blockchain
 
 
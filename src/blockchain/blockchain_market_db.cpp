@@ -1,10 +1,14 @@
 #include <bts/blockchain/blockchain_market_db.hpp>
 #include <bts/blockchain/blockchain_db.hpp>
+#include <bts/blockchain/order_book.hpp>
 #include <bts/db/level_pod_map.hpp>
+#include <bts/db/state_file.hpp>
+#include <bts/db/write_batch.hpp>
 #include <fc/reflect/variant.hpp>
 #include <fc/log/logger.hpp>
 
 #include <algorithm>
+#include <map>
 
 struct price_point_key
 {
@@ -14,13 +18,13 @@ struct price_point_key
 
    price_point_key( bts::blockchain::asset::type q, bts::blockchain::asset::type b, fc::time_point_sec t )
    :quote(q),base(b),timestamp(t){}
+   price_point_key():quote(bts::blockchain::asset::bts),base(bts::blockchain::asset::bts){}
 
    friend bool operator < ( const price_point_key& a, const price_point_key& b )
    {
-      if( a.quote >= b.quote )         return false;
-      if( a.base  >= b.base  )         return false;
-      if( a.timestamp >= b.timestamp ) return false;
-      return true;
+      if( a.quote != b.quote ) return a.quote < b.quote;
+      if( a.base  != b.base  ) return a.base  < b.base;
+      return a.timestamp < b.timestamp;
    }
 
    friend bool operator == ( const price_point_key& a, const price_point_key& b )
@@ -30,6 +34,36 @@ struct price_point_key
 };
 
 FC_REFLECT( price_point_key, (quote)(base)(timestamp) )
+BTS_DB_ORDERED_KEY( price_point_key, (quote)(base)(timestamp) )
+
+/** the candle of a pair that covers @a resolution seconds from @a start */
+struct candle_key
+{
+   bts::blockchain::asset::type quote;
+   bts::blockchain::asset::type base;
+   uint32_t                     resolution;
+   fc::time_point_sec           start;
+
+   candle_key( bts::blockchain::asset::type q, bts::blockchain::asset::type b, uint32_t r, fc::time_point_sec t )
+   :quote(q),base(b),resolution(r),start(t){}
+   candle_key():quote(bts::blockchain::asset::bts),base(bts::blockchain::asset::bts),resolution(0){}
+
+   friend bool operator < ( const candle_key& a, const candle_key& b )
+   {
+      if( a.quote != b.quote )           return a.quote < b.quote;
+      if( a.base  != b.base  )           return a.base  < b.base;
+      if( a.resolution != b.resolution ) return a.resolution < b.resolution;
+      return a.start < b.start;
+   }
+
+   friend bool operator == ( const candle_key& a, const candle_key& b )
+   {
+      return a.quote == b.quote && a.base == b.base && a.resolution == b.resolution && a.start == b.start;
+   }
+};
+
+FC_REFLECT( candle_key, (quote)(base)(resolution)(start) )
+BTS_DB_ORDERED_KEY( candle_key, (quote)(base)(resolution)(start) )
 
 struct depth_stats
 {
@@ -46,16 +80,194 @@ namespace bts { namespace blockchain {
 
   namespace detail
   {
-     class market_db_impl
+     /** a change to the order books made while a batch is joined */
+     struct book_change
+     {
+        enum kind { insert_bid, insert_ask, remove_bid, remove_ask };
+
+        book_change( kind k, const market_order& m, uint64_t a = 0 ):op(k),order(m),amount(a){}
+
+        kind          op;
+        market_order  order;
+        uint64_t      amount; ///< of an inserted order, read when it was inserted
+     };
+
+     /**
+      *  The order books and depth stats mirror what has been committed to the maps,
+      *  changes made while a batch is joined are held back until it commits so that
+      *  a block that fails to apply leaves them untouched.
+      */
+     class market_db_impl : public db::batch_participant
      {
         public:
+           market_db_impl():_batch(nullptr){}
+           ~market_db_impl()
+           {
+              if( _batch ) _batch->leave( this );
+           }
+
            db::level_pod_map<market_order,uint32_t> _bids;
            db::level_pod_map<market_order,uint32_t> _asks;
            db::level_pod_map<margin_call,uint32_t>  _calls;
 
            db::level_pod_map<price_point_key, price_point> _price_history;
+           /** the price points rolled up at each candle_resolution */
+           db::level_map<candle_key, price_point>          _candles;
 
            db::level_pod_map<asset::type,depth_stats> _depth;
+
+           /** the committed bids and asks by (quote, base) */
+           std::map<std::pair<uint8_t,uint8_t>,order_book> _books;
+           /** the committed depth stats by quote */
+           std::map<uint8_t,depth_stats>                   _depth_stats;
+
+           db::write_batch*                                _batch;
+           std::vector<book_change>                        _pending_orders;
+           std::map<uint8_t,depth_stats>                   _pending_depth;
+
+           market_db::order_amount_func                    _order_amount;
+
+           uint64_t order_amount( const market_order& m )const
+           {
+              return _order_amount ? _order_amount( m ) : 0;
+           }
+
+           const order_book* find_book( asset::type quote, asset::type base )const
+           {
+              auto itr = _books.find( std::make_pair( uint8_t(quote), uint8_t(base) ) );
+              return itr == _books.end() ? nullptr : &itr->second;
+           }
+
+           void apply( const book_change& c )
+           {
+              auto key  = std::make_pair( uint8_t(c.order.quote_unit.value), uint8_t(c.order.base_unit.value) );
+              auto itr  = _books.find( key );
+              if( itr == _books.end() )
+              {
+                 itr = _books.insert( std::make_pair( key, order_book( c.order.quote_unit, c.order.base_unit ) ) ).first;
+              }
+              switch( c.op )
+              {
+                 case book_change::insert_bid: itr->second.insert_bid( c.order, c.amount ); break;
+                 case book_change::insert_ask: itr->second.insert_ask( c.order, c.amount ); break;
+                 case book_change::remove_bid: itr->second.remove_bid( c.order ); break;
+                 case book_change::remove_ask: itr->second.remove_ask( c.order ); break;
+              }
+              if( itr->second.empty() ) _books.erase( itr );
+           }
+
+           void change_book( book_change::kind op, const market_order& m )
+           {
+              // read now, the output may be spent by the time a batch commits
+              uint64_t amount = 0;
+              if( op == book_change::insert_bid || op == book_change::insert_ask ) amount = order_amount( m );
+
+              if( _batch ) _pending_orders.push_back( book_change( op, m, amount ) );
+              else         apply( book_change( op, m, amount ) );
+           }
+
+           /** the stats of @param quote including those written to the joined batch */
+           fc::optional<depth_stats> fetch_depth( asset::type quote )const
+           {
+              fc::optional<depth_stats> stat;
+              auto pending = _pending_depth.find( quote );
+              if( pending != _pending_depth.end() )
+              {
+                 stat = pending->second;
+                 return stat;
+              }
+              auto itr = _depth_stats.find( quote );
+              if( itr != _depth_stats.end() ) stat = itr->second;
+              return stat;
+           }
+
+           void store_depth( asset::type quote, const depth_stats& stat )
+           {
+              _depth.store( quote, stat );
+              if( _batch ) _pending_depth[quote] = stat;
+              else         _depth_stats[quote]   = stat;
+           }
+
+           /** reads the books and depth stats back from the maps */
+           void load()
+           {
+              _books.clear();
+              _depth_stats.clear();
+              _pending_orders.clear();
+              _pending_depth.clear();
+
+              market_order m;
+              for( auto itr = _bids.begin(); itr.valid(); ++itr )
+              {
+                 itr.key( m );
+                 apply( book_change( book_change::insert_bid, m, order_amount( m ) ) );
+              }
+              for( auto itr = _asks.begin(); itr.valid(); ++itr )
+              {
+                 itr.key( m );
+                 apply( book_change( book_change::insert_ask, m, order_amount( m ) ) );
+              }
+              asset::type quote;
+              for( auto itr = _depth.begin(); itr.valid(); ++itr )
+              {
+                 itr.key( quote );
+                 _depth_stats[quote] = itr.value();
+              }
+
+              if( !_candles.begin().valid() && _price_history.begin().valid() )
+              {
+                 build_candles();
+              }
+           }
+
+           void add_to_candles( const price_point& pt )
+           {
+              static const uint32_t resolutions[] = { hourly_candles, daily_candles, weekly_candles };
+              for( uint32_t i = 0; i < sizeof(resolutions)/sizeof(resolutions[0]); ++i )
+              {
+                 auto start = fc::time_point_sec( pt.from_time.sec_since_epoch() - pt.from_time.sec_since_epoch() % resolutions[i] );
+                 candle_key key( pt.quote_volume.unit, pt.base_volume.unit, resolutions[i], start );
+                 auto candle = _candles.fetch_optional( key );
+                 if( candle ) *candle += pt;
+                 else         candle = pt;
+                 _candles.store( key, *candle );
+              }
+           }
+
+           /** rolls up the price history of a market written before it kept candles */
+           void build_candles()
+           { try {
+              ilog( "building the market history candles" );
+              db::write_batch batch;
+              _candles.join( batch );
+              for( auto itr = _price_history.begin(); itr.valid(); ++itr )
+              {
+                 add_to_candles( itr.value() );
+              }
+              batch.commit();
+           } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+           virtual void batch_committed()
+           {
+              for( auto itr = _pending_orders.begin(); itr != _pending_orders.end(); ++itr )
+              {
+                 apply( *itr );
+              }
+              for( auto itr = _pending_depth.begin(); itr != _pending_depth.end(); ++itr )
+              {
+                 _depth_stats[itr->first] = itr->second;
+              }
+              _pending_orders.clear();
+              _pending_depth.clear();
+              _batch = nullptr;
+           }
+
+           virtual void batch_discarded()
+           {
+              _pending_orders.clear();
+              _pending_depth.clear();
+              _batch = nullptr;
+           }
      };
 
   } // namespace detail
@@ -144,98 +356,175 @@ namespace bts { namespace blockchain {
      fc::create_directories( db_dir / "calls" );
      fc::create_directories( db_dir / "price_history" );
      fc::create_directories( db_dir / "depth" );
+     fc::create_directories( db_dir / "candles" );
 
      my->_bids.open( db_dir / "bids" );
      my->_asks.open( db_dir / "asks" );
      my->_calls.open( db_dir / "calls" );
      my->_price_history.open( db_dir / "price_history" );
      my->_depth.open( db_dir / "depth" );
+     my->_candles.open( db_dir / "candles" );
+     my->load();
   } FC_RETHROW_EXCEPTIONS( warn, "unable to open market db ${dir}", ("dir",db_dir) ) }
 
+  void market_db::open( const db::database_ptr& db )
+  { try {
+     my->_bids.open( db, "market.bids" );
+     my->_asks.open( db, "market.asks" );
+     my->_calls.open( db, "market.calls" );
+     my->_price_history.open( db, "market.price_history" );
+     my->_depth.open( db, "market.depth" );
+     my->_candles.open( db, "market.candles" );
+     my->load();
+  } FC_RETHROW_EXCEPTIONS( warn, "unable to open market db" ) }
+
+  void market_db::import_standalone( const fc::path& db_dir )
+  { try {
+     my->_bids.import_standalone( db_dir / "bids" );
+     my->_asks.import_standalone( db_dir / "asks" );
+     my->_calls.import_standalone( db_dir / "calls" );
+     my->_price_history.import_standalone( db_dir / "price_history" );
+     my->_depth.import_standalone( db_dir / "depth" );
+     if( fc::exists( db_dir ) ) fc::remove_all( db_dir );
+     my->load();
+  } FC_RETHROW_EXCEPTIONS( warn, "unable to import market db ${dir}", ("dir",db_dir) ) }
+
+  void market_db::close()
+  {
+     my->_bids.close();
+     my->_asks.close();
+     my->_calls.close();
+     my->_price_history.close();
+     my->_depth.close();
+     my->_candles.close();
+     my->_books.clear();
+     my->_depth_stats.clear();
+  }
+
+  void market_db::reload()
+  { try {
+     my->load();
+  } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+  void market_db::set_order_amounts( const order_amount_func& amount_of )
+  { try {
+     my->_order_amount = amount_of;
+     my->load();
+  } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+  void market_db::join( db::write_batch& batch )
+  {
+     my->_bids.join( batch );
+     my->_asks.join( batch );
+     my->_calls.join( batch );
+     my->_price_history.join( batch );
+     my->_depth.join( batch );
+     my->_candles.join( batch );
+     FC_ASSERT( my->_batch == nullptr || my->_batch == &batch );
+     batch.join( my.get(), my->_bids.get_database()->get_db() );
+     my->_batch = &batch;
+  }
+
+  void market_db::export_state( db::state_file_writer& out, const db::snapshot_ptr& snap )
+  { try {
+     db::write_section( out, "market.bids", my->_bids, snap );
+     db::write_section( out, "market.asks", my->_asks, snap );
+     db::write_section( out, "market.calls", my->_calls, snap );
+     db::write_section( out, "market.price_history", my->_price_history, snap );
+     db::write_section( out, "market.depth", my->_depth, snap );
+  } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+  void market_db::import_state( db::state_file_reader& in )
+  { try {
+     FC_ASSERT( !my->_bids.begin().valid() && !my->_asks.begin().valid() && !my->_calls.begin().valid(),
+                "the market must be empty to import a state file" );
+     db::read_section( in, "market.bids", my->_bids );
+     db::read_section( in, "market.asks", my->_asks );
+     db::read_section( in, "market.calls", my->_calls );
+     db::read_section( in, "market.price_history", my->_price_history );
+     db::read_section( in, "market.depth", my->_depth );
+     my->load();
+  } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
   void market_db::insert_bid( const market_order& m, uint64_t depth )
   {
      if( depth )
      {
-        auto itr = my->_depth.find( m.quote_unit );
-        if( itr.valid() )
+        auto stat = my->fetch_depth( m.quote_unit );
+        if( stat )
         {
-           auto stat = itr.value();
-           stat.bid_depth += depth;
-           ilog( "insert bid ${b} with depth ${d}", ("b",m)("d",depth) );
-           my->_depth.store( m.quote_unit, stat );
+           stat->bid_depth += depth;
+           my->store_depth( m.quote_unit, *stat );
         }
         else
         {
-           ilog( "insert bid ${b} with depth ${d}", ("b",m)("d",depth) );
-           my->_depth.store( m.quote_unit, depth_stats( depth, 0) );
+           my->store_depth( m.quote_unit, depth_stats( depth, 0) );
         }
      }
      my->_bids.store( m, 0 );
+     my->change_book( detail::book_change::insert_bid, m );
   }
   void market_db::insert_ask( const market_order& m, uint64_t depth )
   {
      if( depth )
      {
-        auto itr = my->_depth.find( m.quote_unit );
-        if( itr.valid() )
+        auto stat = my->fetch_depth( m.quote_unit );
+        if( stat )
         {
-           auto stat = itr.value();
-           stat.ask_depth += depth;
-           my->_depth.store( m.quote_unit, stat );
-           ilog( "insert ask ${b} with depth ${d}", ("b",m)("d",depth) );
+           stat->ask_depth += depth;
+           my->store_depth( m.quote_unit, *stat );
         }
         else
         {
-           ilog( "insert ask ${b} with depth ${d}", ("b",m)("d",depth) );
-           my->_depth.store( m.quote_unit, depth_stats( 0, depth) );
+           my->store_depth( m.quote_unit, depth_stats( 0, depth) );
         }
      }
      my->_asks.store( m, 0 );
+     my->change_book( detail::book_change::insert_ask, m );
   }
   void market_db::remove_bid( const market_order& m, uint64_t depth )
   {
      if( depth )
      {
-        auto itr = my->_depth.find( m.quote_unit );
-        if( itr.valid() )
+        auto stat = my->fetch_depth( m.quote_unit );
+        if( stat )
         {
-           auto stat = itr.value();
-           FC_ASSERT( stat.bid_depth >= depth, "", ("stat",stat)("depth",depth) );
-           stat.bid_depth -= depth;
-           my->_depth.store( m.quote_unit, stat );
+           FC_ASSERT( stat->bid_depth >= depth, "", ("stat",*stat)("depth",depth) );
+           stat->bid_depth -= depth;
+           my->store_depth( m.quote_unit, *stat );
         }
      }
      my->_bids.remove(m);
+     my->change_book( detail::book_change::remove_bid, m );
   }
   void market_db::remove_ask( const market_order& m, uint64_t depth )
   {
      if( depth )
      {
-        auto itr = my->_depth.find( m.quote_unit );
-        if( itr.valid() )
+        auto stat = my->fetch_depth( m.quote_unit );
+        if( stat )
         {
-           auto stat = itr.value();
-           FC_ASSERT( stat.ask_depth >= depth, "", ("stat",stat)("depth",depth) );
-           stat.ask_depth -= depth;
-           my->_depth.store( m.quote_unit, stat );
+           FC_ASSERT( stat->ask_depth >= depth, "", ("stat",*stat)("depth",depth) );
+           stat->ask_depth -= depth;
+           my->store_depth( m.quote_unit, *stat );
         }
      }
      my->_asks.remove(m);
+     my->change_book( detail::book_change::remove_ask, m );
   }
   void market_db::insert_call( const margin_call& c, uint64_t depth )
   {
      if( depth )
      {
-        auto itr = my->_depth.find( c.call_price.quote_unit );
-        if( itr.valid() )
+        auto stat = my->fetch_depth( c.call_price.quote_unit );
+        if( stat )
         {
-           auto stat = itr.value();
-           stat.bid_depth += depth;
-           my->_depth.store( c.call_price.quote_unit, stat );
+           stat->bid_depth += depth;
+           my->store_depth( c.call_price.quote_unit, *stat );
         }
         else
         {
-           my->_depth.store( c.call_price.quote_unit, depth_stats( depth, 0) );
+           my->store_depth( c.call_price.quote_unit, depth_stats( depth, 0) );
         }
      }
      my->_calls.store( c, 0 );
@@ -245,26 +534,23 @@ namespace bts { namespace blockchain {
   {
      if( depth )
      {
-        auto itr = my->_depth.find( c.call_price.quote_unit );
-        if( itr.valid() )
+        auto stat = my->fetch_depth( c.call_price.quote_unit );
+        if( stat )
         {
-           auto stat = itr.value();
-           FC_ASSERT( stat.bid_depth >= depth, "", ("stat",stat)("depth",depth) );
-           stat.bid_depth -= depth;
-           my->_depth.store( c.call_price.quote_unit, stat );
+           FC_ASSERT( stat->bid_depth >= depth, "", ("stat",*stat)("depth",depth) );
+           stat->bid_depth -= depth;
+           my->store_depth( c.call_price.quote_unit, *stat );
         }
      }
-     my->_calls.remove( c ); // TODO... this side effect is not unwond in 
-                             // in the event of an exception..
+     my->_calls.remove( c );
   }
 
-  uint64_t market_db::get_depth( asset::type quote_unit )
+  uint64_t market_db::get_depth( asset::type quote_unit, const db::snapshot_ptr& snap )
   {
-     auto itr = my->_depth.find( quote_unit );
-     if( itr.valid() )
+     auto stat = snap ? my->_depth.fetch_optional( quote_unit, snap ) : my->fetch_depth( quote_unit );
+     if( stat )
      {
-        auto stat = itr.value();
-        return std::min( stat.bid_depth, stat.ask_depth );
+        return std::min( stat->bid_depth, stat->ask_depth );
      }
      return 0;
   }
@@ -272,17 +558,19 @@ namespace bts { namespace blockchain {
   void market_db::push_price_point( const price_point& pt )
   {
      my->_price_history.store( price_point_key( pt.quote_volume.unit, pt.base_volume.unit, pt.from_time ), pt );
+     my->add_to_candles( pt );
   }
   
   /**
    *  This method returns the price history for a given asset pair for a given range and block granularity. 
    */
-  std::vector<price_point> market_db::get_history( asset::type quote, asset::type base, fc::time_point_sec from, fc::time_point_sec to, uint32_t blocks_per_point  )
+  std::vector<price_point> market_db::get_history( asset::type quote, asset::type base, fc::time_point_sec from, fc::time_point_sec to, uint32_t blocks_per_point,
+                                                  const db::snapshot_ptr& snap )
   {
      std::vector<price_point> points;
      uint32_t blocks_in_point = 0;
 
-     auto point_itr = my->_price_history.lower_bound( price_point_key( quote, base, from ) );
+     auto point_itr = my->_price_history.lower_bound( price_point_key( quote, base, from ), snap );
      while( point_itr.valid() )
      {
         auto key = point_itr.key();
@@ -305,37 +593,69 @@ namespace bts { namespace blockchain {
           points.push_back( point_itr.value() );
           blocks_in_point = 1;
         }
+        ++point_itr;
      }
      return points;
   }
 
+  std::vector<price_point> market_db::get_candles( asset::type quote, asset::type base, uint32_t resolution,
+                                                  fc::time_point_sec from, fc::time_point_sec to,
+                                                  const db::snapshot_ptr& snap )
+  {
+     FC_ASSERT( resolution == hourly_candles || resolution == daily_candles || resolution == weekly_candles,
+                "there are no candles of ${r} seconds", ("r",resolution) );
+     std::vector<price_point> candles;
+
+     // the candle that contains from
+     auto start = fc::time_point_sec( from.sec_since_epoch() - from.sec_since_epoch() % resolution );
+     for( auto itr = my->_candles.lower_bound( candle_key( quote, base, resolution, start ), snap ); itr.valid(); ++itr )
+     {
+        auto key = itr.key();
+        if( key.quote != quote || key.base != base || key.resolution != resolution ) break;
+        if( key.start > to ) break;
+        candles.push_back( itr.value() );
+     }
+     return candles;
+  }
+
+  order_book_summary market_db::get_order_book( asset::type quote, asset::type base, uint32_t levels )const
+  {
+     auto book = my->find_book( quote, base );
+     if( book ) return book->summarize( levels );
+     return order_book( quote, base ).summarize( levels );
+  }
+
   /** @pre quote > base  */
   fc::optional<market_order> market_db::get_highest_bid( asset::type quote, asset::type base )
   {
     FC_ASSERT( quote > base );
-    fc::optional<market_order> highest_bid;
-
-    return highest_bid;
+    auto book = my->find_book( quote, base );
+    return book ? book->highest_bid() : fc::optional<market_order>();
   }
   /** @pre quote > base  */
   fc::optional<market_order> market_db::get_lowest_ask( asset::type quote, asset::type base )
   {
     FC_ASSERT( quote > base );
-    fc::optional<market_order> lowest_ask;
-
-    return lowest_ask;
+    auto book = my->find_book( quote, base );
+    return book ? book->lowest_ask() : fc::optional<market_order>();
   }
 
-  std::vector<market_order> market_db::get_bids( asset::type quote_unit, asset::type base_unit )const
+  std::vector<market_order> market_db::get_bids( asset::type quote_unit, asset::type base_unit,
+                                                 const db::snapshot_ptr& snap )const
   {
      FC_ASSERT( quote_unit > base_unit );
+     if( !snap )
+     {
+        auto book = my->find_book( quote_unit, base_unit );
+        return book ? book->get_bids() : std::vector<market_order>();
+     }
 
      std::vector<market_order> orders;
      market_order mo;
      mo.base_unit  = base_unit;
      mo.quote_unit = quote_unit;
 
-     auto order_itr  = my->_bids.lower_bound( mo );
+     auto order_itr  = my->_bids.lower_bound( mo, snap );
      while( order_itr.valid() )
      {
         auto order = order_itr.key();
@@ -346,16 +666,15 @@ namespace bts { namespace blockchain {
         orders.push_back(order);
         ++order_itr;
      }
-     ilog( "order_itr is not valid!" );
      return orders;
   }
 
-  std::vector<margin_call>  market_db::get_calls( price call_price )const
+  std::vector<margin_call>  market_db::get_calls( price call_price, const db::snapshot_ptr& snap )const
   {
      ilog( "get_calls price: ${p}", ("p",call_price) );
      std::vector<margin_call> calls;
 
-     auto order_itr  = my->_calls.lower_bound( margin_call( call_price, output_reference() ) );
+     auto order_itr  = my->_calls.lower_bound( margin_call( call_price, output_reference() ), snap );
      while( order_itr.valid() )
      {
         auto call = order_itr.key();
@@ -371,16 +690,22 @@ namespace bts { namespace blockchain {
      return calls;
   }
 
-  std::vector<market_order> market_db::get_asks( asset::type quote_unit, asset::type base_unit )const
+  std::vector<market_order> market_db::get_asks( asset::type quote_unit, asset::type base_unit,
+                                                 const db::snapshot_ptr& snap )const
   {
      FC_ASSERT( quote_unit > base_unit );
+     if( !snap )
+     {
+        auto book = my->find_book( quote_unit, base_unit );
+        return book ? book->get_asks() : std::vector<market_order>();
+     }
 
      std::vector<market_order> orders;
      market_order mo;
      mo.base_unit  = base_unit;
      mo.quote_unit = quote_unit;
 
-     auto order_itr  = my->_asks.lower_bound( mo );
+     auto order_itr  = my->_asks.lower_bound( mo, snap );
      while( order_itr.valid() )
      {
         auto order = order_itr.key();
@@ -391,7 +716,6 @@ namespace bts { namespace blockchain {
         orders.push_back(order);
         ++order_itr;
      }
-     ilog( "order_itr is not valid!" );
      return orders;
   }
 
@@ -12,5 +12,6 @@ const message_type get_trx_block_message::type = get_trx_block_msg;
 const message_type trxs_message::type = trxs_msg;
 const message_type full_block_message::type = full_block_msg;
 const message_type trx_block_message::type = trx_block_msg;
+const message_type chain_status_message::type = chain_status_msg;
 
 } } // bts::bitchat
@@ -1052,20 +1052,59 @@ namespace bts { namespace blockchain {
    bool wallet::scan_chain( blockchain_db& chain, uint32_t from_block_num, scan_progress_callback cb )
    { try {
        bool found = false;
-       auto head_block_num = chain.head_block_num();
+       // read a single head block even if blocks are pushed while scanning
+       auto snap = chain.get_snapshot();
+       auto head_block_num = snap->head_block_num();
+
+       // a full rescan only needs the outputs still owned, which the address index has
+       if( from_block_num == 0 && chain.has_address_index() )
+       {
+          std::vector<owned_output> owned;
+          for( auto itr = my->_data.recv_addresses.begin(); itr != my->_data.recv_addresses.end(); ++itr )
+          {
+             auto outs = snap->fetch_unspent_outputs( itr->first );
+             owned.insert( owned.end(), outs.begin(), outs.end() );
+          }
+          for( auto itr = my->_data.recv_pts_addresses.begin(); itr != my->_data.recv_pts_addresses.end(); ++itr )
+          {
+             auto outs = snap->fetch_unspent_outputs( itr->first );
+             owned.insert( owned.end(), outs.begin(), outs.end() );
+          }
+
+          // anything found by an earlier scan that is not owned any more was spent
+          auto previous = my->_output_ref_to_index;
+          for( auto itr = owned.begin(); itr != owned.end(); ++itr )
+          {
+             const output_index oidx( itr->output.source.block_num, itr->output.source.trx_idx, itr->location.output_idx );
+             my->_output_index_to_ref[oidx]          = itr->location;
+             my->_output_ref_to_index[itr->location] = oidx;
+             my->_unspent_outputs[oidx]              = itr->output.output;
+             previous.erase( itr->location );
+          }
+          for( auto itr = previous.begin(); itr != previous.end(); ++itr )
+          {
+             mark_as_spent( itr->first );
+          }
+          if( cb ) cb( head_block_num, head_block_num, 0, 0 );
+          return owned.size() > 0;
+       }
+
+       // decoded in place so their vectors are reused from block to block
+       full_block blk;
+       meta_trx   trx;
    //    ilog( "receive pts addr: ${recv_pts_addrs}", ("recv_pts_addrs",my->_data.recv_pts_addresses) );
        // for each block
        for( uint32_t i = from_block_num; i <= head_block_num; ++i )
        {
        //   ilog( "block: ${i}", ("i",i ) );
-          auto blk = chain.fetch_full_block( i );
+          snap->fetch_full_block( i, blk );
           // for each transaction
           for( uint32_t trx_idx = 0; trx_idx < blk.trx_ids.size(); ++trx_idx )
           {
               if( cb ) cb( i, head_block_num, trx_idx, blk.trx_ids.size() ); 
 
               //ilog( "trx: ${trx_idx}", ("trx_idx",trx_idx ) );
-              auto trx = chain.fetch_trx( trx_num( i, trx_idx ) ); //blk.trx_ids[trx_idx] );
+              snap->fetch_trx( trx_num( i, trx_idx ), trx ); //blk.trx_ids[trx_idx] );
               //ilog( "${id} \n\n  ${trx}\n\n", ("id",trx.id())("trx",trx) );
 
               for( uint32_t in_idx = 0; in_idx < trx.inputs.size(); ++in_idx )
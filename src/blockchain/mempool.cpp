@@ -0,0 +1,493 @@
+#include <bts/blockchain/mempool.hpp>
+#include <bts/blockchain/signature_recovery.hpp>
+#include <bts/signature_cache.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace bts { namespace blockchain {
+
+  namespace detail
+  {
+     /** orders the fee index with the highest fee rate first, then by arrival */
+     struct fee_key
+     {
+        uint64_t             fee_rate;
+        uint64_t             seq;
+        transaction_id_type  trx_id;
+
+        friend bool operator < ( const fee_key& a, const fee_key& b )
+        {
+           if( a.fee_rate != b.fee_rate ) return a.fee_rate > b.fee_rate;
+           return a.seq < b.seq;
+        }
+     };
+
+     struct pending_trx
+     {
+        mempool_entry  entry;
+        fee_key        key;
+     };
+
+     struct orphan_trx
+     {
+        hashed_transaction                trx;
+        uint64_t                          seq;
+        std::vector<transaction_id_type>  missing_parents;
+     };
+
+     class mempool_impl
+     {
+        public:
+          mempool_impl():_chain(nullptr),_max_bytes(0),_bytes(0),_next_seq(0),_max_orphans(BLOCKCHAIN_MEMPOOL_ORPHANS){}
+
+          blockchain_db*                                        _chain;
+          uint64_t                                              _max_bytes;
+          uint64_t                                              _bytes;
+          uint64_t                                              _next_seq;
+
+          std::unordered_map<transaction_id_type,pending_trx>   _trxs;
+          std::set<fee_key>                                     _by_fee;
+          /** the pending trx spending each output */
+          std::unordered_map<output_reference,transaction_id_type> _spent_by;
+          /** outputs created by pending trxs, which other pending trxs may spend */
+          pending_outputs                                       _outputs;
+
+          uint32_t                                              _max_orphans;
+          std::unordered_map<transaction_id_type,orphan_trx>    _orphans;
+          std::unordered_multimap<transaction_id_type,transaction_id_type> _orphans_by_parent;
+          std::map<uint64_t,transaction_id_type>                _orphans_by_age;
+          /** descendants erased with an ancestor, parents first, waiting to be validated again */
+          std::vector<hashed_transaction>                       _displaced;
+
+          void insert( pending_trx p )
+          {
+             const signed_transaction& trx = p.entry.trx.trx();
+             for( auto itr = trx.inputs.begin(); itr != trx.inputs.end(); ++itr )
+             {
+                _spent_by[itr->output_ref] = p.key.trx_id;
+             }
+             add_pending_outputs( _outputs, trx, p.key.trx_id );
+             _by_fee.insert( p.key );
+             _bytes += p.entry.trx.size();
+             auto trx_id = p.key.trx_id;
+             _trxs[trx_id] = std::move(p);
+          }
+
+          /**
+           *  @param with_descendants - also erase the pending trxs that spend the outputs
+           *  of trx_id, which is what must happen unless trx_id was included in a block.
+           *  They are queued in _displaced so they can be held as orphans again.
+           */
+          bool erase( const transaction_id_type& trx_id, bool with_descendants = true )
+          {
+             auto itr = _trxs.find( trx_id );
+             if( itr == _trxs.end() ) return false;
+
+             hashed_transaction htrx = itr->second.entry.trx;
+             const signed_transaction& trx = htrx.trx();
+             for( auto in = trx.inputs.begin(); in != trx.inputs.end(); ++in )
+             {
+                _spent_by.erase( in->output_ref );
+             }
+             _by_fee.erase( itr->second.key );
+             _bytes -= htrx.size();
+             _trxs.erase( itr );
+
+             for( uint32_t i = 0; i < trx.outputs.size(); ++i )
+             {
+                output_reference out( trx_id, i );
+                _outputs.erase( out );
+                if( !with_descendants ) continue;
+
+                auto spender = _spent_by.find( out );
+                if( spender != _spent_by.end() )
+                {
+                   auto child_id = spender->second;
+                   _displaced.push_back( _trxs.at( child_id ).entry.trx );
+                   erase( child_id, true );
+                }
+             }
+             return true;
+          }
+
+          /** adds @param trx_id and every pending trx spending its outputs to @param ids */
+          void find_descendants( const transaction_id_type& trx_id, std::unordered_set<transaction_id_type>& ids )const
+          {
+             if( !ids.insert( trx_id ).second ) return;
+             const signed_transaction& trx = _trxs.at( trx_id ).entry.trx.trx();
+             for( uint32_t i = 0; i < trx.outputs.size(); ++i )
+             {
+                auto spender = _spent_by.find( output_reference( trx_id, i ) );
+                if( spender != _spent_by.end() )
+                {
+                   find_descendants( spender->second, ids );
+                }
+             }
+          }
+
+          /** @return the ids of pending trxs that spend any input of @param trx */
+          std::vector<transaction_id_type> find_conflicts( const signed_transaction& trx )const
+          {
+             std::vector<transaction_id_type> conflicts;
+             for( auto itr = trx.inputs.begin(); itr != trx.inputs.end(); ++itr )
+             {
+                auto spender = _spent_by.find( itr->output_ref );
+                if( spender != _spent_by.end() &&
+                    std::find( conflicts.begin(), conflicts.end(), spender->second ) == conflicts.end() )
+                {
+                   conflicts.push_back( spender->second );
+                }
+             }
+             return conflicts;
+          }
+
+          /** @return the trxs @param trx spends from that are neither pending nor in the chain */
+          std::vector<transaction_id_type> find_missing_parents( const signed_transaction& trx )const
+          {
+             std::vector<transaction_id_type> missing;
+             for( auto itr = trx.inputs.begin(); itr != trx.inputs.end(); ++itr )
+             {
+                const auto& parent = itr->output_ref.trx_hash;
+                if( _outputs.find( itr->output_ref ) != _outputs.end() ) continue;
+                if( _trxs.find( parent ) != _trxs.end() ) continue;
+                if( std::find( missing.begin(), missing.end(), parent ) != missing.end() ) continue;
+                if( _chain->has_transaction( parent ) ) continue;
+                missing.push_back( parent );
+             }
+             return missing;
+          }
+
+          void evict_to( uint64_t max_bytes )
+          {
+             while( _bytes > max_bytes && _by_fee.size() )
+             {
+                auto lowest = *_by_fee.rbegin();
+                wlog( "evicting trx ${id} with fee rate ${r} from the mempool", ("id",lowest.trx_id)("r",lowest.fee_rate) );
+                erase( lowest.trx_id );
+             }
+          }
+
+          void add_orphan( const hashed_transaction& trx, std::vector<transaction_id_type> missing_parents )
+          {
+             while( _orphans.size() >= _max_orphans && _orphans_by_age.size() )
+             {
+                erase_orphan( _orphans_by_age.begin()->second );
+             }
+             if( _max_orphans == 0 ) return;
+
+             orphan_trx o;
+             o.trx             = trx;
+             o.seq             = _next_seq++;
+             o.missing_parents = std::move(missing_parents);
+             for( auto itr = o.missing_parents.begin(); itr != o.missing_parents.end(); ++itr )
+             {
+                _orphans_by_parent.insert( std::make_pair( *itr, trx.id() ) );
+             }
+             _orphans_by_age[o.seq] = trx.id();
+             _orphans[trx.id()]     = std::move(o);
+          }
+
+          void erase_orphan( const transaction_id_type& trx_id )
+          {
+             auto itr = _orphans.find( trx_id );
+             if( itr == _orphans.end() ) return;
+
+             const auto& parents = itr->second.missing_parents;
+             for( auto p = parents.begin(); p != parents.end(); ++p )
+             {
+                auto range = _orphans_by_parent.equal_range( *p );
+                for( auto child = range.first; child != range.second; ++child )
+                {
+                   if( child->second == trx_id ) { _orphans_by_parent.erase( child ); break; }
+                }
+             }
+             _orphans_by_age.erase( itr->second.seq );
+             _orphans.erase( itr );
+          }
+
+          /** removes and returns the orphans that were waiting for @param parent */
+          std::vector<hashed_transaction> take_orphans( const transaction_id_type& parent )
+          {
+             std::vector<hashed_transaction> children;
+             auto range = _orphans_by_parent.equal_range( parent );
+             for( auto itr = range.first; itr != range.second; ++itr )
+             {
+                children.push_back( _orphans.at( itr->second ).trx );
+             }
+             for( auto itr = children.begin(); itr != children.end(); ++itr )
+             {
+                erase_orphan( itr->id() );
+             }
+             return children;
+          }
+     };
+  } // namespace detail
+
+  mempool::mempool( blockchain_db* chain, uint64_t max_bytes )
+  :my( new detail::mempool_impl() )
+  {
+     my->_chain     = chain;
+     my->_max_bytes = max_bytes;
+  }
+
+  mempool::~mempool(){}
+
+  bool mempool::add( const hashed_transaction& trx )
+  { try {
+     if( contains( trx.id() ) || is_orphan( trx.id() ) ) return false;
+
+     auto missing_parents = my->find_missing_parents( trx );
+     if( missing_parents.size() )
+     {
+        ilog( "holding trx ${id} until its parents ${p} arrive", ("id",trx.id())("p",missing_parents) );
+        my->add_orphan( trx, std::move(missing_parents) );
+        return false;
+     }
+
+     // recover from the cached digest rather than repacking the trx
+     signature_keys keys;
+     for( auto itr = trx.trx().sigs.begin(); itr != trx.trx().sigs.end(); ++itr )
+     {
+        keys.keys.push_back( signature_cache::instance().recover( trx.digest(), *itr ) );
+     }
+
+     detail::pending_trx p;
+     p.entry.trx      = trx;
+     p.entry.eval     = my->_chain->evaluate_signed_transaction( trx, true, false, &keys, &my->_outputs );
+     p.entry.fee_rate = p.entry.eval.fee_rate( trx.size() );
+     p.entry.received = fc::time_point::now();
+     FC_ASSERT( p.entry.eval.fees.get_rounded_amount() >= (my->_chain->get_fee_rate() * trx.size()).get_rounded_amount(),
+                "transaction does not pay the minimum fee", ("fees",p.entry.eval.fees)("size",trx.size()) );
+
+     auto conflicts = my->find_conflicts( trx );
+     for( auto itr = conflicts.begin(); itr != conflicts.end(); ++itr )
+     {
+        const auto& other = my->_trxs.at( *itr ).entry;
+        FC_ASSERT( p.entry.fee_rate > other.fee_rate,
+                   "transaction spends the same outputs as ${other} without paying a higher fee rate",
+                   ("other",*itr)("fee_rate",p.entry.fee_rate)("other_fee_rate",other.fee_rate) );
+     }
+
+     if( my->_by_fee.size() && my->_bytes + trx.size() > my->_max_bytes )
+     {
+        FC_ASSERT( p.entry.fee_rate > my->_by_fee.rbegin()->fee_rate,
+                   "mempool is full and transaction pays no more than the lowest fee rate",
+                   ("fee_rate",p.entry.fee_rate)("lowest",my->_by_fee.rbegin()->fee_rate) );
+     }
+
+     // trx was validated against the outputs of the trxs it replaces and their
+     // descendants, it must not spend any of them
+     std::unordered_set<transaction_id_type> replaced;
+     for( auto itr = conflicts.begin(); itr != conflicts.end(); ++itr )
+     {
+        my->find_descendants( *itr, replaced );
+     }
+     for( auto in = trx.trx().inputs.begin(); in != trx.trx().inputs.end(); ++in )
+     {
+        FC_ASSERT( replaced.find( in->output_ref.trx_hash ) == replaced.end(),
+                   "transaction spends an output of ${parent}, which it would replace",
+                   ("parent",in->output_ref.trx_hash) );
+     }
+
+     for( auto itr = conflicts.begin(); itr != conflicts.end(); ++itr )
+     {
+        // the replaced trx takes any trxs spending its outputs with it
+        ilog( "trx ${id} replaced by ${new_id}", ("id",*itr)("new_id",trx.id()) );
+        my->erase( *itr );
+     }
+
+     p.key.fee_rate = p.entry.fee_rate;
+     p.key.seq      = my->_next_seq++;
+     p.key.trx_id   = trx.id();
+     my->insert( std::move(p) );
+     my->evict_to( my->_max_bytes );
+
+     accept_orphans( trx.id() );
+     revalidate_displaced();
+     return contains( trx.id() );
+  } FC_RETHROW_EXCEPTIONS( warn, "unable to add transaction ${id} to the mempool", ("id",trx.id()) ) }
+
+  void mempool::accept_orphans( const transaction_id_type& parent )
+  {
+     auto children = my->take_orphans( parent );
+     for( auto itr = children.begin(); itr != children.end(); ++itr )
+     {
+        try {
+           add( *itr );
+        }
+        catch ( const fc::exception& e )
+        {
+           wlog( "dropping orphan trx ${id}\n${e}", ("id",itr->id())("e",e.to_detail_string()) );
+        }
+     }
+  }
+
+  void mempool::revalidate_displaced()
+  {
+     auto displaced = std::move( my->_displaced );
+     my->_displaced.clear();
+     for( auto itr = displaced.begin(); itr != displaced.end(); ++itr )
+     {
+        // a trx whose parent left is held as an orphan again until the parent returns
+        try {
+           add( *itr );
+        }
+        catch ( const fc::exception& e )
+        {
+           wlog( "dropping trx ${id} whose parent left the mempool\n${e}", ("id",itr->id())("e",e.to_detail_string()) );
+        }
+     }
+  }
+
+  bool mempool::remove( const transaction_id_type& trx_id )
+  {
+     bool removed = my->erase( trx_id );
+     revalidate_displaced();
+     return removed;
+  }
+
+  void mempool::handle_block( const trx_block& b )
+  {
+     std::vector<transaction_id_type> ids;
+     ids.reserve( b.trxs.size() );
+     for( auto trx = b.trxs.begin(); trx != b.trxs.end(); ++trx )
+     {
+        ids.push_back( trx->id() );
+        // pending children of an included trx now spend outputs in the chain
+        if( my->erase( ids.back(), false ) ) continue;
+
+        auto conflicts = my->find_conflicts( *trx );
+        for( auto itr = conflicts.begin(); itr != conflicts.end(); ++itr )
+        {
+           my->erase( *itr );
+        }
+     }
+     for( auto itr = ids.begin(); itr != ids.end(); ++itr )
+     {
+        accept_orphans( *itr );
+     }
+     revalidate_displaced();
+  }
+
+  void mempool::clear()
+  {
+     my->_trxs.clear();
+     my->_by_fee.clear();
+     my->_spent_by.clear();
+     my->_outputs.clear();
+     my->_orphans.clear();
+     my->_orphans_by_parent.clear();
+     my->_orphans_by_age.clear();
+     my->_displaced.clear();
+     my->_bytes = 0;
+  }
+
+  bool mempool::contains( const transaction_id_type& trx_id )const
+  {
+     return my->_trxs.find( trx_id ) != my->_trxs.end();
+  }
+
+  bool mempool::is_orphan( const transaction_id_type& trx_id )const
+  {
+     return my->_orphans.find( trx_id ) != my->_orphans.end();
+  }
+
+  fc::optional<mempool_entry> mempool::get( const transaction_id_type& trx_id )const
+  {
+     auto itr = my->_trxs.find( trx_id );
+     if( itr == my->_trxs.end() ) return fc::optional<mempool_entry>();
+     return itr->second.entry;
+  }
+
+  fc::optional<transaction_id_type> mempool::get_spender( const output_reference& out )const
+  {
+     auto itr = my->_spent_by.find( out );
+     if( itr == my->_spent_by.end() ) return fc::optional<transaction_id_type>();
+     return itr->second;
+  }
+
+  std::vector<hashed_transaction> mempool::get_block_template()const
+  {
+     std::vector<hashed_transaction>          trxs;
+     std::unordered_set<transaction_id_type>  added;
+     size_t block_size = 0;
+
+     // a trx can only go in after the pending trxs it spends from
+     std::function<bool(const transaction_id_type&)> include = [&]( const transaction_id_type& trx_id ) -> bool
+     {
+        if( added.find( trx_id ) != added.end() ) return true;
+
+        const hashed_transaction& trx = my->_trxs.at( trx_id ).entry.trx;
+        const auto& inputs = trx.trx().inputs;
+        for( auto in = inputs.begin(); in != inputs.end(); ++in )
+        {
+           if( my->_trxs.find( in->output_ref.trx_hash ) != my->_trxs.end() &&
+               !include( in->output_ref.trx_hash ) )
+           {
+              return false;
+           }
+        }
+        if( block_size + trx.size() > MAX_BLOCK_TRXS_SIZE ) return false;
+
+        block_size += trx.size();
+        trxs.push_back( trx );
+        added.insert( trx_id );
+        return true;
+     };
+
+     for( auto itr = my->_by_fee.begin(); itr != my->_by_fee.end(); ++itr )
+     {
+        include( itr->trx_id );
+     }
+     return trxs;
+  }
+
+  std::vector<transaction_id_type> mempool::get_ids( uint32_t limit )const
+  {
+     std::vector<transaction_id_type> ids;
+     for( auto itr = my->_by_fee.begin(); ids.size() < limit && itr != my->_by_fee.end(); ++itr )
+     {
+        ids.push_back( itr->trx_id );
+     }
+     return ids;
+  }
+
+  size_t mempool::size()const
+  {
+     return my->_trxs.size();
+  }
+
+  size_t mempool::orphan_count()const
+  {
+     return my->_orphans.size();
+  }
+
+  uint64_t mempool::bytes()const
+  {
+     return my->_bytes;
+  }
+
+  void mempool::set_max_bytes( uint64_t max_bytes )
+  {
+     my->_max_bytes = max_bytes;
+     my->evict_to( max_bytes );
+     revalidate_displaced();
+  }
+
+  void mempool::set_max_orphans( uint32_t max_orphans )
+  {
+     my->_max_orphans = max_orphans;
+     while( my->_orphans.size() > max_orphans )
+     {
+        my->erase_orphan( my->_orphans_by_age.begin()->second );
+     }
+  }
+
+} } // bts::blockchain
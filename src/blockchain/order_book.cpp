@@ -0,0 +1,147 @@
+#include <bts/blockchain/order_book.hpp>
+#include <fc/exception/exception.hpp>
+
+#include <algorithm>
+
+namespace bts { namespace blockchain {
+
+  void order_book::insert_bid( const market_order& m, uint64_t amount )
+  {
+     insert( _bids, _bid_count, m, amount );
+  }
+
+  void order_book::insert_ask( const market_order& m, uint64_t amount )
+  {
+     insert( _asks, _ask_count, m, amount );
+  }
+
+  bool order_book::remove_bid( const market_order& m )
+  {
+     return remove( _bids, _bid_count, m );
+  }
+
+  bool order_book::remove_ask( const market_order& m )
+  {
+     return remove( _asks, _ask_count, m );
+  }
+
+  std::vector<market_order> order_book::get_bids()const
+  {
+     return get_orders( _bids );
+  }
+
+  std::vector<market_order> order_book::get_asks()const
+  {
+     return get_orders( _asks );
+  }
+
+  fc::optional<market_order> order_book::highest_bid()const
+  {
+     fc::optional<market_order> highest;
+     if( !_bids.empty() )
+     {
+        auto level = _bids.rbegin();
+        highest = make_order( level->first, level->second.orders.rbegin()->first );
+     }
+     return highest;
+  }
+
+  fc::optional<market_order> order_book::lowest_ask()const
+  {
+     fc::optional<market_order> lowest;
+     if( !_asks.empty() )
+     {
+        auto level = _asks.begin();
+        lowest = make_order( level->first, level->second.orders.begin()->first );
+     }
+     return lowest;
+  }
+
+  order_book_summary order_book::summarize( uint32_t max_levels )const
+  {
+     order_book_summary summary;
+     summary.quote_unit = _quote;
+     summary.base_unit  = _base;
+     summary.bid_levels = _bids.size();
+     summary.ask_levels = _asks.size();
+     summary.bid_orders = _bid_count;
+     summary.ask_orders = _ask_count;
+     if( !_bids.empty() ) summary.best_bid = price( _bids.rbegin()->first, _base, _quote );
+     if( !_asks.empty() ) summary.best_ask = price( _asks.begin()->first, _base, _quote );
+
+     auto add_level = [&]( std::vector<order_book_level>& out, const levels::value_type& level )
+     {
+        order_book_level l;
+        l.level_price       = price( level.first, _base, _quote );
+        l.amount            = level.second.amount;
+        l.cumulative_amount = level.second.amount + (out.empty() ? 0 : out.back().cumulative_amount);
+        l.orders            = level.second.orders.size();
+        out.push_back( l );
+     };
+     summary.bids.reserve( std::min<size_t>( max_levels, _bids.size() ) );
+     for( auto level = _bids.rbegin(); level != _bids.rend() && summary.bids.size() < max_levels; ++level )
+     {
+        add_level( summary.bids, *level );
+     }
+     summary.asks.reserve( std::min<size_t>( max_levels, _asks.size() ) );
+     for( auto level = _asks.begin(); level != _asks.end() && summary.asks.size() < max_levels; ++level )
+     {
+        add_level( summary.asks, *level );
+     }
+     return summary;
+  }
+
+  void order_book::insert( levels& side, uint32_t& count, const market_order& m, uint64_t amount )
+  {
+     FC_ASSERT( m.quote_unit == _quote && m.base_unit == _base, "", ("order",m)("quote",_quote)("base",_base) );
+     auto& level = side[m.ratio];
+     auto  order = level.orders.insert( std::make_pair( m.location, amount ) );
+     if( order.second )
+     {
+        ++count;
+     }
+     else
+     {
+        level.amount -= order.first->second;
+        order.first->second = amount;
+     }
+     level.amount += amount;
+  }
+
+  bool order_book::remove( levels& side, uint32_t& count, const market_order& m )
+  {
+     auto level = side.find( m.ratio );
+     if( level == side.end() ) return false;
+     auto order = level->second.orders.find( m.location );
+     if( order == level->second.orders.end() ) return false;
+
+     level->second.amount -= order->second;
+     level->second.orders.erase( order );
+     if( level->second.orders.empty() )
+     {
+        side.erase( level );
+     }
+     --count;
+     return true;
+  }
+
+  std::vector<market_order> order_book::get_orders( const levels& side )const
+  {
+     std::vector<market_order> orders;
+     orders.reserve( &side == &_bids ? _bid_count : _ask_count );
+     for( auto level = side.begin(); level != side.end(); ++level )
+     {
+        for( auto order = level->second.orders.begin(); order != level->second.orders.end(); ++order )
+        {
+           orders.push_back( make_order( level->first, order->first ) );
+        }
+     }
+     return orders;
+  }
+
+  market_order order_book::make_order( const fc::uint128_t& ratio, const output_reference& loc )const
+  {
+     return market_order( price( ratio, _base, _quote ), loc );
+  }
+
+} } // bts::blockchain
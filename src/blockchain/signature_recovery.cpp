@@ -0,0 +1,142 @@
+#include <bts/blockchain/signature_recovery.hpp>
+#include <bts/config.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/optional.hpp>
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+#include <thread>
+
+namespace bts { namespace blockchain {
+
+  std::unordered_set<address> signature_keys::addresses()const
+  {
+     std::unordered_set<address> r;
+     for( auto itr = keys.begin(); itr != keys.end(); ++itr )
+     {
+        r.insert( (*itr)->addr );
+     }
+     return r;
+  }
+
+  std::unordered_set<pts_address> signature_keys::pts_addresses()const
+  {
+     std::unordered_set<pts_address> r;
+     for( auto itr = keys.begin(); itr != keys.end(); ++itr )
+     {
+        r.insert( (*itr)->pts_addrs, (*itr)->pts_addrs + 4 );
+     }
+     return r;
+  }
+
+  signature_recovery_pool::signature_recovery_pool( uint32_t num_threads )
+  :_num_threads(num_threads)
+  {
+     if( _num_threads == 0 )
+     {
+        _num_threads = std::max( 1u, std::thread::hardware_concurrency() );
+     }
+  }
+
+  signature_recovery_pool::~signature_recovery_pool(){}
+
+  std::vector<signature_keys> signature_recovery_pool::recover( const std::vector<signed_transaction>& trxs )
+  {
+     std::vector<const signed_transaction*> ptrs( trxs.size() );
+     std::vector<fc::sha256>                digests( trxs.size() );
+     for( uint32_t t = 0; t < trxs.size(); ++t )
+     {
+        ptrs[t] = &trxs[t];
+        if( !trxs[t].sigs.empty() ) digests[t] = trxs[t].digest();
+     }
+     return recover( ptrs, digests );
+  }
+
+  std::vector<signature_keys> signature_recovery_pool::recover( const std::vector<hashed_transaction>& trxs )
+  {
+     std::vector<const signed_transaction*> ptrs( trxs.size() );
+     std::vector<fc::sha256>                digests( trxs.size() );
+     for( uint32_t t = 0; t < trxs.size(); ++t )
+     {
+        ptrs[t]    = &trxs[t].trx();
+        digests[t] = trxs[t].digest();
+     }
+     return recover( ptrs, digests );
+  }
+
+  std::vector<signature_keys> signature_recovery_pool::recover( const std::vector<const signed_transaction*>& trxs,
+                                                                const std::vector<fc::sha256>& digests )
+  { try {
+     struct job
+     {
+        uint32_t                             trx;
+        uint32_t                             key;
+        const fc::ecc::compact_signature*    sig;
+     };
+
+     std::vector<signature_keys> result( trxs.size() );
+     std::vector<job>            jobs;
+     for( uint32_t t = 0; t < trxs.size(); ++t )
+     {
+        if( trxs[t]->sigs.empty() ) continue;
+        result[t].keys.resize( trxs[t]->sigs.size() );
+
+        uint32_t k = 0;
+        for( auto itr = trxs[t]->sigs.begin(); itr != trxs[t]->sigs.end(); ++itr, ++k )
+        {
+           job j;
+           j.trx = t;
+           j.key = k;
+           j.sig = &*itr;
+           jobs.push_back( j );
+        }
+     }
+
+     // each job writes a distinct key that was sized above, so the workers share nothing
+     auto run = [&]( size_t begin, size_t end )
+     {
+        for( size_t i = begin; i < end; ++i )
+        {
+           result[jobs[i].trx].keys[jobs[i].key] = signature_cache::instance().recover( digests[jobs[i].trx], *jobs[i].sig );
+        }
+     };
+
+     uint32_t num_workers = std::min<size_t>( _num_threads, jobs.size() / BLOCKCHAIN_SIGNATURES_PER_THREAD );
+     if( num_workers <= 1 )
+     {
+        run( 0, jobs.size() );
+        return result;
+     }
+
+     while( _threads.size() < num_workers )
+     {
+        _threads.push_back( std::unique_ptr<fc::thread>( new fc::thread( "signature_recovery" ) ) );
+     }
+
+     size_t per_worker = (jobs.size() + num_workers - 1) / num_workers;
+     std::vector<fc::future<void> > done;
+     done.reserve( num_workers );
+     for( uint32_t w = 0; w < num_workers; ++w )
+     {
+        size_t begin = w * per_worker;
+        size_t end   = std::min( jobs.size(), begin + per_worker );
+        done.push_back( _threads[w]->async( [=,&run](){ run( begin, end ); } ) );
+     }
+     // wait for every worker before rethrowing, they reference this frame
+     fc::exception_ptr error;
+     for( auto itr = done.begin(); itr != done.end(); ++itr )
+     {
+        try {
+           itr->wait();
+        }
+        catch ( const fc::exception& e )
+        {
+           if( !error ) error = e.dynamic_copy_exception();
+        }
+     }
+     if( error ) error->dynamic_rethrow_exception();
+     return result;
+  } FC_RETHROW_EXCEPTIONS( warn, "error recovering the signatures of ${n} transactions", ("n",trxs.size()) ) }
+
+} } // bts::blockchain
@@ -1,4 +1,5 @@
 #include <bts/address.hpp>
+#include <bts/signature_cache.hpp>
 #include <bts/blockchain/transaction.hpp>
 #include <fc/reflect/variant.hpp>
 #include <fc/io/raw.hpp>
@@ -20,7 +21,7 @@ namespace bts { namespace blockchain {
        std::unordered_set<address> r;
        for( auto itr = sigs.begin(); itr != sigs.end(); ++itr )
        {
-            r.insert( address(fc::ecc::public_key( *itr, dig )) );
+            r.insert( signature_cache::instance().recover( dig, *itr )->addr );
        }
        return r;
    }
@@ -32,16 +33,8 @@ namespace bts { namespace blockchain {
        // add both compressed and uncompressed forms...
        for( auto itr = sigs.begin(); itr != sigs.end(); ++itr )
        {
-            auto signed_key_data = fc::ecc::public_key( *itr, dig ).serialize();
-            auto signed_key_point = fc::ecc::public_key( *itr, dig ).serialize_ecc_point();
-
-            
-            // note: 56 is the version bit of protoshares
-            r.insert( pts_address(fc::ecc::public_key( signed_key_data),false,56) );
-            r.insert( pts_address(fc::ecc::public_key( signed_key_data ),true,56) );
-            // note: 5 comes from en.bitcoin.it/wiki/Vanitygen where version bit is 0
-            r.insert( pts_address(fc::ecc::public_key( signed_key_data ),false,0) );
-            r.insert( pts_address(fc::ecc::public_key( signed_key_data ),true,0) );
+            auto signed_key = signature_cache::instance().recover( dig, *itr );
+            r.insert( signed_key->pts_addrs, signed_key->pts_addrs + 4 );
        }
        ilog( "${signed_addr}", ("signed_addr",r) );
        return r;
@@ -68,6 +61,45 @@ namespace bts { namespace blockchain {
       return ds.tellp();
    }
 
+   hashed_transaction::hashed_transaction()
+   :hashed_transaction( signed_transaction() ){}
+
+   hashed_transaction::hashed_transaction( signed_transaction trx )
+   {
+      auto s = std::make_shared<state>();
+      s->trx    = std::move(trx);
+      s->packed = fc::raw::pack( s->trx );
+
+      // a signed_transaction packs as its transaction followed by the sigs, so
+      // the digest covers a prefix of the packed bytes
+      fc::datastream<size_t> unsigned_size;
+      fc::raw::pack( unsigned_size, static_cast<const transaction&>(s->trx) );
+      s->digest = fc::sha256::hash( s->packed.data(), unsigned_size.tellp() );
+      s->id     = small_hash( s->packed.data(), s->packed.size() );
+      my = s;
+   }
+
+   std::unordered_set<bts::address> hashed_transaction::get_signed_addresses()const
+   {
+       std::unordered_set<address> r;
+       for( auto itr = my->trx.sigs.begin(); itr != my->trx.sigs.end(); ++itr )
+       {
+            r.insert( signature_cache::instance().recover( my->digest, *itr )->addr );
+       }
+       return r;
+   }
+
+   std::unordered_set<bts::pts_address> hashed_transaction::get_signed_pts_addresses()const
+   {
+       std::unordered_set<pts_address> r;
+       for( auto itr = my->trx.sigs.begin(); itr != my->trx.sigs.end(); ++itr )
+       {
+            auto signed_key = signature_cache::instance().recover( my->digest, *itr );
+            r.insert( signed_key->pts_addrs, signed_key->pts_addrs + 4 );
+       }
+       return r;
+   }
+
 } }
 namespace fc {
    void to_variant( const bts::blockchain::trx_output& var,  variant& vo )
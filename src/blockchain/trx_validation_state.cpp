@@ -8,11 +8,14 @@
 
 namespace bts  { namespace blockchain { 
 
-trx_validation_state::trx_validation_state( const signed_transaction& t, blockchain_db* d, bool enf, uint32_t h )
-:allow_short_long_matching(false),
- prev_block_id1(0),prev_block_id2(0),trx(t),total_cdd(0),uncounted_cdd(0),balance_sheet( asset::count ),db(d),enforce_unspent(enf),ref_head(h)
+trx_validation_state::trx_validation_state( const signed_transaction& t, blockchain_db* d, bool enf, uint32_t h,
+                                            const signature_keys* keys, const pending_outputs* pending,
+                                            const prefetched_inputs* prefetched )
+:allow_short_long_matching(false),check_signatures(true),
+ prev_block_id1(0),prev_block_id2(0),trx(t),total_cdd(0),uncounted_cdd(0),balance_sheet( asset::count ),db(d),enforce_unspent(enf),ref_head(h),
+ _keys(keys)
 { 
-  inputs  = d->fetch_inputs( t.inputs, ref_head );
+  inputs  = d->fetch_inputs( t.inputs, ref_head, pending, prefetched );
   if( ref_head == std::numeric_limits<uint32_t>::max()  )
   {
     ref_head = d->head_block_num();
@@ -28,7 +31,36 @@ trx_validation_state::trx_validation_state( const signed_transaction& t, blockch
     balance_sheet[i].collat_out.unit  = (asset::bts);
     balance_sheet[i].neg_out.unit     = (asset::type)i;
   }
-  signed_addresses = t.get_signed_addresses();
+}
+
+/**
+ *  Recovers the signing keys unless check_signatures is off and no input
+ *  depends on who signed.
+ */
+void trx_validation_state::load_signed_addresses()
+{
+  bool need_addresses     = check_signatures;
+  bool need_pts_addresses = false;
+  for( auto itr = inputs.begin(); itr != inputs.end(); ++itr )
+  {
+     if( itr->output.claim_func == claim_by_pts )
+     {
+        need_pts_addresses = check_signatures;
+     }
+     // signed by the pay address cancels the order rather than filling it
+     if( itr->output.claim_func == claim_by_bid || itr->output.claim_func == claim_by_long )
+     {
+        need_addresses = true;
+     }
+  }
+  if( need_addresses )
+  {
+     signed_addresses = _keys ? _keys->addresses() : trx.get_signed_addresses();
+  }
+  if( need_pts_addresses )
+  {
+     signed_pts_addresses = _keys ? _keys->pts_addresses() : trx.get_signed_pts_addresses();
+  }
 }
 
 void trx_validation_state::validate()
@@ -36,6 +68,7 @@ void trx_validation_state::validate()
   try
   {
      FC_ASSERT( trx.inputs.size() == inputs.size() );
+     load_signed_addresses();
      
      if( enforce_unspent )
      {
@@ -74,12 +107,8 @@ void trx_validation_state::validate()
         }
      }
 
-     if( !signed_addresses.size() )
-     {
-        signed_addresses =  trx.get_signed_addresses();
-     }
      std::vector<address> missing;
-     for( auto itr  = required_sigs.begin(); itr != required_sigs.end(); ++itr )
+     for( auto itr  = required_sigs.begin(); check_signatures && itr != required_sigs.end(); ++itr )
      {
         if( signed_addresses.find( *itr ) == signed_addresses.end() )
         {
@@ -265,11 +294,8 @@ void trx_validation_state::validate_pts( const meta_trx_input& in )
 {
    try {
       auto pts_claim = in.output.as<claim_by_pts_output>();
-      auto pts_addrs = trx.get_signed_pts_addresses();
-      auto addrs = trx.get_signed_addresses();
-
-      FC_ASSERT( pts_addrs.find( pts_claim.owner ) != pts_addrs.end(),
-                "Unable to find signature by ${owner}", ("owner",pts_claim.owner)("signedby",pts_addrs)("addrs",addrs) );
+      FC_ASSERT( !check_signatures || signed_pts_addresses.find( pts_claim.owner ) != signed_pts_addresses.end(),
+                "Unable to find signature by ${owner}", ("owner",pts_claim.owner)("signedby",signed_pts_addresses)("addrs",signed_addresses) );
 
       balance_sheet[(asset::type)in.output.amount.unit].in += in.output.amount;
 
@@ -0,0 +1,80 @@
+#include <bts/db/database.hpp>
+#include <bts/db/upgrade_leveldb.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/reflect/variant.hpp>
+
+namespace bts { namespace db {
+
+  database::database(){}
+
+  database::~database()
+  {
+     close();
+  }
+
+  void database::open( const fc::path& dir, bool create, const database_options& o )
+  { try {
+     FC_ASSERT( !is_open() );
+
+     _block_cache.reset( ldb::NewLRUCache( o.cache_size ) );
+     if( o.bloom_filter_bits )
+     {
+        _filter_policy.reset( ldb::NewBloomFilterPolicy( o.bloom_filter_bits ) );
+     }
+
+     ldb::Options opts;
+     opts.create_if_missing = create;
+     opts.block_cache       = _block_cache.get();
+     opts.filter_policy     = _filter_policy.get();
+     opts.write_buffer_size = o.write_buffer_size;
+     opts.block_size        = o.block_size;
+     opts.compression       = o.compression ? ldb::kSnappyCompression : ldb::kNoCompression;
+
+     /// \warning Given path must exist to succeed toNativeAnsiPath
+     fc::create_directories(dir);
+
+     std::string ldb_path = dir.to_native_ansi_path();
+
+     ldb::DB* ndb = nullptr;
+     auto status = ldb::DB::Open( opts, ldb_path.c_str(), &ndb );
+     if( !status.ok() )
+     {
+         _block_cache.reset();
+         _filter_policy.reset();
+         FC_THROW_EXCEPTION( db_in_use_exception, "Unable to open database ${db}\n\t${msg}",
+              ("db",dir)
+              ("msg",status.ToString())
+              );
+     }
+     _db.reset(ndb);
+     _dir     = dir;
+     _options = o;
+     MarkDbKeysOrdered(dir);
+     ilog( "opened database ${dir} with ${options}", ("dir",dir)("options",o) );
+  } FC_RETHROW_EXCEPTIONS( warn, "error opening database ${dir}", ("dir",dir)("create",create)("options",o) ) }
+
+  void database::close()
+  {
+     _db.reset();
+     _block_cache.reset();
+     _filter_policy.reset();
+  }
+
+  snapshot_ptr database::create_snapshot()
+  {
+     FC_ASSERT( is_open() );
+     auto self = shared_from_this();
+     return snapshot_ptr( _db->GetSnapshot(), [self]( const ldb::Snapshot* s )
+                          {
+                             if( self->_db ) self->_db->ReleaseSnapshot( s );
+                          } );
+  }
+
+  ldb::DB* database::get_db()const
+  {
+     FC_ASSERT( is_open() );
+     return _db.get();
+  }
+
+} } // bts::db
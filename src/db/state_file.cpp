@@ -0,0 +1,70 @@
+#include <bts/db/state_file.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/reflect/variant.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace bts { namespace db {
+
+  state_file_writer::state_file_writer( const fc::path& file )
+  { try {
+     _out.open( file.generic_string().c_str(), std::ios::binary | std::ios::trunc );
+     FC_ASSERT( _out.good(), "unable to create ${file}", ("file",file) );
+  } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+  void state_file_writer::write( const char* data, size_t len )
+  {
+     _checksum.write( data, len );
+     _out.write( data, len );
+     FC_ASSERT( _out.good() );
+  }
+
+  void state_file_writer::finish()
+  {
+     auto checksum = _checksum.result();
+     _out.write( checksum.data(), checksum.data_size() );
+     _out.close();
+     FC_ASSERT( !_out.fail(), "error writing the state file" );
+  }
+
+  state_file_reader::state_file_reader( const fc::path& file )
+  :_remaining(0)
+  { try {
+     _in.open( file.generic_string().c_str(), std::ios::binary );
+     FC_ASSERT( _in.good(), "unable to open ${file}", ("file",file) );
+
+     _in.seekg( 0, std::ios::end );
+     uint64_t size = _in.tellg();
+     fc::sha256 expected;
+     FC_ASSERT( size >= expected.data_size(), "${file} is too short", ("file",file) );
+     _remaining = size - expected.data_size();
+
+     // the whole file is checked before any of it is used
+     _in.seekg( 0, std::ios::beg );
+     fc::sha256::encoder checksum;
+     std::vector<char> buffer( 1024*1024 );
+     for( uint64_t left = _remaining; left > 0; )
+     {
+        size_t len = std::min<uint64_t>( left, buffer.size() );
+        _in.read( buffer.data(), len );
+        FC_ASSERT( _in.good() );
+        checksum.write( buffer.data(), len );
+        left -= len;
+     }
+     _in.read( expected.data(), expected.data_size() );
+     FC_ASSERT( _in.good() && checksum.result() == expected, "${file} is corrupt, its checksum does not match", ("file",file) );
+
+     _in.seekg( 0, std::ios::beg );
+  } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+  bool state_file_reader::read( char* data, size_t len )
+  {
+     FC_ASSERT( len <= _remaining, "unexpected end of the state file" );
+     _in.read( data, len );
+     FC_ASSERT( _in.good() );
+     _remaining -= len;
+     return true;
+  }
+
+} } // bts::db
@@ -1,8 +1,12 @@
 #include <bts/db/upgrade_leveldb.hpp>
+#include <leveldb/write_batch.h>
 #include <boost/filesystem.hpp>
 #include <fc/log/logger.hpp>
 #include <fstream>
 
+#define KEY_ENCODING_FILENAME "KEY_ENCODING"
+#define KEY_ENCODING_VERSION  "ordered_key 1"
+
 
 TUpgradeDbMapper* TUpgradeDbMapper::_updateDbMapper = nullptr;
 // this code has no bitshares dependencies, and it
@@ -77,3 +81,124 @@ void UpgradeDbIfNecessary(fc::path dir, leveldb::DB* dbase, const char* record_t
 
   }
 }
+
+void MarkDbKeysOrdered(fc::path dir)
+{
+  fc::path key_encoding_filename = dir / KEY_ENCODING_FILENAME;
+  if ( !boost::filesystem::exists( key_encoding_filename ) )
+  {
+    std::ofstream os(key_encoding_filename.to_native_ansi_path());
+    os << KEY_ENCODING_VERSION << std::endl;
+  }
+}
+
+//the converted database is only marked once it is complete, so a marked upgrade_dir
+//can replace dir. dir is moved aside to old_dir until the converted database is in place,
+//and there is always either a complete database at dir or one that can be moved back there.
+static void ReplaceDbWithUpgrade(const fc::path& dir, const fc::path& upgrade_dir, const fc::path& old_dir)
+{
+  //once old_dir holds the original, dir can only be the empty directory the map creates
+  if ( boost::filesystem::exists( dir ) && boost::filesystem::exists( old_dir ) )
+    boost::filesystem::remove_all( dir.to_native_ansi_path() );
+  else if ( boost::filesystem::exists( dir ) )
+    boost::filesystem::rename( dir.to_native_ansi_path(), old_dir.to_native_ansi_path() );
+  boost::filesystem::rename( upgrade_dir.to_native_ansi_path(), dir.to_native_ansi_path() );
+  boost::filesystem::remove_all( old_dir.to_native_ansi_path() );
+}
+
+//finishes or rolls back a conversion that was interrupted
+static void RecoverDbKeysUpgrade(const fc::path& dir, const fc::path& upgrade_dir, const fc::path& old_dir)
+{
+  if ( boost::filesystem::exists( upgrade_dir / KEY_ENCODING_FILENAME ) )
+  {
+    ilog("Finishing the interrupted conversion of database ${db}",("db",dir.to_native_ansi_path()));
+    ReplaceDbWithUpgrade( dir, upgrade_dir, old_dir );
+    return;
+  }
+  //a conversion that did not complete is started over from the original
+  if ( boost::filesystem::exists( upgrade_dir ) )
+    boost::filesystem::remove_all( upgrade_dir.to_native_ansi_path() );
+  if ( boost::filesystem::exists( old_dir ) )
+  {
+    if ( boost::filesystem::exists( dir / KEY_ENCODING_FILENAME ) )
+    {
+      //the converted database was already moved into place
+      boost::filesystem::remove_all( old_dir.to_native_ansi_path() );
+    }
+    else if ( !boost::filesystem::exists( dir / "CURRENT" ) )
+    {
+      wlog("Restoring database ${db} from ${old}",("db",dir.to_native_ansi_path())("old",old_dir.to_native_ansi_path()));
+      boost::filesystem::remove_all( dir.to_native_ansi_path() );
+      boost::filesystem::rename( old_dir.to_native_ansi_path(), dir.to_native_ansi_path() );
+    }
+    else
+    {
+      FC_THROW_EXCEPTION( exception, "Both ${db} and ${old} hold a database, remove the one that is not wanted",
+                          ("db",dir)("old",old_dir) );
+    }
+  }
+}
+
+void UpgradeDbKeysIfNecessary(fc::path dir, const leveldb::Comparator* legacy_comparator, TRecodeKeyFunction recode_key)
+{
+  fc::path upgrade_dir = dir.parent_path() / (dir.filename().generic_string() + ".upgrade");
+  fc::path old_dir     = dir.parent_path() / (dir.filename().generic_string() + ".old");
+  RecoverDbKeysUpgrade( dir, upgrade_dir, old_dir );
+
+  //a database that was never opened, or already uses ordered keys
+  if ( !boost::filesystem::exists( dir / "CURRENT" ) || boost::filesystem::exists( dir / KEY_ENCODING_FILENAME ) )
+    return;
+
+  ilog("Converting keys of database ${db} to the ordered encoding",("db",dir.to_native_ansi_path()));
+
+  leveldb::Options legacy_opts;
+  legacy_opts.comparator = legacy_comparator;
+  leveldb::DB* legacy_db = nullptr;
+  auto status = leveldb::DB::Open( legacy_opts, dir.to_native_ansi_path(), &legacy_db );
+  if (!status.ok())
+    FC_THROW_EXCEPTION( exception, "Unable to open legacy database ${db}: ${msg}", ("db",dir)("msg", status.ToString() ) );
+  std::unique_ptr<leveldb::DB> legacy_dbase(legacy_db);
+
+  leveldb::Options opts;
+  opts.create_if_missing = true;
+  opts.error_if_exists = true;
+  leveldb::DB* new_db = nullptr;
+  status = leveldb::DB::Open( opts, upgrade_dir.to_native_ansi_path(), &new_db );
+  if (!status.ok())
+    FC_THROW_EXCEPTION( exception, "Unable to create database ${db}: ${msg}", ("db",upgrade_dir)("msg", status.ToString() ) );
+  std::unique_ptr<leveldb::DB> new_dbase(new_db);
+
+  uint64_t converted = 0;
+  leveldb::WriteBatch batch;
+  std::unique_ptr<leveldb::Iterator> legacy_itr( legacy_dbase->NewIterator(leveldb::ReadOptions()) );
+  for (legacy_itr->SeekToFirst(); legacy_itr->Valid(); legacy_itr->Next())
+  {
+    batch.Put( recode_key( legacy_itr->key() ), legacy_itr->value() );
+    if (++converted % 1000 == 0)
+    {
+      status = new_dbase->Write( leveldb::WriteOptions(), &batch );
+      if (!status.ok())
+        FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
+      batch.Clear();
+    }
+  }
+  if (!legacy_itr->status().ok())
+    FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", legacy_itr->status().ToString() ) );
+  leveldb::WriteOptions sync_opts;
+  sync_opts.sync = true;
+  status = new_dbase->Write( sync_opts, &batch );
+  if (!status.ok())
+    FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
+
+  legacy_itr.reset();
+  legacy_dbase.reset();
+  new_dbase.reset();
+
+  //carry the value versioning over to the converted database
+  if ( boost::filesystem::exists( dir / "RECORD_TYPE" ) )
+    boost::filesystem::copy_file( (dir / "RECORD_TYPE").to_native_ansi_path(), (upgrade_dir / "RECORD_TYPE").to_native_ansi_path() );
+  MarkDbKeysOrdered( upgrade_dir );
+
+  ReplaceDbWithUpgrade( dir, upgrade_dir, old_dir );
+  ilog("Converted ${n} keys of database ${db}",("n",converted)("db",dir.to_native_ansi_path()));
+}
@@ -0,0 +1,126 @@
+#include <bts/db/write_batch.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+
+namespace bts { namespace db {
+
+  void undo_journal::record( const std::string& key, const fc::optional<std::string>& prior )
+  {
+     if( !_keys.insert( key ).second ) return;
+     undo_entry e;
+     e.key   = key;
+     e.value = prior;
+     _entries.push_back( e );
+  }
+
+  void undo_journal::revert( const std::vector<undo_entry>& entries, write_batch& batch, ldb::DB* db )
+  {
+     for( auto itr = entries.rbegin(); itr != entries.rend(); ++itr )
+     {
+        if( itr->value ) batch.put( db, itr->key, *itr->value );
+        else             batch.remove( db, itr->key );
+     }
+  }
+
+  write_batch::write_batch()
+  :_operations(0),_undo_db(nullptr),_undo(nullptr){}
+
+  write_batch::~write_batch()
+  {
+     try {
+        discard();
+     }
+     catch ( const fc::exception& e )
+     {
+        wlog( "${e}", ("e",e.to_detail_string()) );
+     }
+  }
+
+  void write_batch::join( batch_participant* p, ldb::DB* db )
+  {
+     FC_ASSERT( p != nullptr );
+     FC_ASSERT( db != nullptr );
+     if( std::find( _participants.begin(), _participants.end(), p ) == _participants.end() )
+     {
+        _participants.push_back(p);
+     }
+     batch_for(db);
+  }
+
+  void write_batch::leave( batch_participant* p )
+  {
+     _participants.erase( std::remove( _participants.begin(), _participants.end(), p ), _participants.end() );
+  }
+
+  ldb::WriteBatch& write_batch::batch_for( ldb::DB* db )
+  {
+     for( auto itr = _batches.begin(); itr != _batches.end(); ++itr )
+     {
+        if( itr->db == db )
+        {
+           return *itr->batch;
+        }
+     }
+     _batches.push_back( db_batch(db) );
+     return *_batches.back().batch;
+  }
+
+  void write_batch::record_undo( ldb::DB* db, undo_journal* journal )
+  {
+     _undo_db = journal ? db : nullptr;
+     _undo    = journal;
+  }
+
+  void write_batch::put( ldb::DB* db, const ldb::Slice& key, const ldb::Slice& value )
+  {
+     batch_for(db).Put( key, value );
+     ++_operations;
+  }
+
+  void write_batch::remove( ldb::DB* db, const ldb::Slice& key )
+  {
+     batch_for(db).Delete( key );
+     ++_operations;
+  }
+
+  void write_batch::commit( bool sync )
+  { try {
+     ldb::WriteOptions opts;
+     opts.sync = sync;
+     for( auto itr = _batches.begin(); itr != _batches.end(); ++itr )
+     {
+        auto status = itr->db->Write( opts, itr->batch.get() );
+        if( !status.ok() )
+        {
+           FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
+        }
+     }
+     _batches.clear();
+     _operations = 0;
+     record_undo( nullptr, nullptr );
+
+     auto participants = std::move(_participants);
+     _participants.clear();
+     for( auto itr = participants.begin(); itr != participants.end(); ++itr )
+     {
+        (*itr)->batch_committed();
+     }
+  } FC_RETHROW_EXCEPTIONS( warn, "error committing batch of ${n} operations", ("n",_operations) ) }
+
+  void write_batch::discard()
+  {
+     _batches.clear();
+     _operations = 0;
+     record_undo( nullptr, nullptr );
+
+     auto participants = std::move(_participants);
+     _participants.clear();
+     for( auto itr = participants.begin(); itr != participants.end(); ++itr )
+     {
+        (*itr)->batch_discarded();
+     }
+  }
+
+} } // bts::db
@@ -253,7 +253,7 @@ namespace mail {
       ilog( "listening for stcp connections on port ${p}", ("p",c.port) );
       my->tcp_serv.listen( c.port );
       my->accept_loop_complete = fc::async( [=](){ my->accept_loop(); } ); 
-      my->_message_db.open( "message_db" );
+      my->_message_db.open( "message_db", true, c.message_db_options );
 
     } FC_RETHROW_EXCEPTIONS( warn, "error configuring server", ("config", c) );
   }
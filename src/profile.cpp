@@ -5,6 +5,7 @@
 #include <bts/addressbook/contact.hpp>
 #include <bts/db/level_map.hpp>
 #include <bts/db/level_pod_map.hpp>
+#include <bts/config.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/io/raw_variant.hpp>
 #include <fc/interprocess/mmap_struct.hpp>
@@ -112,16 +113,8 @@ namespace bts {
       my->_profile_name = profile_dir.filename().generic_wstring();
 
       fc::create_directories( profile_dir );
-      fc::create_directories( profile_dir / "addressbook" );
       fc::create_directories( profile_dir / "idents" );
       fc::create_directories( profile_dir / "mail" );
-      fc::create_directories( profile_dir / "mail" / "inbox" );
-      fc::create_directories( profile_dir / "mail" / "draft" );
-      fc::create_directories( profile_dir / "mail" / "pending" );
-      fc::create_directories( profile_dir / "mail" / "sent" );
-      fc::create_directories( profile_dir / "chat" );
-      fc::create_directories( profile_dir / "request" );
-      fc::create_directories( profile_dir / "authorization" );
 
       ilog("loading master key file:" KEYHOTEE_MASTER_KEY_FILE);
       auto profile_cfg_key         = fc::sha512::hash( password.c_str(), password.size() );
@@ -137,15 +130,21 @@ namespace bts {
 
       ilog("opening profile databases");
       my->_keychain.set_seed( fc::raw::unpack<fc::sha512>(stretched_seed_data) );
-      my->_addressbook->open( profile_dir / "addressbook", profile_cfg_key );
+      // the addressbook and message databases share one leveldb, the identities keep
+      // their own because wallet_identity is upgraded through REGISTER_DB_OBJECT
+      db::database_options profile_db_options;
+      profile_db_options.cache_size = BITCHAT_DB_CACHE_BYTES;
+      auto profile_db = std::make_shared<db::database>();
+      profile_db->open( profile_dir / "database", true, profile_db_options );
+      my->_addressbook->open( profile_db, profile_cfg_key, profile_dir / "addressbook" );
       my->_idents.open( profile_dir / "idents" );
-      my->_inbox_db->open( profile_dir / "mail" / "inbox", profile_cfg_key );
-      my->_draft_db->open( profile_dir / "mail" / "draft", profile_cfg_key );
-      my->_pending_db->open( profile_dir / "mail" / "pending", profile_cfg_key );
-      my->_sent_db->open( profile_dir / "mail" / "sent", profile_cfg_key );
-      my->_chat_db->open( profile_dir / "chat", profile_cfg_key );
-      my->_request_db->open( profile_dir / "request", profile_cfg_key );
-      my->_auth_db->open( profile_dir / "authorization", profile_cfg_key );
+      my->_inbox_db->open( profile_db, "inbox", profile_cfg_key, profile_dir / "mail" / "inbox" );
+      my->_draft_db->open( profile_db, "draft", profile_cfg_key, profile_dir / "mail" / "draft" );
+      my->_pending_db->open( profile_db, "pending", profile_cfg_key, profile_dir / "mail" / "pending" );
+      my->_sent_db->open( profile_db, "sent", profile_cfg_key, profile_dir / "mail" / "sent" );
+      my->_chat_db->open( profile_db, "chat", profile_cfg_key, profile_dir / "chat" );
+      my->_request_db->open( profile_db, "request", profile_cfg_key, profile_dir / "request" );
+      my->_auth_db->open( profile_db, "authorization", profile_cfg_key, profile_dir / "authorization" );
       my->_last_sync_time.open( profile_dir / "mail" / "last_recv", true );
       if( *my->_last_sync_time == fc::time_point())
       {
@@ -0,0 +1,62 @@
+#include <bts/signature_cache.hpp>
+#include <fc/exception/exception.hpp>
+
+namespace bts {
+
+  recovered_key::recovered_key( const fc::ecc::public_key& k )
+  :key(k),addr(k)
+  {
+     // note: 56 is the version bit of protoshares
+     pts_addrs[0] = pts_address( k, false, 56 );
+     pts_addrs[1] = pts_address( k, true,  56 );
+     // note: 5 comes from en.bitcoin.it/wiki/Vanitygen where version bit is 0
+     pts_addrs[2] = pts_address( k, false, 0 );
+     pts_addrs[3] = pts_address( k, true,  0 );
+  }
+
+  signature_cache::signature_cache( uint64_t max_entries )
+  {
+     _cache.set_limits( max_entries, 0 );
+  }
+
+  signature_cache& signature_cache::instance()
+  {
+     static signature_cache cache;
+     return cache;
+  }
+
+  recovered_key_ptr signature_cache::recover( const fc::sha256& digest, const fc::ecc::compact_signature& sig )
+  {
+     std::string key( (const char*)&digest, sizeof(digest) );
+     key.append( (const char*)sig.data, sizeof(sig) );
+     {
+        std::lock_guard<std::mutex> lock( _mutex );
+        auto cached = _cache.get( key );
+        if( cached ) return *cached;
+     }
+
+     auto result = std::make_shared<const recovered_key>( fc::ecc::public_key( sig, digest ) );
+
+     std::lock_guard<std::mutex> lock( _mutex );
+     _cache.put( key, result, sizeof(recovered_key) );
+     return result;
+  }
+
+  void signature_cache::set_max_entries( uint64_t max_entries )
+  {
+     std::lock_guard<std::mutex> lock( _mutex );
+     _cache.set_limits( max_entries, 0 );
+  }
+
+  db::cache_stats signature_cache::get_stats()const
+  {
+     std::lock_guard<std::mutex> lock( _mutex );
+     return _cache.stats();
+  }
+
+  fc::ecc::public_key recover_public_key( const fc::ecc::compact_signature& sig, const fc::sha256& digest )
+  {
+     return signature_cache::instance().recover( digest, sig )->key;
+  }
+
+} // bts
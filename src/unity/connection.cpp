@@ -2,6 +2,7 @@
 #include <unity/messages.hpp>
 #include <mail/message.hpp>
 #include <bts/config.hpp>
+#include <bts/signature_cache.hpp>
 
 #include <fc/network/tcp_socket.hpp>
 #include <fc/network/resolve.hpp>
@@ -39,7 +40,7 @@ namespace unity {
 
   fc::ecc::public_key          subscribe_message::signee()const
   {
-     return fc::ecc::public_key( sig, digest() ); 
+     return bts::recover_public_key( sig, digest() ); 
   }
 
   namespace detail
@@ -1,4 +1,5 @@
 #include <unity/node.hpp>
+#include <bts/signature_cache.hpp>
 #include <algorithm>
 #include <fc/exception/exception.hpp>
 #include <fc/io/raw.hpp>
@@ -23,7 +24,7 @@ namespace unity
 
    bts::address   signed_proposal::get_signee_id()const
    {
-      return bts::address( fc::ecc::public_key( node_signature, digest() ) );
+      return bts::signature_cache::instance().recover( digest(), node_signature )->addr;
    }
    namespace detail
    {
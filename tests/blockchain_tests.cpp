@@ -8,6 +8,7 @@
 #include <bts/blockchain/asset.hpp>
 #include <fc/crypto/hex.hpp>
 #include <bts/blockchain/blockchain_db.hpp>
+#include <bts/blockchain/mempool.hpp>
 #include <bts/config.hpp>
 #include <fc/io/json.hpp>
 #include <fc/io/raw.hpp>
@@ -16,6 +17,14 @@
 #include <bts/keychain.hpp>
 #include <bts/bitname/bitname_db.hpp>
 #include <bts/bitname/bitname_block.hpp>
+#include <bts/db/level_map.hpp>
+#include <bts/db/write_batch.hpp>
+#include <bts/db/database.hpp>
+#include <bts/blockchain/signature_recovery.hpp>
+#include <bts/signature_cache.hpp>
+#include <bts/blockchain/block_pipeline.hpp>
+#include <bts/blockchain/block_archive.hpp>
+#include <bts/blockchain/blockchain_market_db.hpp>
 #include <fstream>
 
 using namespace bts;
@@ -192,6 +201,1687 @@ BOOST_AUTO_TEST_CASE( mining_reward_rate )
 }
 */
 
+BOOST_AUTO_TEST_CASE( level_map_write_batch )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::db::level_map<uint32_t,std::string> map_a;
+    bts::db::level_map<uint32_t,std::string> map_b;
+    map_a.open( temp_dir.path() / "a" );
+    map_b.open( temp_dir.path() / "b" );
+    map_a.store( 1, "one" );
+
+    {
+       bts::db::write_batch batch;
+       map_a.join( batch );
+       map_b.join( batch );
+       map_a.remove( 1 );
+       map_b.store( 2, "two" );
+       BOOST_CHECK( !map_a.fetch_optional( 1 ) );
+       BOOST_CHECK( map_b.fetch( 2 ) == "two" );
+       // batch is discarded when it goes out of scope
+    }
+    BOOST_CHECK( map_a.fetch( 1 ) == "one" );
+    BOOST_CHECK( !map_b.fetch_optional( 2 ) );
+
+    bts::db::write_batch batch;
+    map_a.join( batch );
+    map_b.join( batch );
+    map_a.remove( 1 );
+    map_b.store( 2, "two" );
+    batch.commit();
+    BOOST_CHECK( !map_a.fetch_optional( 1 ) );
+    BOOST_CHECK( map_b.fetch( 2 ) == "two" );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( level_map_cache )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::db::level_map<uint32_t,std::string> map;
+    map.open( temp_dir.path() / "map" );
+    map.store( 1, "one" );
+    map.store( 2, "two" );
+    map.store( 3, "three" );
+    map.set_cache_limits( 2, 0 );
+
+    // the least recently used value is evicted at capacity
+    map.fetch( 1 );
+    map.fetch( 2 );
+    map.fetch( 1 );
+    map.fetch( 3 );
+    auto stats = map.get_cache_stats();
+    BOOST_CHECK_EQUAL( stats.misses, 3u );
+    BOOST_CHECK_EQUAL( stats.hits, 1u );
+    BOOST_CHECK_EQUAL( stats.entries, 2u );
+    BOOST_CHECK_EQUAL( stats.evictions, 1u );
+    map.fetch( 1 );
+    map.fetch( 3 );
+    BOOST_CHECK_EQUAL( map.get_cache_stats().hits, 3u );
+    map.fetch( 2 );
+    BOOST_CHECK_EQUAL( map.get_cache_stats().misses, 4u );
+
+    // writes replace the cached value
+    map.store( 2, "dos" );
+    BOOST_CHECK( map.fetch( 2 ) == "dos" );
+    map.remove( 2 );
+    BOOST_CHECK( !map.fetch_optional( 2 ) );
+
+    // a discarded batch leaves the stored value, a committed one replaces it
+    BOOST_CHECK( map.fetch( 3 ) == "three" );
+    {
+       bts::db::write_batch batch;
+       map.join( batch );
+       map.store( 3, "tres" );
+       BOOST_CHECK( map.fetch( 3 ) == "tres" );
+    }
+    BOOST_CHECK( map.fetch( 3 ) == "three" );
+    {
+       bts::db::write_batch batch;
+       map.join( batch );
+       map.store( 3, "drei" );
+       map.remove( 1 );
+       batch.commit();
+    }
+    BOOST_CHECK( map.fetch( 3 ) == "drei" );
+    BOOST_CHECK( !map.fetch_optional( 1 ) );
+
+    map.set_cache_limits( 0, 0 );
+    BOOST_CHECK_EQUAL( map.get_cache_stats().entries, 0u );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( level_map_shared_database )
+{
+  try {
+    fc::temp_directory temp_dir;
+    {
+       bts::db::level_map<uint32_t,std::string> standalone;
+       standalone.open( temp_dir.path() / "standalone" );
+       standalone.store( 3, "three" );
+    }
+
+    auto shared_db = std::make_shared<bts::db::database>();
+    shared_db->open( temp_dir.path() / "database" );
+    bts::db::level_map<uint32_t,std::string> map_a;
+    bts::db::level_map<uint32_t,std::string> map_b;
+    map_a.open( shared_db, "a" );
+    map_b.open( shared_db, "b" );
+
+    uint32_t last_key = 0;
+    map_b.store( 1, "one" );
+    BOOST_CHECK( !map_a.begin().valid() );
+    BOOST_CHECK( !map_a.last( last_key ) );
+
+    map_a.import_standalone( temp_dir.path() / "standalone" );
+    BOOST_CHECK( !fc::exists( temp_dir.path() / "standalone" ) );
+    BOOST_CHECK( map_a.fetch( 3 ) == "three" );
+    BOOST_CHECK( map_a.last( last_key ) && last_key == 3 );
+    BOOST_CHECK( map_b.last( last_key ) && last_key == 1 );
+    BOOST_CHECK( !map_b.find( 3 ).valid() );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( level_map_leaves_batch )
+{
+  try {
+    typedef bts::db::level_map<uint32_t,std::string> string_map;
+    fc::temp_directory temp_dir;
+    auto shared_db = std::make_shared<bts::db::database>();
+    shared_db->open( temp_dir.path() / "shared" );
+    string_map kept;
+    kept.open( shared_db, "kept" );
+
+    // destroying one map does not drop what the other maps wrote to the batch
+    bts::db::write_batch batch;
+    kept.join( batch );
+    kept.store( 1, "one" );
+    {
+       string_map gone;
+       gone.open( shared_db, "gone" );
+       gone.join( batch );
+       gone.store( 2, "two" );
+    }
+    kept.store( 3, "three" );
+    batch.commit();
+
+    BOOST_CHECK( kept.fetch( 1 ) == "one" );
+    BOOST_CHECK( kept.fetch( 3 ) == "three" );
+    string_map reopened;
+    reopened.open( shared_db, "gone" );
+    BOOST_CHECK( reopened.fetch( 2 ) == "two" );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( database_options )
+{
+  try {
+    fc::temp_directory temp_dir;
+
+    bts::db::database_options defaults;
+    BOOST_CHECK_EQUAL( defaults.bloom_filter_bits, uint32_t(DB_BLOOM_FILTER_BITS) );
+    auto chain_defaults = bts::blockchain::blockchain_db::default_database_options();
+    BOOST_CHECK_EQUAL( chain_defaults.cache_size, uint64_t(BLOCKCHAIN_DB_CACHE_BYTES) );
+    BOOST_CHECK_EQUAL( chain_defaults.write_buffer_size, uint64_t(BLOCKCHAIN_DB_WRITE_BUFFER_BYTES) );
+
+    // a small block size spreads the keys over many blocks so the filter and
+    // the uncompressed tables are exercised on lookups and misses
+    bts::db::database_options opts;
+    opts.bloom_filter_bits = 0;
+    opts.cache_size        = 64*1024;
+    opts.write_buffer_size = 64*1024;
+    opts.block_size        = 256;
+    opts.compression       = false;
+    {
+       auto shared_db = std::make_shared<bts::db::database>();
+       shared_db->open( temp_dir.path() / "shared", true, opts );
+       BOOST_CHECK_EQUAL( shared_db->get_options().bloom_filter_bits, 0u );
+       BOOST_CHECK_EQUAL( shared_db->get_options().block_size, 256u );
+       BOOST_CHECK( !shared_db->get_options().compression );
+
+       bts::db::level_map<uint32_t,std::string> map;
+       map.open( shared_db, "map" );
+       for( uint32_t i = 0; i < 2000; i += 2 )
+          map.store( i, fc::variant(i).as_string() );
+    }
+
+    // reopening the same data with a bloom filter and compression keeps every value
+    opts.bloom_filter_bits = 10;
+    opts.compression       = true;
+    auto shared_db = std::make_shared<bts::db::database>();
+    shared_db->open( temp_dir.path() / "shared", true, opts );
+    BOOST_CHECK_EQUAL( shared_db->get_options().bloom_filter_bits, 10u );
+    bts::db::level_map<uint32_t,std::string> map;
+    map.open( shared_db, "map" );
+    for( uint32_t i = 0; i < 2000; ++i )
+    {
+       auto value = map.fetch_optional( i );
+       BOOST_CHECK_EQUAL( bool(value), i % 2 == 0 );
+       if( value ) BOOST_CHECK( *value == fc::variant(i).as_string() );
+    }
+
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain", true, opts );
+    BOOST_CHECK_EQUAL( chain.get_database_options().cache_size, opts.cache_size );
+    BOOST_CHECK_EQUAL( chain.get_database_options().block_size, opts.block_size );
+    chain.close();
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( level_map_visit )
+{
+  try {
+    typedef bts::db::level_map<uint32_t,std::string> string_map;
+    fc::temp_directory temp_dir;
+    string_map map;
+    map.open( temp_dir.path() / "map" );
+    map.store( 1, "one" );
+
+    std::string value;
+    BOOST_CHECK( map.exists( 1 ) );
+    BOOST_CHECK( !map.exists( 2 ) );
+    BOOST_CHECK( map.visit( 1, [&]( const string_map::value_view& v ){ v.unpack( value ); } ) );
+    BOOST_CHECK( value == "one" );
+    BOOST_CHECK( !map.visit( 2, [&]( const string_map::value_view& v ){ v.unpack( value ); } ) );
+
+    bts::db::write_batch batch;
+    map.join( batch );
+    map.remove( 1 );
+    BOOST_CHECK( !map.exists( 1 ) );
+    batch.commit();
+
+    map.store( 3, "three" );
+    auto itr = map.begin();
+    BOOST_REQUIRE( itr.valid() );
+    itr.value( value );
+    BOOST_CHECK( value == "three" );
+    BOOST_CHECK( itr.view().value() == "three" );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( level_map_nested_visit )
+{
+  try {
+    typedef bts::db::level_map<uint32_t,std::string> string_map;
+    fc::temp_directory temp_dir;
+    string_map map;
+    map.open( temp_dir.path() / "map" );
+    map.store( 1, "one" );
+    map.store( 2, "two" );
+
+    // visiting the map inside the callback leaves the view being visited intact,
+    // whether it points at the packed bytes or at a cached value
+    for( uint32_t cache_entries = 0; cache_entries < 2; ++cache_entries )
+    {
+       map.set_cache_limits( cache_entries, 0 );
+       map.fetch( 1 );
+       bool found = map.visit( 1, [&]( const string_map::value_view& one )
+       {
+          BOOST_CHECK( map.exists( 2 ) );
+          BOOST_CHECK( !map.exists( 3 ) );
+          map.visit( 2, [&]( const string_map::value_view& two ){ BOOST_CHECK( two.value() == "two" ); } );
+          BOOST_CHECK( one.value() == "one" );
+       } );
+       BOOST_CHECK( found );
+    }
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( level_map_snapshot )
+{
+  try {
+    typedef bts::db::level_map<uint32_t,std::string> string_map;
+    fc::temp_directory temp_dir;
+    string_map map;
+    map.open( temp_dir.path() / "map" );
+    map.store( 1, "one" );
+    map.store( 2, "two" );
+
+    auto snap = map.get_database()->create_snapshot();
+    map.store( 3, "three" );
+    map.remove( 1 );
+
+    BOOST_CHECK( map.exists( 1, snap ) );
+    BOOST_CHECK( !map.exists( 3, snap ) );
+    BOOST_CHECK( !map.exists( 1 ) );
+    BOOST_CHECK( map.fetch( 1, snap ) == "one" );
+
+    uint32_t count = 0;
+    for( auto itr = map.begin( snap ); itr.valid(); ++itr )
+       ++count;
+    BOOST_CHECK( count == 2 );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( level_map_undo )
+{
+  try {
+    typedef bts::db::level_map<uint32_t,std::string> string_map;
+    fc::temp_directory temp_dir;
+    string_map map;
+    map.open( temp_dir.path() / "map" );
+    map.store( 1, "one" );
+    map.store( 2, "two" );
+
+    bts::db::undo_journal undo;
+    {
+       bts::db::write_batch batch;
+       batch.record_undo( map.get_database()->get_db(), &undo );
+       map.join( batch );
+       map.store( 1, "uno" );
+       map.store( 1, "eins" );
+       map.remove( 2 );
+       map.store( 3, "three" );
+       batch.commit();
+    }
+    BOOST_CHECK( undo.entries().size() == 3 );
+    BOOST_CHECK( map.fetch( 1 ) == "eins" );
+
+    bts::db::write_batch batch;
+    bts::db::undo_journal::revert( undo.entries(), batch, map.get_database()->get_db() );
+    batch.commit();
+    map.clear_cache();
+
+    BOOST_CHECK( map.fetch( 1 ) == "one" );
+    BOOST_CHECK( map.fetch( 2 ) == "two" );
+    BOOST_CHECK( !map.exists( 3 ) );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( level_map_visit_sorted )
+{
+  try {
+    typedef bts::db::level_map<uint32_t,std::string> string_map;
+    fc::temp_directory temp_dir;
+    string_map map;
+    map.open( temp_dir.path() / "map" );
+    for( uint32_t i = 0; i < 100; i += 2 )
+       map.store( i, std::to_string( i ) );
+
+    std::vector<uint32_t> keys = { 0, 1, 2, 50, 51, 98, 200 };
+    std::vector<std::string> values( keys.size() );
+    auto read = [&]( size_t i, const string_map::value_view& v ){ v.unpack( values[i] ); };
+    BOOST_CHECK_EQUAL( map.visit_sorted( keys, read ), 4u );
+    BOOST_CHECK( values[0] == "0" && values[2] == "2" && values[3] == "50" && values[5] == "98" );
+    BOOST_CHECK( values[1].empty() && values[4].empty() && values[6].empty() );
+
+    // pending writes are seen before they are committed
+    bts::db::write_batch batch;
+    map.join( batch );
+    map.store( 1, "one" );
+    map.remove( 2 );
+    values.assign( keys.size(), std::string() );
+    BOOST_CHECK_EQUAL( map.visit_sorted( keys, read ), 4u );
+    BOOST_CHECK( values[1] == "one" && values[2].empty() );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( ordered_key_encoding )
+{
+  try {
+    std::vector<trx_num> nums = { trx_num(0,5), trx_num(1,0), trx_num(1,1), trx_num(256,0), trx_num(70000,2) };
+    for( uint32_t i = 0; i < nums.size(); ++i )
+    {
+       for( uint32_t j = 0; j < nums.size(); ++j )
+       {
+          BOOST_CHECK( (nums[i] < nums[j]) == (bts::db::encode_key(nums[i]) < bts::db::encode_key(nums[j])) );
+       }
+       trx_num decoded;
+       std::string encoded = bts::db::encode_key( nums[i] );
+       bts::db::decode_key( encoded.data(), encoded.size(), decoded );
+       BOOST_CHECK( decoded == nums[i] );
+    }
+    BOOST_CHECK( bts::db::encode_key( int64_t(-1) ) < bts::db::encode_key( int64_t(0) ) );
+    BOOST_CHECK( bts::db::encode_key( std::string("a") ) < bts::db::encode_key( std::string("a\0",2) ) );
+    BOOST_CHECK( bts::db::encode_key( std::string("a\0",2) ) < bts::db::encode_key( std::string("ab") ) );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( output_num_key_order )
+{
+  try {
+    // the spent outputs of a transaction must be adjacent so they can be read with one seek
+    std::vector<output_num> nums = { output_num( trx_num(1,0), 0 ), output_num( trx_num(1,0), 255 ),
+                                     output_num( trx_num(1,1), 0 ), output_num( trx_num(2,0), 3 ) };
+    for( uint32_t i = 1; i < nums.size(); ++i )
+    {
+       BOOST_CHECK( bts::db::encode_key( nums[i-1] ) < bts::db::encode_key( nums[i] ) );
+    }
+    output_num decoded;
+    std::string encoded = bts::db::encode_key( nums[1] );
+    bts::db::decode_key( encoded.data(), encoded.size(), decoded );
+    BOOST_CHECK( decoded.trx_id == nums[1].trx_id && decoded.output_idx == 255 );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+/** a genesis block for @param chain paying 100 BTS to @param key */
+trx_block create_test_genesis_block( blockchain_db& chain, const fc::ecc::private_key& key )
+{
+    trx_block genesis;
+    genesis.version      = 0;
+    genesis.block_num    = 0;
+    genesis.total_shares = 100*COIN;
+    genesis.timestamp    = fc::time_point::from_iso_string( "20131201T054434" );
+
+    signed_transaction coinbase;
+    coinbase.outputs.push_back( trx_output( claim_by_signature_output( address( key.get_public_key() ) ), asset( 100., asset::bts ) ) );
+    genesis.trxs.push_back( coinbase );
+    genesis.next_fee  = genesis.calculate_next_fee( chain.get_fee_rate().get_rounded_amount(), genesis.block_size() );
+    genesis.trx_mroot = genesis.calculate_merkle_root();
+    return genesis;
+}
+
+/**
+ *  the block after the head of @param chain, spaced one block interval after it so the difficulty stays put
+ *
+ *  @param strip_signatures - drop the signatures of the trxs once they are picked, such a block is only
+ *                            accepted under an assume valid checkpoint
+ */
+trx_block create_test_block( blockchain_db& chain, const std::vector<signed_transaction>& trxs, bool strip_signatures = false )
+{
+    auto head = chain.fetch_block( chain.head_block_num() );
+    auto b    = chain.generate_next_block( trxs );
+    if( strip_signatures )
+    {
+       for( auto trx = b.trxs.begin(); trx != b.trxs.end(); ++trx )
+       {
+          trx->sigs.clear();
+       }
+       b.trx_mroot = b.calculate_merkle_root();
+    }
+    b.timestamp      = fc::time_point_sec( head.timestamp.sec_since_epoch() + BLOCK_INTERVAL*60 );
+    b.avail_coindays = 0;
+    b.next_fee       = b.calculate_next_fee( chain.get_fee_rate().get_rounded_amount(), b.block_size() );
+    while( b.get_difficulty() < b.get_required_difficulty( head.next_difficulty, head.avail_coindays ) )
+    {
+       ++b.noncea;
+    }
+    return b;
+}
+
+/** spends @param amount held by @param key at @param in to @param outputs, paying the change back to @param key last */
+signed_transaction create_test_spend( const fc::ecc::private_key& key, const output_reference& in,
+                                      const asset& amount, std::vector<trx_output> outputs = std::vector<trx_output>() )
+{
+    signed_transaction trx;
+    trx.inputs.push_back( trx_input( in ) );
+    asset change = amount - asset( uint64_t(100000), asset::bts );
+    for( auto out = outputs.begin(); out != outputs.end(); ++out )
+    {
+       change -= out->amount;
+    }
+    trx.outputs = std::move( outputs );
+    trx.outputs.push_back( trx_output( claim_by_signature_output( address( key.get_public_key() ) ), change ) );
+    trx.sign( key );
+    return trx;
+}
+
+BOOST_AUTO_TEST_CASE( push_pop_block_state )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+
+    auto key     = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "push_pop", 8 ) );
+    auto owner   = address( key.get_public_key() );
+    auto genesis = create_test_genesis_block( chain, key );
+    chain.push_block( genesis );
+
+    // everything a block changes besides the trxs it stores
+    auto to     = fc::time_point_sec( genesis.timestamp.sec_since_epoch() + 86400 );
+    auto state  = [&]() -> std::string
+    {
+       return fc::json::to_string( chain.fetch_trx( chain.fetch_trx_num( genesis.trxs[0].id() ) ).meta_outputs ) +
+              fc::json::to_string( chain.get_market( asset::usd, asset::bts ) ) +
+              fc::json::to_string( chain.get_market_depth( asset::usd ) ) +
+              fc::json::to_string( chain.get_market_history( asset::usd, asset::bts, genesis.timestamp, to ) ) +
+              fc::json::to_string( chain.get_market_history( asset::gld, asset::usd, genesis.timestamp, to ) );
+    };
+    auto genesis_state = state();
+
+    // an ask and a short that do not cross, so the orders stay on the books
+    std::vector<trx_output> orders;
+    orders.push_back( trx_output( claim_by_bid_output( owner, price( 2.0, asset::usd, asset::bts ) ), asset( 10., asset::bts ) ) );
+    orders.push_back( trx_output( claim_by_long_output( owner, price( 1.0, asset::usd, asset::bts ) ), asset( 10., asset::bts ) ) );
+    auto order_trx = create_test_spend( key, output_reference( genesis.trxs[0].id(), 0 ), genesis.trxs[0].outputs[0].amount, orders );
+    auto block1    = create_test_block( chain, std::vector<signed_transaction>( 1, order_trx ) );
+    chain.push_block( block1 );
+    auto block1_state = state();
+    BOOST_CHECK( block1_state != genesis_state );
+    BOOST_CHECK_EQUAL( chain.get_market( asset::usd, asset::bts ).asks.size(), 1u );
+    BOOST_CHECK_EQUAL( chain.get_market( asset::usd, asset::bts ).shorts.size(), 1u );
+    BOOST_CHECK( chain.get_market_depth( asset::usd ) > 0 );
+
+    auto spend  = create_test_spend( key, output_reference( order_trx.id(), 2 ), order_trx.outputs[2].amount );
+    auto block2 = create_test_block( chain, std::vector<signed_transaction>( 1, spend ) );
+    chain.push_block( block2 );
+    BOOST_CHECK( chain.fetch_trx( chain.fetch_trx_num( order_trx.id() ) ).meta_outputs[2].is_spent() );
+    auto block2_state = state();
+
+    // popping restores the state before each block
+    full_block                      popped;
+    std::vector<signed_transaction> popped_trxs;
+    chain.pop_block( popped, popped_trxs );
+    BOOST_CHECK( popped.id() == block2.id() );
+    BOOST_CHECK( state() == block1_state );
+    BOOST_CHECK_THROW( chain.fetch_trx_num( spend.id() ), fc::exception );
+    BOOST_CHECK( !chain.fetch_trx( chain.fetch_trx_num( order_trx.id() ) ).meta_outputs[2].is_spent() );
+    BOOST_CHECK_EQUAL( chain.head_block_num(), 1u );
+    BOOST_CHECK( chain.head_block_id() == block1.id() );
+
+    chain.pop_block( popped, popped_trxs );
+    BOOST_CHECK( popped.id() == block1.id() );
+    BOOST_REQUIRE_EQUAL( popped_trxs.size(), 1u );
+    BOOST_CHECK( popped_trxs[0].id() == order_trx.id() );
+    BOOST_CHECK( state() == genesis_state );
+    BOOST_CHECK_THROW( chain.fetch_trx_num( order_trx.id() ), fc::exception );
+    BOOST_CHECK_EQUAL( chain.get_market_depth( asset::usd ), 0u );
+    BOOST_CHECK_EQUAL( chain.head_block_num(), 0u );
+    BOOST_CHECK( chain.head_block_id() == genesis.id() );
+
+    // and the same blocks apply again on top of it
+    chain.push_block( block1 );
+    BOOST_CHECK( state() == block1_state );
+    chain.push_block( block2 );
+    BOOST_CHECK( state() == block2_state );
+    BOOST_CHECK( chain.head_block_id() == block2.id() );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( signature_recovery )
+{
+  try {
+    std::vector<signed_transaction> trxs( 40 );
+    for( uint32_t i = 0; i < trxs.size(); ++i )
+    {
+       trxs[i].stake = i;
+       trxs[i].sign( fc::ecc::private_key::generate() );
+       if( i % 3 == 0 ) trxs[i].sign( fc::ecc::private_key::generate() );
+    }
+    trxs.push_back( signed_transaction() ); // unsigned
+
+    signature_recovery_pool pool( 4 );
+    auto keys = pool.recover( trxs );
+    BOOST_REQUIRE( keys.size() == trxs.size() );
+    for( uint32_t i = 0; i < trxs.size(); ++i )
+    {
+       BOOST_CHECK( keys[i].addresses() == trxs[i].get_signed_addresses() );
+       BOOST_CHECK( keys[i].pts_addresses() == trxs[i].get_signed_pts_addresses() );
+    }
+    BOOST_CHECK( keys.back().keys.empty() );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( signature_cache_test )
+{
+  try {
+    auto key    = fc::ecc::private_key::generate();
+    auto digest = fc::sha256::hash( "signature cache", 15 );
+    auto sig    = key.sign_compact( digest );
+
+    bts::signature_cache cache( 2 );
+    auto first = cache.recover( digest, sig );
+    BOOST_CHECK( first->addr == bts::address( key.get_public_key() ) );
+    BOOST_CHECK( first->pts_addrs[0] == bts::pts_address( key.get_public_key() ) );
+    BOOST_CHECK( cache.recover( digest, sig ) == first );
+    BOOST_CHECK( cache.get_stats().hits == 1 );
+    BOOST_CHECK( cache.get_stats().misses == 1 );
+
+    // a different digest with the same signature is a different entry
+    auto other = cache.recover( fc::sha256::hash( "other", 5 ), sig );
+    BOOST_CHECK( other != first );
+    BOOST_CHECK( cache.get_stats().entries == 2 );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( hashed_transaction_cache )
+{
+  try {
+    auto key = fc::ecc::private_key::generate();
+    signed_transaction trx;
+    trx.inputs.push_back( trx_input( output_reference( uint160(), 0 ) ) );
+    trx.outputs.push_back( trx_output( claim_by_signature_output( bts::address( key.get_public_key() ) ), asset( 1000, asset::bts ) ) );
+    trx.sign( key );
+
+    hashed_transaction htrx( trx );
+    BOOST_CHECK( htrx.id()     == trx.id() );
+    BOOST_CHECK( htrx.digest() == trx.digest() );
+    BOOST_CHECK( htrx.size()   == trx.size() );
+    BOOST_CHECK( htrx.packed() == fc::raw::pack( trx ) );
+    BOOST_CHECK( htrx.get_signed_addresses() == trx.get_signed_addresses() );
+
+    // copies share the cached state
+    hashed_transaction copy = htrx;
+    BOOST_CHECK( &copy.trx() == &htrx.trx() );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( mempool_admission )
+{
+  try {
+    trx_eval eval;
+    eval.fees = asset( 2000, asset::bts );
+    BOOST_CHECK( eval.fee_rate( 1000 ) == 2000 );
+    BOOST_CHECK( eval.fee_rate( 4000 ) == 500 );
+
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+
+    mempool pool( &chain );
+    BOOST_CHECK( pool.size() == 0 );
+    BOOST_CHECK( pool.get_block_template().size() == 0 );
+
+    // spends an output that does not exist
+    auto key = fc::ecc::private_key::generate();
+    signed_transaction trx;
+    trx.inputs.push_back( trx_input( output_reference( uint160(), 0 ) ) );
+    trx.outputs.push_back( trx_output( claim_by_signature_output( bts::address( key.get_public_key() ) ), asset( 1000, asset::bts ) ) );
+    trx.sign( key );
+
+    hashed_transaction htrx( trx );
+    BOOST_REQUIRE_THROW( pool.add( htrx ), fc::exception );
+    BOOST_CHECK( !pool.contains( htrx.id() ) );
+    BOOST_CHECK( !pool.get_spender( trx.inputs[0].output_ref ) );
+    BOOST_CHECK( pool.bytes() == 0 );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( mempool_replacement )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+
+    auto key     = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "replacement", 11 ) );
+    auto genesis = create_test_genesis_block( chain, key );
+    chain.push_block( genesis );
+
+    // passing a smaller amount leaves a bigger fee
+    output_reference coin( genesis.trxs[0].id(), 0 );
+    asset            amount = genesis.trxs[0].outputs[0].amount;
+    std::vector<trx_output> gift( 1, trx_output( claim_by_signature_output( address() ), asset( 1., asset::bts ) ) );
+    hashed_transaction low( create_test_spend( key, coin, amount ) );
+    hashed_transaction same( create_test_spend( key, coin, amount, gift ) );
+    hashed_transaction high( create_test_spend( key, coin, amount - asset( uint64_t(100000), asset::bts ) ) );
+
+    mempool pool( &chain );
+    BOOST_CHECK( pool.add( low ) );
+    BOOST_CHECK( !pool.add( low ) );
+    BOOST_CHECK( *pool.get_spender( coin ) == low.id() );
+
+    // a double spend must pay a higher fee rate to replace the pending trx
+    BOOST_REQUIRE_THROW( pool.add( same ), fc::exception );
+    BOOST_CHECK( pool.contains( low.id() ) );
+
+    BOOST_CHECK( pool.add( high ) );
+    BOOST_CHECK( !pool.contains( low.id() ) );
+    BOOST_CHECK_EQUAL( pool.size(), 1u );
+    BOOST_CHECK_EQUAL( pool.bytes(), high.size() );
+    BOOST_CHECK( *pool.get_spender( coin ) == high.id() );
+    BOOST_REQUIRE_EQUAL( pool.get_block_template().size(), 1u );
+    BOOST_CHECK( pool.get_block_template()[0].id() == high.id() );
+
+    // once a block spends the output nothing spending it is left pending
+    auto block = create_test_block( chain, std::vector<signed_transaction>( 1, high.trx() ) );
+    chain.push_block( block );
+    pool.handle_block( block );
+    BOOST_CHECK_EQUAL( pool.size(), 0u );
+    BOOST_CHECK( !pool.get_spender( coin ) );
+    BOOST_REQUIRE_THROW( pool.add( low ), fc::exception );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( mempool_chained_trxs )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+
+    auto key = fc::ecc::private_key::generate();
+    signed_transaction parent;
+    parent.inputs.push_back( trx_input( output_reference( uint160(), 0 ) ) );
+    parent.outputs.push_back( trx_output( claim_by_signature_output( bts::address( key.get_public_key() ) ), asset( 1000, asset::bts ) ) );
+    parent.sign( key );
+
+    signed_transaction child;
+    child.inputs.push_back( trx_input( output_reference( parent.id(), 0 ) ) );
+    child.outputs.push_back( trx_output( claim_by_signature_output( bts::address( key.get_public_key() ) ), asset( 900, asset::bts ) ) );
+    child.sign( key );
+
+    // the child resolves its input through the outputs of the unconfirmed parent
+    BOOST_REQUIRE_THROW( chain.fetch_inputs( child.inputs ), fc::exception );
+    pending_outputs pending;
+    add_pending_outputs( pending, parent, parent.id() );
+    auto inputs = chain.fetch_inputs( child.inputs, INVALID_BLOCK_NUM, &pending );
+    BOOST_REQUIRE( inputs.size() == 1 );
+    BOOST_CHECK( inputs[0].output.amount == parent.outputs[0].amount );
+    BOOST_CHECK( !inputs[0].meta_output.is_spent() );
+
+    // without the parent the child waits in the orphan pool
+    mempool pool( &chain );
+    hashed_transaction hchild( child );
+    BOOST_CHECK( !pool.add( hchild ) );
+    BOOST_CHECK( pool.is_orphan( hchild.id() ) );
+    BOOST_CHECK( !pool.contains( hchild.id() ) );
+    BOOST_CHECK( pool.orphan_count() == 1 );
+    BOOST_CHECK( !pool.add( hchild ) );
+    BOOST_CHECK( pool.orphan_count() == 1 );
+
+    pool.set_max_orphans( 0 );
+    BOOST_CHECK( pool.orphan_count() == 0 );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( mempool_replacement_spends_replaced )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+
+    auto key     = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "ancestors", 9 ) );
+    auto genesis = create_test_genesis_block( chain, key );
+    chain.push_block( genesis );
+
+    output_reference coin( genesis.trxs[0].id(), 0 );
+    asset            amount = genesis.trxs[0].outputs[0].amount;
+    hashed_transaction parent( create_test_spend( key, coin, amount ) );
+    hashed_transaction child( create_test_spend( key, output_reference( parent.id(), 0 ), parent.trx().outputs[0].amount ) );
+
+    mempool pool( &chain );
+    BOOST_CHECK( pool.add( parent ) );
+    BOOST_CHECK( pool.add( child ) );
+
+    // double spends the coin and spends the child, which replacing the parent would drop
+    signed_transaction cheat;
+    cheat.inputs.push_back( trx_input( coin ) );
+    cheat.inputs.push_back( trx_input( output_reference( child.id(), 0 ) ) );
+    cheat.outputs.push_back( trx_output( claim_by_signature_output( address( key.get_public_key() ) ),
+                                         amount + child.trx().outputs[0].amount - asset( 1., asset::bts ) ) );
+    cheat.sign( key );
+    BOOST_REQUIRE_THROW( pool.add( hashed_transaction( cheat ) ), fc::exception );
+
+    BOOST_CHECK( !pool.contains( cheat.id() ) );
+    BOOST_CHECK( pool.contains( parent.id() ) );
+    BOOST_CHECK( pool.contains( child.id() ) );
+    BOOST_CHECK( *pool.get_spender( coin ) == parent.id() );
+    BOOST_CHECK_EQUAL( pool.bytes(), parent.size() + child.size() );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( mempool_orphan_parent_replaced )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+
+    auto key     = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "orphans", 7 ) );
+    auto genesis = create_test_genesis_block( chain, key );
+    chain.push_block( genesis );
+
+    output_reference coin( genesis.trxs[0].id(), 0 );
+    asset            amount = genesis.trxs[0].outputs[0].amount;
+    hashed_transaction parent( create_test_spend( key, coin, amount ) );
+    output_reference   change( parent.id(), 0 );
+    hashed_transaction child( create_test_spend( key, change, parent.trx().outputs[0].amount ) );
+    hashed_transaction replacement( create_test_spend( key, coin, amount - asset( uint64_t(100000), asset::bts ) ) );
+
+    mempool pool( &chain );
+    BOOST_CHECK( !pool.add( child ) );
+    BOOST_CHECK( pool.is_orphan( child.id() ) );
+
+    // the parent arriving promotes the orphan
+    BOOST_CHECK( pool.add( parent ) );
+    BOOST_CHECK( pool.contains( child.id() ) );
+    BOOST_CHECK( !pool.is_orphan( child.id() ) );
+    BOOST_CHECK( *pool.get_spender( change ) == child.id() );
+
+    // replacing the parent orphans the child again rather than leaving it pending
+    BOOST_CHECK( pool.add( replacement ) );
+    BOOST_CHECK( !pool.contains( parent.id() ) );
+    BOOST_CHECK( !pool.contains( child.id() ) );
+    BOOST_CHECK( pool.is_orphan( child.id() ) );
+    BOOST_CHECK( !pool.get_spender( change ) );
+    BOOST_CHECK_EQUAL( pool.size(), 1u );
+    BOOST_CHECK_EQUAL( pool.bytes(), replacement.size() );
+    BOOST_REQUIRE_EQUAL( pool.get_block_template().size(), 1u );
+    BOOST_CHECK( pool.get_block_template()[0].id() == replacement.id() );
+
+    // a block including the parent after all brings the child back
+    auto block = create_test_block( chain, std::vector<signed_transaction>( 1, parent.trx() ) );
+    chain.push_block( block );
+    pool.handle_block( block );
+    BOOST_CHECK( !pool.contains( replacement.id() ) );
+    BOOST_CHECK( pool.contains( child.id() ) );
+    BOOST_CHECK_EQUAL( pool.orphan_count(), 0u );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( block_pipeline_apply )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+
+    auto key     = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "pipeline", 8 ) );
+    auto genesis = create_test_genesis_block( chain, key );
+
+    uint32_t applied = 0;
+    block_pipeline pipeline( &chain, 2 );
+    pipeline.set_applied_handler( [&]( const trx_block& b ){ ++applied; } );
+
+    pipeline.push( fc::raw::pack( genesis ) );
+    BOOST_CHECK_EQUAL( pipeline.size(), 1u );
+    pipeline.flush();
+    BOOST_CHECK_EQUAL( pipeline.size(), 0u );
+    BOOST_CHECK_EQUAL( applied, 1u );
+    BOOST_CHECK( chain.head_block_id() == genesis.id() );
+
+    auto stats = pipeline.get_stats();
+    BOOST_CHECK_EQUAL( stats.decode.blocks, 1u );
+    BOOST_CHECK_EQUAL( stats.verify.blocks, 1u );
+    BOOST_CHECK_EQUAL( stats.apply.blocks, 1u );
+
+    // a block that fails is not applied and nothing is left in flight
+    pipeline.push( genesis );
+    BOOST_REQUIRE_THROW( pipeline.flush(), fc::exception );
+    BOOST_CHECK_EQUAL( pipeline.size(), 0u );
+    BOOST_CHECK_EQUAL( applied, 1u );
+    BOOST_CHECK_EQUAL( chain.head_block_num(), 0u );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( block_pipeline_dependent_blocks )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db source;
+    source.open( temp_dir.path() / "source" );
+
+    auto key     = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "dependent", 9 ) );
+    auto genesis = create_test_genesis_block( source, key );
+    source.push_block( genesis );
+
+    // every block spends the change of the one before it
+    std::vector<trx_block> blocks( 1, genesis );
+    output_reference change( genesis.trxs[0].id(), 0 );
+    asset            amount = genesis.trxs[0].outputs[0].amount;
+    for( uint32_t i = 0; i < 5; ++i )
+    {
+       auto trx = create_test_spend( key, change, amount );
+       blocks.push_back( create_test_block( source, std::vector<signed_transaction>( 1, trx ) ) );
+       source.push_block( blocks.back() );
+       change = output_reference( trx.id(), trx.outputs.size() - 1 );
+       amount = trx.outputs.back().amount;
+    }
+
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+    block_pipeline pipeline( &chain, 3 );
+    for( auto b = blocks.begin(); b != blocks.end(); ++b )
+    {
+       pipeline.push( fc::raw::pack( *b ) );
+    }
+    pipeline.flush();
+
+    BOOST_CHECK_EQUAL( chain.head_block_num(), source.head_block_num() );
+    BOOST_CHECK( chain.head_block_id() == source.head_block_id() );
+    for( auto b = blocks.begin(); b != blocks.end(); ++b )
+    {
+       BOOST_CHECK( chain.has_transaction( b->trxs.back().id() ) );
+    }
+    // only the change of the last block is left unspent
+    BOOST_CHECK( chain.fetch_trx( chain.fetch_trx_num( blocks[1].trxs.back().id() ) ).meta_outputs.back().is_spent() );
+    BOOST_CHECK( !chain.fetch_trx( chain.fetch_trx_num( blocks.back().trxs.back().id() ) ).meta_outputs.back().is_spent() );
+
+    auto stats = pipeline.get_stats();
+    BOOST_CHECK_EQUAL( stats.decode.blocks,   blocks.size() );
+    BOOST_CHECK_EQUAL( stats.prefetch.blocks, blocks.size() );
+    BOOST_CHECK_EQUAL( stats.verify.blocks,   blocks.size() );
+    BOOST_CHECK_EQUAL( stats.apply.blocks,    blocks.size() );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( assume_valid_checkpoint )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+
+    auto key     = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "checkpoint", 10 ) );
+    auto genesis = create_test_genesis_block( chain, key );
+
+    // the block at the checkpoint height must be the trusted one
+    chain.set_assume_valid( 0, block_id_type() );
+    BOOST_REQUIRE_THROW( chain.push_block( genesis ), fc::exception );
+    chain.set_assume_valid( 0, genesis.id() );
+    chain.push_block( genesis );
+    BOOST_CHECK_EQUAL( chain.assume_valid_block_num(), 0u );
+
+    signed_transaction unsigned_trx;
+    unsigned_trx.inputs.push_back( trx_input( output_reference( genesis.trxs[0].id(), 0 ) ) );
+    unsigned_trx.outputs.push_back( trx_output( claim_by_signature_output( address( key.get_public_key() ) ), asset( 50., asset::bts ) ) );
+
+    BOOST_REQUIRE_THROW( chain.evaluate_signed_transaction( unsigned_trx, true ), fc::exception );
+    chain.evaluate_signed_transaction( unsigned_trx, true, false, nullptr, nullptr, nullptr, false );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( assume_valid_ancestors )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db source;
+    source.open( temp_dir.path() / "source" );
+
+    auto key     = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "assume_valid", 12 ) );
+    auto genesis = create_test_genesis_block( source, key );
+    source.push_block( genesis );
+
+    // block 1 carries a trx without signatures, the source takes it as its checkpoint
+    auto spend1 = create_test_spend( key, output_reference( genesis.trxs[0].id(), 0 ), genesis.trxs[0].outputs[0].amount );
+    auto block1 = create_test_block( source, std::vector<signed_transaction>( 1, spend1 ), true );
+    BOOST_REQUIRE( block1.trxs.back().sigs.empty() );
+    source.set_assume_valid( 1, block1.id() );
+    source.push_block( block1 );
+
+    const signed_transaction& unsigned1 = block1.trxs.back();
+    auto spend2 = create_test_spend( key, output_reference( unsigned1.id(), 0 ), unsigned1.outputs[0].amount );
+    auto block2 = create_test_block( source, std::vector<signed_transaction>( 1, spend2 ) );
+    source.push_block( block2 );
+
+    // a checkpoint above block 1 does not vouch for it until headers link the two
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+    chain.set_assume_valid( 2, block2.id() );
+    chain.push_block( genesis );
+    BOOST_REQUIRE_THROW( chain.push_block( block1 ), fc::exception );
+    BOOST_CHECK_EQUAL( chain.head_block_num(), 0u );
+
+    std::vector<block_header> headers;
+    headers.push_back( genesis );
+    headers.push_back( block1 );
+    headers.push_back( block2 );
+    std::vector<block_header> forged( headers );
+    ++forged[1].noncea;
+    BOOST_REQUIRE_THROW( chain.add_assume_valid_headers( forged ), fc::exception );
+    BOOST_CHECK( !chain.get_assume_valid_chain()->covers( 1, block1.id() ) );
+
+    chain.add_assume_valid_headers( headers );
+    BOOST_CHECK( chain.get_assume_valid_chain()->covers( 0, genesis.id() ) );
+    BOOST_CHECK( chain.get_assume_valid_chain()->covers( 1, block1.id() ) );
+    BOOST_CHECK_EQUAL( chain.assume_valid_block_num(), 2u );
+    chain.push_block( block1 );
+    chain.push_block( block2 );
+    BOOST_CHECK( chain.head_block_id() == block2.id() );
+
+    // above the checkpoint every signature is checked again
+    auto spend3 = create_test_spend( key, output_reference( spend2.id(), 0 ), spend2.outputs[0].amount );
+    auto block3 = create_test_block( chain, std::vector<signed_transaction>( 1, spend3 ), true );
+    BOOST_REQUIRE_THROW( chain.push_block( block3 ), fc::exception );
+    BOOST_CHECK_EQUAL( chain.head_block_num(), 2u );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( export_import_state )
+{
+  try {
+    fc::temp_directory temp_dir;
+    auto key     = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "state", 5 ) );
+    auto file    = temp_dir.path() / "chain.state";
+
+    trx_block genesis;
+    {
+       bts::blockchain::blockchain_db chain;
+       chain.open( temp_dir.path() / "exported" );
+       BOOST_REQUIRE_THROW( chain.export_state( file ), fc::exception );
+       genesis = create_test_genesis_block( chain, key );
+       chain.push_block( genesis );
+       chain.export_state( file );
+    }
+
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "imported" );
+    chain.import_state( file );
+    BOOST_CHECK_EQUAL( chain.head_block_num(), 0u );
+    BOOST_CHECK( chain.head_block_id() == genesis.id() );
+    BOOST_CHECK( chain.has_transaction( genesis.trxs[0].id() ) );
+    BOOST_CHECK_EQUAL( chain.fetch_block_num( genesis.id() ), 0u );
+
+    // the imported unspent outputs can be spent
+    signed_transaction trx;
+    trx.inputs.push_back( trx_input( output_reference( genesis.trxs[0].id(), 0 ) ) );
+    trx.outputs.push_back( trx_output( claim_by_signature_output( address( key.get_public_key() ) ), asset( 50., asset::bts ) ) );
+    trx.sign( key );
+    chain.evaluate_signed_transaction( trx, true );
+
+    // only an empty chain can be imported into
+    BOOST_REQUIRE_THROW( chain.import_state( file ), fc::exception );
+
+    // a file that was cut short fails its checksum
+    auto truncated = temp_dir.path() / "truncated.state";
+    {
+       std::ifstream in( file.generic_string().c_str(), std::ios::binary );
+       std::vector<char> data( (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>() );
+       std::ofstream out( truncated.generic_string().c_str(), std::ios::binary );
+       out.write( data.data(), data.size() - 1 );
+    }
+    bts::blockchain::blockchain_db empty;
+    empty.open( temp_dir.path() / "empty" );
+    BOOST_REQUIRE_THROW( empty.import_state( truncated ), fc::exception );
+    BOOST_CHECK_EQUAL( empty.head_block_num(), uint32_t(-1) );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( block_archive_segments )
+{
+  try {
+    fc::temp_directory temp_dir;
+    auto shared_db = std::make_shared<bts::db::database>();
+    shared_db->open( temp_dir.path() / "database" );
+
+    std::vector<trx_block> blocks( 3 );
+    for( uint32_t i = 0; i < blocks.size(); ++i )
+    {
+       blocks[i].block_num = i;
+       for( uint32_t t = 0; t <= i; ++t )
+       {
+          signed_transaction trx;
+          trx.inputs.push_back( trx_input( output_reference( fc::ripemd160::hash( std::string( t+1, 'a'+i ) ), t ) ) );
+          trx.outputs.push_back( trx_output( claim_by_signature_output( address() ), asset( uint64_t(t+1), asset::bts ) ) );
+          blocks[i].trxs.push_back( trx );
+       }
+    }
+
+    {
+       // small enough that every block starts a new segment
+       block_archive archive;
+       archive.open( temp_dir.path() / "archive", shared_db, 16 );
+       for( uint32_t i = 0; i < blocks.size(); ++i )
+       {
+          bts::db::write_batch batch;
+          archive.join( batch );
+          archive.store( blocks[i] );
+          BOOST_CHECK( !archive.fetch_location( i ) );
+          batch.commit();
+          BOOST_CHECK_EQUAL( archive.fetch_location( i )->segment, i );
+       }
+    }
+
+    block_archive archive;
+    archive.open( temp_dir.path() / "archive", shared_db, 16 );
+    for( uint32_t i = 0; i < blocks.size(); ++i )
+    {
+       std::vector<char> packed;
+       BOOST_REQUIRE( archive.fetch_packed( i, packed ) );
+       BOOST_CHECK( packed == fc::raw::pack( blocks[i] ) );
+
+       trx_block b;
+       BOOST_REQUIRE( archive.fetch( i, b ) );
+       BOOST_CHECK( b.id() == blocks[i].id() );
+       for( uint16_t t = 0; t < blocks[i].trxs.size(); ++t )
+       {
+          signed_transaction trx;
+          BOOST_REQUIRE( archive.fetch_trx( i, t, trx ) );
+          BOOST_CHECK( trx.id() == blocks[i].trxs[t].id() );
+       }
+    }
+    trx_block missing;
+    BOOST_CHECK( !archive.fetch( uint32_t(blocks.size()), missing ) );
+
+    // segments are deleted once none of their blocks are indexed, and the block
+    // that removed the entries can no longer be popped to restore them
+    {
+       bts::db::write_batch batch;
+       archive.join( batch );
+       archive.remove( 0 );
+       archive.remove( 1 );
+       batch.commit();
+    }
+    archive.remove_unused_segments( 10 );
+    archive.remove_unused_segments( 10 + BLOCKCHAIN_UNDO_BLOCKS - 1 );
+    BOOST_CHECK( fc::exists( temp_dir.path() / "archive" / "blocks-000000.dat" ) );
+    BOOST_CHECK( fc::exists( temp_dir.path() / "archive" / "blocks-000001.dat" ) );
+
+    // after a pop the segments are timed again
+    archive.clear_cache();
+    archive.remove_unused_segments( 10 + BLOCKCHAIN_UNDO_BLOCKS );
+    BOOST_CHECK( fc::exists( temp_dir.path() / "archive" / "blocks-000000.dat" ) );
+    archive.remove_unused_segments( 10 + 2*BLOCKCHAIN_UNDO_BLOCKS );
+    BOOST_CHECK( !fc::exists( temp_dir.path() / "archive" / "blocks-000000.dat" ) );
+    BOOST_CHECK( !fc::exists( temp_dir.path() / "archive" / "blocks-000001.dat" ) );
+    BOOST_CHECK( archive.fetch( 2, missing ) );
+    BOOST_CHECK( !archive.fetch( 1, missing ) );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( prune_depth )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+    BOOST_CHECK_EQUAL( chain.prune_depth(), 0u );
+    BOOST_CHECK_EQUAL( chain.first_full_block(), 0u );
+
+    // blocks that may still be popped are never pruned
+    BOOST_REQUIRE_THROW( chain.set_prune_depth( BLOCKCHAIN_MIN_PRUNE_DEPTH - 1 ), fc::exception );
+    chain.set_prune_depth( BLOCKCHAIN_MIN_PRUNE_DEPTH );
+    BOOST_CHECK_EQUAL( chain.prune_depth(), uint32_t(BLOCKCHAIN_MIN_PRUNE_DEPTH) );
+
+    // nothing is deep enough to prune yet
+    auto key     = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "prune", 5 ) );
+    auto genesis = create_test_genesis_block( chain, key );
+    chain.push_block( genesis );
+    BOOST_CHECK_EQUAL( chain.first_full_block(), 0u );
+    BOOST_CHECK( chain.fetch_trx_block( 0 ).id() == genesis.id() );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( block_archive_pop )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+
+    auto key     = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "archive_pop", 11 ) );
+    auto genesis = create_test_genesis_block( chain, key );
+    chain.push_block( genesis );
+
+    output_reference coinbase( genesis.trxs[0].id(), 0 );
+    auto trx   = create_test_spend( key, coinbase, genesis.trxs[0].outputs[0].amount );
+    auto block = create_test_block( chain, std::vector<signed_transaction>( 1, trx ) );
+    chain.push_block( block );
+
+    // reading the block caches its archive location
+    BOOST_CHECK( chain.fetch_trx_block( 1 ).id() == block.id() );
+
+    full_block                      popped;
+    std::vector<signed_transaction> popped_trxs;
+    chain.pop_block( popped, popped_trxs );
+    BOOST_CHECK( popped.id() == block.id() );
+    BOOST_CHECK_EQUAL( chain.head_block_num(), 0u );
+
+    // the popped block is no longer served, not even from the cache
+    BOOST_REQUIRE_THROW( chain.fetch_trx_block( 1 ), fc::exception );
+    BOOST_REQUIRE_THROW( chain.get_snapshot()->fetch_packed_trx_block( 1 ), fc::exception );
+    BOOST_CHECK( !chain.has_transaction( trx.id() ) );
+
+    // a different block at the same height is served in its place
+    std::vector<trx_output> outputs( 1, trx_output( claim_by_signature_output( address( key.get_public_key() ) ), asset( 1., asset::bts ) ) );
+    auto other       = create_test_spend( key, coinbase, genesis.trxs[0].outputs[0].amount, outputs );
+    auto other_block = create_test_block( chain, std::vector<signed_transaction>( 1, other ) );
+    chain.push_block( other_block );
+    BOOST_CHECK( chain.fetch_trx_block( 1 ).id() == other_block.id() );
+    BOOST_CHECK( chain.get_snapshot()->fetch_packed_trx_block( 1 ) == fc::raw::pack( other_block ) );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( prune_spent_transactions )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+    chain.set_prune_depth( BLOCKCHAIN_MIN_PRUNE_DEPTH );
+
+    auto key     = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "pruned", 6 ) );
+    auto genesis = create_test_genesis_block( chain, key );
+    chain.push_block( genesis );
+
+    // block 1 leaves one output unspent, every later block spends the change of the one before
+    std::vector<trx_block>  blocks( 1, genesis );
+    std::vector<trx_output> kept( 1, trx_output( claim_by_signature_output( address( key.get_public_key() ) ), asset( 1., asset::bts ) ) );
+    auto first = create_test_spend( key, output_reference( genesis.trxs[0].id(), 0 ), genesis.trxs[0].outputs[0].amount, kept );
+    blocks.push_back( create_test_block( chain, std::vector<signed_transaction>( 1, first ) ) );
+    chain.push_block( blocks.back() );
+
+    signed_transaction last = first;
+    const uint32_t head = BLOCKCHAIN_MIN_PRUNE_DEPTH + 7;
+    while( chain.head_block_num() < head )
+    {
+       last = create_test_spend( key, output_reference( last.id(), last.outputs.size() - 1 ), last.outputs.back().amount );
+       blocks.push_back( create_test_block( chain, std::vector<signed_transaction>( 1, last ) ) );
+       chain.push_block( blocks.back() );
+    }
+
+    // the blocks more than the prune depth below the head lost their transactions
+    const uint32_t first_full = head - BLOCKCHAIN_MIN_PRUNE_DEPTH + 1;
+    BOOST_CHECK_EQUAL( chain.first_full_block(), first_full );
+    for( uint32_t n = 0; n < first_full; ++n )
+    {
+       BOOST_CHECK_THROW( chain.fetch_trx_block( n ), fc::exception );
+    }
+    BOOST_CHECK( chain.fetch_trx_block( first_full ).id() == blocks[first_full].id() );
+
+    // fully spent trxs are forgotten, the id of the one with an unspent output is kept
+    BOOST_CHECK( !chain.has_transaction( genesis.trxs[0].id() ) );
+    BOOST_CHECK_THROW( chain.fetch_trx( trx_num( 0, 0 ) ), fc::exception );
+    for( uint32_t n = 2; n < first_full; ++n )
+    {
+       BOOST_CHECK( !chain.has_transaction( blocks[n].trxs.back().id() ) );
+       BOOST_CHECK_THROW( chain.fetch_trx( trx_num( n, 0 ) ), fc::exception );
+    }
+    BOOST_CHECK( chain.has_transaction( first.id() ) );
+    BOOST_CHECK_EQUAL( chain.fetch_trx_num( first.id() ).block_num, 1u );
+    BOOST_CHECK( chain.has_transaction( blocks[first_full].trxs.back().id() ) );
+
+    // every header survives
+    for( uint32_t n = 0; n < blocks.size(); ++n )
+    {
+       BOOST_CHECK( chain.fetch_block( n ).id() == blocks[n].id() );
+       BOOST_CHECK_EQUAL( chain.fetch_block_num( blocks[n].id() ), n );
+    }
+
+    // new blocks still validate, spending the last output of a pruned block drops its trx
+    std::vector<signed_transaction> trxs;
+    trxs.push_back( create_test_spend( key, output_reference( first.id(), 0 ), first.outputs[0].amount ) );
+    trxs.push_back( create_test_spend( key, output_reference( last.id(), last.outputs.size() - 1 ), last.outputs.back().amount ) );
+    auto next = create_test_block( chain, trxs );
+    BOOST_REQUIRE_EQUAL( next.trxs.size(), 2u );
+    chain.push_block( next );
+    BOOST_CHECK_EQUAL( chain.head_block_num(), head + 1 );
+    BOOST_CHECK( !chain.has_transaction( first.id() ) );
+    BOOST_CHECK( chain.has_transaction( trxs[0].id() ) );
+
+    // popping it restores what it pruned, its archived bytes are still there
+    full_block                      popped;
+    std::vector<signed_transaction> popped_trxs;
+    chain.pop_block( popped, popped_trxs );
+    BOOST_CHECK( popped.id() == next.id() );
+    BOOST_CHECK_EQUAL( chain.first_full_block(), first_full );
+    BOOST_CHECK( chain.fetch_trx_block( first_full ).id() == blocks[first_full].id() );
+    BOOST_CHECK( chain.has_transaction( first.id() ) );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( address_index )
+{
+  try {
+    fc::temp_directory temp_dir;
+    auto key   = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "address", 7 ) );
+    auto other = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "other", 5 ) );
+    address owner( key.get_public_key() );
+
+    {
+       bts::blockchain::blockchain_db chain;
+       chain.open( temp_dir.path() / "chain" );
+       BOOST_CHECK( chain.has_address_index() );
+       auto genesis = create_test_genesis_block( chain, key );
+       chain.push_block( genesis );
+
+       auto owned = chain.fetch_unspent_outputs( owner );
+       BOOST_REQUIRE_EQUAL( owned.size(), 1u );
+       BOOST_CHECK( owned[0].location == output_reference( genesis.trxs[0].id(), 0 ) );
+       BOOST_CHECK( owned[0].output.output.amount == genesis.trxs[0].outputs[0].amount );
+       BOOST_CHECK_EQUAL( owned[0].output.source.block_num, 0u );
+       BOOST_CHECK( chain.fetch_unspent_outputs( address( other.get_public_key() ) ).empty() );
+       BOOST_CHECK( chain.fetch_unspent_outputs( pts_address( key.get_public_key() ) ).empty() );
+       BOOST_CHECK_EQUAL( chain.get_snapshot()->fetch_unspent_outputs( owner ).size(), 1u );
+       chain.close();
+    }
+    {
+       // turning the index off drops it
+       bts::blockchain::blockchain_db chain;
+       chain.set_address_index( false );
+       chain.open( temp_dir.path() / "chain" );
+       BOOST_REQUIRE_THROW( chain.fetch_unspent_outputs( owner ), fc::exception );
+       chain.close();
+    }
+    {
+       // and turning it back on builds it from the unspent outputs
+       bts::blockchain::blockchain_db chain;
+       chain.open( temp_dir.path() / "chain" );
+       BOOST_CHECK_EQUAL( chain.fetch_unspent_outputs( owner ).size(), 1u );
+       chain.close();
+    }
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( market_order_book )
+{
+  try {
+    fc::temp_directory temp_dir;
+    auto order = []( double p, uint8_t idx )
+    {
+       return market_order( price( p, asset::usd, asset::bts ), output_reference( fc::uint160(), idx ) );
+    };
+
+    market_db market;
+    market.open( temp_dir.path() / "market" );
+    market.insert_bid( order( 1.0, 1 ), 0 );
+    market.insert_bid( order( 2.0, 2 ), 0 );
+    market.insert_bid( order( 2.0, 1 ), 0 );
+
+    // levels from the lowest price up, orders at a price in location order
+    auto bids = market.get_bids( asset::usd, asset::bts );
+    BOOST_REQUIRE_EQUAL( bids.size(), 3u );
+    BOOST_CHECK( bids[0] == order( 1.0, 1 ) );
+    BOOST_CHECK( bids[1] == order( 2.0, 1 ) );
+    BOOST_CHECK( bids[2] == order( 2.0, 2 ) );
+    BOOST_CHECK( *market.get_highest_bid( asset::usd, asset::bts ) == order( 2.0, 2 ) );
+    BOOST_CHECK( !market.get_lowest_ask( asset::usd, asset::bts ) );
+    BOOST_CHECK( market.get_bids( asset::gld, asset::bts ).empty() );
+
+    // the books only change when a batch commits
+    {
+       db::write_batch batch;
+       market.join( batch );
+       market.insert_ask( order( 3.0, 3 ), 100 );
+       market.remove_bid( order( 1.0, 1 ), 0 );
+    }
+    BOOST_CHECK( market.get_asks( asset::usd, asset::bts ).empty() );
+    BOOST_CHECK_EQUAL( market.get_bids( asset::usd, asset::bts ).size(), 3u );
+    {
+       db::write_batch batch;
+       market.join( batch );
+       market.insert_ask( order( 3.0, 3 ), 100 );
+       market.insert_ask( order( 4.0, 4 ), 100 );
+       market.remove_bid( order( 1.0, 1 ), 0 );
+       BOOST_CHECK( market.get_asks( asset::usd, asset::bts ).empty() );
+       batch.commit();
+    }
+    BOOST_CHECK_EQUAL( market.get_asks( asset::usd, asset::bts ).size(), 2u );
+    BOOST_CHECK( *market.get_lowest_ask( asset::usd, asset::bts ) == order( 3.0, 3 ) );
+    BOOST_CHECK_EQUAL( market.get_bids( asset::usd, asset::bts ).size(), 2u );
+    market.close();
+
+    // and are loaded from the database when it is opened
+    market_db reopened;
+    reopened.open( temp_dir.path() / "market" );
+    BOOST_CHECK( reopened.get_bids( asset::usd, asset::bts ) == std::vector<market_order>( { order( 2.0, 1 ), order( 2.0, 2 ) } ) );
+    BOOST_CHECK( *reopened.get_lowest_ask( asset::usd, asset::bts ) == order( 3.0, 3 ) );
+    reopened.close();
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( market_order_book_levels )
+{
+  try {
+    fc::temp_directory temp_dir;
+    auto order = []( double p, uint8_t idx )
+    {
+       return market_order( price( p, asset::usd, asset::bts ), output_reference( fc::uint160(), idx ) );
+    };
+    std::map<uint8_t,uint64_t> amounts;
+    amounts[1] = 10; amounts[2] = 20; amounts[3] = 30; amounts[4] = 40; amounts[5] = 50;
+
+    market_db market;
+    market.open( temp_dir.path() / "market" );
+    market.insert_bid( order( 1.0, 1 ), 0 );
+    market.set_order_amounts( [&]( const market_order& m ){ return amounts[m.location.output_idx]; } );
+    market.insert_bid( order( 2.0, 2 ), 0 );
+    market.insert_bid( order( 2.0, 3 ), 0 );
+    market.insert_ask( order( 3.0, 4 ), 0 );
+    market.insert_ask( order( 4.0, 5 ), 0 );
+
+    // the best price first on both sides, amounts summed away from the spread
+    auto book = market.get_order_book( asset::usd, asset::bts, 10 );
+    BOOST_CHECK( *book.best_bid == price( 2.0, asset::usd, asset::bts ) );
+    BOOST_CHECK( *book.best_ask == price( 3.0, asset::usd, asset::bts ) );
+    BOOST_CHECK_EQUAL( book.bid_orders, 3u );
+    BOOST_REQUIRE_EQUAL( book.bids.size(), 2u );
+    BOOST_CHECK_EQUAL( book.bids[0].amount, 50u );
+    BOOST_CHECK_EQUAL( book.bids[0].orders, 2u );
+    BOOST_CHECK_EQUAL( book.bids[1].amount, 10u );
+    BOOST_CHECK_EQUAL( book.bids[1].cumulative_amount, 60u );
+    BOOST_REQUIRE_EQUAL( book.asks.size(), 2u );
+    BOOST_CHECK_EQUAL( book.asks[1].cumulative_amount, 90u );
+
+    // only the requested levels are returned, the counts cover the whole book
+    market.remove_bid( order( 2.0, 2 ), 0 );
+    book = market.get_order_book( asset::usd, asset::bts, 1 );
+    BOOST_CHECK_EQUAL( book.bid_levels, 2u );
+    BOOST_REQUIRE_EQUAL( book.bids.size(), 1u );
+    BOOST_CHECK_EQUAL( book.bids[0].amount, 30u );
+    BOOST_CHECK_EQUAL( book.bids[0].orders, 1u );
+
+    BOOST_CHECK( market.get_order_book( asset::gld, asset::bts, 10 ).bids.empty() );
+    BOOST_CHECK( !market.get_order_book( asset::gld, asset::bts, 10 ).best_ask );
+    market.close();
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( market_history_candles )
+{
+  try {
+    fc::temp_directory temp_dir;
+    auto point = []( asset::type quote, uint32_t block, uint32_t sec, double p, uint64_t volume )
+    {
+       price_point pt;
+       pt.from_block   = pt.to_block = block;
+       pt.from_time    = pt.to_time  = fc::time_point_sec( sec );
+       pt.open_bid     = pt.high_bid = pt.low_bid = pt.close_bid = price( p, quote, asset::bts );
+       pt.open_ask     = pt.high_ask = pt.low_ask = pt.close_ask = price( p, quote, asset::bts );
+       pt.quote_volume = asset( volume, quote );
+       pt.base_volume  = asset( volume, asset::bts );
+       return pt;
+    };
+
+    market_db market;
+    market.open( temp_dir.path() / "market" );
+    uint32_t day = daily_candles;
+    market.push_price_point( point( asset::usd, 1, day + 10,   1.0, 1 ) );
+    market.push_price_point( point( asset::gld, 1, day + 10,   9.0, 5 ) );
+    market.push_price_point( point( asset::usd, 2, day + 600,  3.0, 2 ) );
+    market.push_price_point( point( asset::usd, 3, day + 3700, 2.0, 4 ) );
+
+    // each pair is scanned on its own now that the keys are ordered
+    BOOST_CHECK_EQUAL( market.get_history( asset::usd, asset::bts, fc::time_point_sec( 0 ), fc::time_point_sec( 2*day ) ).size(), 3u );
+    BOOST_CHECK_EQUAL( market.get_history( asset::gld, asset::bts, fc::time_point_sec( 0 ), fc::time_point_sec( 2*day ) ).size(), 1u );
+
+    auto hours = market.get_candles( asset::usd, asset::bts, hourly_candles, fc::time_point_sec( day + 100 ), fc::time_point_sec( 2*day ) );
+    BOOST_REQUIRE_EQUAL( hours.size(), 2u );
+    BOOST_CHECK_EQUAL( hours[0].from_block, 1u );
+    BOOST_CHECK_EQUAL( hours[0].to_block, 2u );
+    BOOST_CHECK( hours[0].open_bid == price( 1.0, asset::usd, asset::bts ) );
+    BOOST_CHECK( hours[0].close_bid == price( 3.0, asset::usd, asset::bts ) );
+    BOOST_CHECK( hours[0].high_bid == price( 3.0, asset::usd, asset::bts ) );
+    BOOST_CHECK_EQUAL( hours[0].quote_volume.get_rounded_amount(), 3u );
+    BOOST_CHECK_EQUAL( hours[1].from_block, 3u );
+
+    auto days = market.get_candles( asset::usd, asset::bts, daily_candles, fc::time_point_sec( 0 ), fc::time_point_sec( 2*day ) );
+    BOOST_REQUIRE_EQUAL( days.size(), 1u );
+    BOOST_CHECK_EQUAL( days[0].to_block, 3u );
+    BOOST_CHECK_EQUAL( days[0].quote_volume.get_rounded_amount(), 7u );
+    BOOST_CHECK( days[0].low_bid == price( 1.0, asset::usd, asset::bts ) );
+    BOOST_CHECK_EQUAL( market.get_candles( asset::gld, asset::bts, weekly_candles, fc::time_point_sec( 0 ), fc::time_point_sec( 2*day ) ).size(), 1u );
+    BOOST_CHECK_THROW( market.get_candles( asset::usd, asset::bts, 60, fc::time_point_sec( 0 ), fc::time_point_sec( 2*day ) ), fc::exception );
+    market.close();
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( match_orders_by_pair )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+    auto key     = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "match", 5 ) );
+    auto genesis = create_test_genesis_block( chain, key );
+    chain.push_block( genesis );
+
+    // one price point per pair, in the order the pairs are listed whichever thread matched them
+    std::vector<price_point> stats;
+    auto matched = chain.match_orders( &stats );
+    BOOST_CHECK( matched.empty() );
+    BOOST_REQUIRE_EQUAL( stats.size(), size_t(asset::count * (asset::count - 1) / 2) );
+    size_t i = 0;
+    for( uint32_t base = asset::bts; base < asset::count; ++base )
+    {
+       for( uint32_t quote = base + 1; quote < asset::count; ++quote, ++i )
+       {
+          // pairs against bts are skipped without depth and leave their point empty
+          if( base == asset::bts ) continue;
+          BOOST_CHECK( stats[i].quote_volume.unit == asset::type(quote) );
+          BOOST_CHECK( stats[i].base_volume.unit == asset::type(base) );
+          BOOST_CHECK_EQUAL( stats[i].from_block, genesis.block_num );
+       }
+    }
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( match_orders_threads )
+{
+  try {
+    fc::temp_directory temp_dir;
+    bts::blockchain::blockchain_db chain;
+    chain.open( temp_dir.path() / "chain" );
+    auto key     = fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "match_threads", 13 ) );
+    auto owner   = address( key.get_public_key() );
+    auto genesis = create_test_genesis_block( chain, key );
+    chain.push_block( genesis );
+
+    // a short that crosses an ask in two of the pairs against bts
+    auto crossing = [&]( asset::type quote )
+    {
+       std::vector<trx_output> orders;
+       orders.push_back( trx_output( claim_by_bid_output( owner, price( 1.0, quote, asset::bts ) ), asset( 10., asset::bts ) ) );
+       orders.push_back( trx_output( claim_by_long_output( owner, price( 2.0, quote, asset::bts ) ), asset( 10., asset::bts ) ) );
+       return orders;
+    };
+    std::vector<signed_transaction> trxs;
+    trxs.push_back( create_test_spend( key, output_reference( genesis.trxs[0].id(), 0 ), genesis.trxs[0].outputs[0].amount,
+                                       crossing( asset::usd ) ) );
+    trxs.push_back( create_test_spend( key, output_reference( trxs[0].id(), 2 ), trxs[0].outputs[2].amount,
+                                       crossing( asset::gld ) ) );
+    auto block = create_test_block( chain, trxs );
+    BOOST_REQUIRE_EQUAL( block.trxs.size(), 2u );
+    chain.push_block( block );
+
+    auto ids = []( const std::vector<signed_transaction>& matched )
+    {
+       std::vector<transaction_id_type> result;
+       for( auto itr = matched.begin(); itr != matched.end(); ++itr ) result.push_back( itr->id() );
+       return result;
+    };
+
+    chain.set_match_threads( 1 );
+    auto serial = chain.match_orders();
+    BOOST_REQUIRE( !serial.empty() );
+
+    // the usd pair comes before the gld pair
+    bool seen_gld = false;
+    bool seen_usd = false;
+    for( auto trx = serial.begin(); trx != serial.end(); ++trx )
+    {
+       BOOST_REQUIRE( !trx->inputs.empty() );
+       const auto& source = trx->inputs.front().output_ref.trx_hash;
+       if( source == trxs[0].id() )
+       {
+          seen_usd = true;
+          BOOST_CHECK( !seen_gld );
+       }
+       else
+       {
+          BOOST_CHECK( source == trxs[1].id() );
+          seen_gld = true;
+       }
+    }
+    BOOST_CHECK( seen_usd );
+    BOOST_CHECK( seen_gld );
+
+    // and every thread count generates the same trxs in the same order
+    chain.set_match_threads( 4 );
+    BOOST_CHECK( ids( chain.match_orders() ) == ids( serial ) );
+    chain.set_match_threads( 0 );
+    BOOST_CHECK( ids( chain.match_orders() ) == ids( serial ) );
+  } catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string()) );
+    throw;
+  }
+}
+
 BOOST_AUTO_TEST_CASE( fixed_math )
 {
   try{